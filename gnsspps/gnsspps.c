@@ -25,26 +25,313 @@
  * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
  * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <loc_pla.h>
 #include <log_util.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <pthread.h>
 #include <timepps.h>
 #include <linux/types.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <gnsspps.h>
 
-//DRsync kernel timestamp
-static struct timespec drsyncKernelTs = {0,0};
-//DRsync userspace timestamp
-static struct timespec drsyncUserTs = {0,0};
-//flag to stop fetching timestamp
-static int isActive = 0;
-static pps_handle handle;
+#define NSEC_PER_SEC (1000000000LL)
+/* a pulse further than this from a whole number of seconds after the
+   previous one is not from the same 1 Hz train, the history restarts */
+#define PPS_MAX_PHASE_ERROR_NS (100000000LL)
+/* history restarts after this many missed pulses */
+#define PPS_MAX_GAP_SEC (8)
+/* residuals beyond this many sigma are left out of the fit */
+#define PPS_OUTLIER_SIGMA (3.0)
+/* floor of the outlier threshold, ns */
+#define PPS_OUTLIER_MIN_NS (1000.0)
+/* a blocking fetch starts this long before the expected pulse */
+#define PPS_FETCH_GUARD_NS (50000000LL)
+/* longest blocking fetch; bounds the stop latency */
+#define PPS_FETCH_WINDOW_NS (2 * PPS_FETCH_GUARD_NS)
 
-static pthread_mutex_t ts_lock;
+/* everything readers can see, written by the fetch thread only */
+typedef struct {
+    //DRsync kernel timestamp
+    struct timespec drsyncKernelTs;
+    //DRsync userspace timestamp
+    struct timespec drsyncUserTs;
+    pps_estimate estimate;
+    pps_stats stats;
+    /* history ring, oldest at historyHead when full */
+    uint32_t historyHead;
+    uint32_t historyCount;
+    pps_capture history[PPS_HISTORY_SIZE];
+} pps_snapshot;
+
+#define PPS_SNAPSHOT_WORDS ((sizeof(pps_snapshot) + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+/* words needed for the getPPS fields */
+#define PPS_SAMPLE_WORDS \
+    ((2 * sizeof(struct timespec) + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+
+typedef union {
+    pps_snapshot snapshot;
+    uint64_t words[PPS_SNAPSHOT_WORDS];
+} pps_snapshot_words;
+
+struct pps_source {
+    char devname[64];
+    pps_handle handle;
+    /* written to stop the fetch thread */
+    int stopFd;
+    pthread_t thread;
+    int threadStarted;
+    /* published snapshot under a sequence counter. The counter is odd
+       while an update is in progress; readers copy and retry if the
+       counter moved, so they never block the fetch thread or each other */
+    uint32_t seq;
+    pps_snapshot_words published;
+    /* fetch thread working copy */
+    pps_snapshot_words working;
+    /* second index of each history entry, fetch thread only */
+    int64_t pulseIndex[PPS_HISTORY_SIZE];
+    /* sequence number of the last fetched assert event */
+    unsigned int lastSequence;
+    int hasSequence;
+};
+
+/* source behind the initPPS()/getPPS()/deInitPPS() API. Static so that
+   a late getPPS() after deInitPPS() reads a stale sample and not freed
+   memory */
+static struct pps_source defaultSource;
+static int defaultSourceOpen = 0;
+
+/* single writer: the fetch thread */
+static void publish_pps(struct pps_source *src)
+{
+    uint32_t seq = __atomic_load_n(&src->seq, __ATOMIC_RELAXED);
+    size_t i;
+
+    __atomic_store_n(&src->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (i = 0; i < PPS_SNAPSHOT_WORDS; i++) {
+        __atomic_store_n(&src->published.words[i], src->working.words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&src->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* copies the first numWords of a consistent snapshot, retries only if
+   it raced with an update, which happens once per pulse */
+static void read_pps_snapshot(struct pps_source *src, pps_snapshot_words *dst,
+                              size_t numWords)
+{
+    uint32_t seq1, seq2;
+    size_t i;
+
+    do {
+        seq1 = __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE);
+        for (i = 0; i < numWords; i++) {
+            dst->words[i] = __atomic_load_n(&src->published.words[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        seq2 = __atomic_load_n(&src->seq, __ATOMIC_RELAXED);
+    } while ((seq1 & 1) || seq1 != seq2);
+}
+
+static inline int64_t ts_to_ns(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static inline void ns_to_ts(int64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+/* least squares fit of pulse boot time against the pulse second index,
+   over the entries with use[i] set. The line is anchored at the newest
+   pulse, so offset is the fitted boot time of that pulse relative to its
+   measured one. Returns the number of entries used. */
+static int fit_pps(const struct pps_source *src, const int *use, double *offsetNs,
+                   double *periodNs, double *sigmaNs, double *offsetUncNs,
+                   double *periodUncNs, double *residuals)
+{
+    const pps_snapshot *snap = &src->working.snapshot;
+    uint32_t newest = (snap->historyHead + snap->historyCount - 1) % PPS_HISTORY_SIZE;
+    int64_t newestBootNs = ts_to_ns(&snap->history[newest].pulseBoottime);
+    double sumX = 0, sumY = 0, sxx = 0, sxy = 0, sse = 0, meanX, meanY;
+    uint32_t i;
+    int n = 0;
+
+    for (i = 0; i < snap->historyCount; i++) {
+        uint32_t idx = (snap->historyHead + i) % PPS_HISTORY_SIZE;
+        if (use[idx]) {
+            sumX += (double)(src->pulseIndex[idx] - src->pulseIndex[newest]);
+            sumY += (double)(ts_to_ns(&snap->history[idx].pulseBoottime) - newestBootNs);
+            n++;
+        }
+    }
+    if (n < 3) {
+        return 0;
+    }
+    meanX = sumX / n;
+    meanY = sumY / n;
+    for (i = 0; i < snap->historyCount; i++) {
+        uint32_t idx = (snap->historyHead + i) % PPS_HISTORY_SIZE;
+        if (use[idx]) {
+            double dx = (double)(src->pulseIndex[idx] - src->pulseIndex[newest]) - meanX;
+            double dy = (double)(ts_to_ns(&snap->history[idx].pulseBoottime) -
+                                 newestBootNs) - meanY;
+            sxx += dx * dx;
+            sxy += dx * dy;
+        }
+    }
+    if (sxx <= 0) {
+        return 0;
+    }
+    *periodNs = sxy / sxx;
+    *offsetNs = meanY - *periodNs * meanX;
+
+    for (i = 0; i < snap->historyCount; i++) {
+        uint32_t idx = (snap->historyHead + i) % PPS_HISTORY_SIZE;
+        double x = (double)(src->pulseIndex[idx] - src->pulseIndex[newest]);
+        double y = (double)(ts_to_ns(&snap->history[idx].pulseBoottime) - newestBootNs);
+        residuals[idx] = y - (*offsetNs + *periodNs * x);
+        if (use[idx]) {
+            sse += residuals[idx] * residuals[idx];
+        }
+    }
+    *sigmaNs = sqrt(sse / (n - 2));
+    *offsetUncNs = *sigmaNs * sqrt(1.0 / n + meanX * meanX / sxx);
+    *periodUncNs = *sigmaNs / sqrt(sxx);
+    return n;
+}
+
+/* refits the estimate after a new capture, leaving out outliers */
+static void update_pps_estimate(struct pps_source *src)
+{
+    pps_snapshot *snap = &src->working.snapshot;
+    int use[PPS_HISTORY_SIZE];
+    double residuals[PPS_HISTORY_SIZE];
+    double offsetNs, periodNs, sigmaNs, offsetUncNs, periodUncNs;
+    double latencySum = 0, latencySqSum = 0, threshold;
+    uint32_t i, newest;
+    int n, rejected = 0;
+
+    memset(&snap->estimate, 0, sizeof(snap->estimate));
+    for (i = 0; i < PPS_HISTORY_SIZE; i++) {
+        use[i] = 1;
+    }
+
+    n = fit_pps(src, use, &offsetNs, &periodNs, &sigmaNs, &offsetUncNs,
+                &periodUncNs, residuals);
+    if (0 == n) {
+        return;
+    }
+    threshold = PPS_OUTLIER_SIGMA * sigmaNs;
+    if (threshold < PPS_OUTLIER_MIN_NS) {
+        threshold = PPS_OUTLIER_MIN_NS;
+    }
+    for (i = 0; i < snap->historyCount; i++) {
+        uint32_t idx = (snap->historyHead + i) % PPS_HISTORY_SIZE;
+        if (fabs(residuals[idx]) > threshold) {
+            use[idx] = 0;
+            rejected++;
+        }
+    }
+    if (rejected > 0) {
+        n = fit_pps(src, use, &offsetNs, &periodNs, &sigmaNs, &offsetUncNs,
+                    &periodUncNs, residuals);
+        if (0 == n) {
+            return;
+        }
+    }
+
+    for (i = 0; i < snap->historyCount; i++) {
+        uint32_t idx = (snap->historyHead + i) % PPS_HISTORY_SIZE;
+        if (use[idx]) {
+            double latency = (double)(ts_to_ns(&snap->history[idx].userTs) -
+                                      ts_to_ns(&snap->history[idx].pulseBoottime));
+            latencySum += latency;
+            latencySqSum += latency * latency;
+        }
+    }
+
+    newest = (snap->historyHead + snap->historyCount - 1) % PPS_HISTORY_SIZE;
+    snap->estimate.numCaptures = n;
+    ns_to_ts(ts_to_ns(&snap->history[newest].pulseBoottime) + (int64_t)llround(offsetNs),
+             &snap->estimate.pulseBoottime);
+    snap->estimate.periodNs = periodNs;
+    snap->estimate.driftPpb = periodNs - NSEC_PER_SEC;
+    snap->estimate.offsetUncNs = offsetUncNs;
+    snap->estimate.driftUncPpb = periodUncNs;
+    snap->estimate.latencyMeanNs = latencySum / n;
+    snap->estimate.latencyStdNs =
+            sqrt(fabs(latencySqSum / n - snap->estimate.latencyMeanNs *
+                                         snap->estimate.latencyMeanNs));
+
+    snap->stats.rejectedCaptures = rejected;
+    snap->stats.jitterNs = sigmaNs;
+}
+
+/* adds a capture to the history and publishes the new snapshot */
+static void add_pps_capture(struct pps_source *src, const struct timespec *kernelTs,
+                            const struct timespec *userTs,
+                            const struct timespec *pulseBoottime)
+{
+    pps_snapshot *snap = &src->working.snapshot;
+    int64_t pulseIndex = 0;
+    double latencyNs;
+    uint32_t slot;
+
+    if (snap->historyCount > 0) {
+        uint32_t newest = (snap->historyHead + snap->historyCount - 1) % PPS_HISTORY_SIZE;
+        int64_t deltaNs = ts_to_ns(pulseBoottime) -
+                          ts_to_ns(&snap->history[newest].pulseBoottime);
+        int64_t seconds = (deltaNs + NSEC_PER_SEC / 2) / NSEC_PER_SEC;
+        int64_t phaseNs = deltaNs - seconds * NSEC_PER_SEC;
+
+        if (seconds < 1 || seconds > PPS_MAX_GAP_SEC ||
+            phaseNs > PPS_MAX_PHASE_ERROR_NS || phaseNs < -PPS_MAX_PHASE_ERROR_NS) {
+            LOC_LOGV("%s:%d %s PPS train broken after %d pulses, delta %" PRId64 " ns",
+                     __func__, __LINE__, src->devname, snap->historyCount, deltaNs);
+            snap->historyHead = 0;
+            snap->historyCount = 0;
+            snap->stats.trainResets++;
+        } else {
+            pulseIndex = src->pulseIndex[newest] + seconds;
+            snap->stats.missedPulses += seconds - 1;
+        }
+    }
+
+    if (PPS_HISTORY_SIZE == snap->historyCount) {
+        snap->historyHead = (snap->historyHead + 1) % PPS_HISTORY_SIZE;
+        snap->historyCount--;
+    }
+    slot = (snap->historyHead + snap->historyCount) % PPS_HISTORY_SIZE;
+    snap->history[slot].kernelTs = *kernelTs;
+    snap->history[slot].pulseBoottime = *pulseBoottime;
+    snap->history[slot].userTs = *userTs;
+    src->pulseIndex[slot] = pulseIndex;
+    snap->historyCount++;
+
+    snap->stats.captures++;
+    latencyNs = (double)(ts_to_ns(userTs) - ts_to_ns(pulseBoottime));
+    if (latencyNs > snap->stats.maxLatencyNs) {
+        snap->stats.maxLatencyNs = latencyNs;
+    }
+
+    snap->drsyncKernelTs = *kernelTs;
+    snap->drsyncUserTs = *userTs;
+    update_pps_estimate(src);
+
+    publish_pps(src);
+}
 
   /*  checks the PPS source and opens it */
 int check_device(char *path, pps_handle *handle)
@@ -69,94 +356,304 @@ int check_device(char *path, pps_handle *handle)
      return 0;
 }
 
-/* fetches the timestamp from the PPS source */
-int read_pps(pps_handle *handle)
+/* fetches the latest timestamp from the PPS source, waiting at most
+   timeout for a new one. Returns 1 for a new pulse, 0 if there was
+   none and -1 on error */
+int read_pps(struct pps_source *src, const struct timespec *timeout)
 {
-    struct timespec timeout;
     pps_info infobuf;
+    struct timespec userTs, realTs, pulseBoottime;
+    unsigned int sequence;
     int ret;
-    // 3sec timeout
-    timeout.tv_sec = 3;
-    timeout.tv_nsec = 0;
 
-       ret = pps_fetch(*handle, PPS_TSFMT_TSPEC, &infobuf,&timeout);
+       ret = pps_fetch_seq(src->handle, timeout, &infobuf, &sequence);
 
-        if (ret < 0 && ret !=-EINTR)
+        if (ret < 0)
         {
-            LOC_LOGV("%s:%d pps_fetch() error %d", __func__, __LINE__,  ret);
+            if (ETIMEDOUT == errno || EINTR == errno)
+            {
+                return 0;
+            }
+            LOC_LOGV("%s:%d pps_fetch() error %d", __func__, __LINE__, errno);
             return -1;
         }
+        /* a fetch with a timeout only returns once a new event
+           arrived, so even the first one is a fresh pulse; the
+           sequence just guards against a driver repeating one */
+        if (src->hasSequence && sequence == src->lastSequence)
+        {
+            return 0;
+        }
+        src->hasSequence = 1;
+        src->lastSequence = sequence;
 
-        pthread_mutex_lock(&ts_lock);
-        drsyncKernelTs.tv_sec = infobuf.tv_sec;
-        drsyncKernelTs.tv_nsec = infobuf.tv_nsec;
-        ret = clock_gettime(CLOCK_BOOTTIME,&drsyncUserTs);
-        pthread_mutex_unlock(&ts_lock);
-
+        /* the kernel stamps the pulse with CLOCK_REALTIME, move it
+           to boot time with the current offset between the two */
+        ret = clock_gettime(CLOCK_BOOTTIME,&userTs);
+        if(ret == 0)
+        {
+            ret = clock_gettime(CLOCK_REALTIME,&realTs);
+        }
         if(ret != 0)
         {
             LOC_LOGV("%s:%d clock_gettime() error",__func__,__LINE__);
+            return 0;
         }
-    return 0;
+        ns_to_ts(ts_to_ns(&infobuf) + ts_to_ns(&userTs) - ts_to_ns(&realTs), &pulseBoottime);
+        add_pps_capture(src, &infobuf, &userTs, &pulseBoottime);
+    return 1;
 }
 
 #ifdef __cplusplus
 extern "C" {
 #endif
-/* infinitely calls read_pps() */
-void *thread_handle(void *input)
+/* time to sleep before the next pulse is due, less the fetch guard.
+   0 while the pulse train isn't known yet or was lost */
+static int64_t next_pulse_wait_ns(struct pps_source *src)
 {
-    int ret;
-    if(input != NULL)
+    const pps_snapshot *snap = &src->working.snapshot;
+    struct timespec now;
+    int64_t periodNs = NSEC_PER_SEC, newestNs, elapsedNs, waitNs;
+
+    if (0 == snap->historyCount || 0 != clock_gettime(CLOCK_BOOTTIME, &now))
     {
-        LOC_LOGV("%s:%d Thread Input is present", __func__, __LINE__);
+        return 0;
+    }
+    if (snap->estimate.numCaptures > 0 &&
+        fabs(snap->estimate.periodNs - NSEC_PER_SEC) < NSEC_PER_SEC / 10)
+    {
+        periodNs = (int64_t)llround(snap->estimate.periodNs);
     }
-    while(isActive)
+    newestNs = ts_to_ns(&snap->history[(snap->historyHead + snap->historyCount - 1) %
+                                       PPS_HISTORY_SIZE].pulseBoottime);
+    elapsedNs = ts_to_ns(&now) - newestNs;
+    if (elapsedNs < 0 || elapsedNs > PPS_MAX_GAP_SEC * NSEC_PER_SEC)
     {
-        ret = read_pps(&handle);
+        return 0;
+    }
+    waitNs = newestNs + (elapsedNs / periodNs + 1) * periodNs - ts_to_ns(&now) -
+             PPS_FETCH_GUARD_NS;
+    return (waitNs > 0) ? waitNs : 0;
+}
+
+/* waits for pulses until stopFd is written. The PPS cdev reports
+   POLLIN at all times, so only stopFd is polled: the thread sleeps in
+   poll() until shortly before the next pulse is due and then blocks in
+   PPS_FETCH across it, waking once per pulse. Until the pulse train is
+   known it fetches in back to back windows. Either way a stop is seen
+   within PPS_FETCH_WINDOW_NS */
+void *thread_handle(void *input)
+{
+    struct pps_source *src = (struct pps_source *)input;
+    struct pollfd pfd;
+    struct timespec window;
+    int ret;
 
-        if (ret == -1 && errno != ETIMEDOUT )
+    ns_to_ts(PPS_FETCH_WINDOW_NS, &window);
+    pfd.fd = src->stopFd;
+    pfd.events = POLLIN;
+    while (1)
+    {
+        pfd.revents = 0;
+        ret = poll(&pfd, 1, (int)(next_pulse_wait_ns(src) / 1000000LL));
+        if (ret < 0 && EINTR != errno)
         {
-            LOC_LOGV("%s:%d Could not fetch PPS source", __func__, __LINE__);
+            LOC_LOGV("%s:%d poll() error %d", __func__, __LINE__, errno);
+            break;
+        }
+        if (ret > 0)
+        {
+            break;
+        }
+        if (read_pps(src, &window) < 0)
+        {
+            LOC_LOGV("%s:%d Could not fetch PPS source %s", __func__, __LINE__, src->devname);
+            break;
         }
     }
     return NULL;
 }
 
-/*  opens the device and fetches from PPS source */
-int initPPS(char *devname)
+/* opens a PPS device and starts fetching from it. src is either
+   zeroed or was closed with close_pps_source(), so no fetch thread
+   writes to it; readers may still be copying its snapshot though */
+static int open_pps_source(struct pps_source *src, const char *devname)
 {
-    int ret,pid;
-    pthread_t thread;
-    isActive = 1;
+    int ret;
 
-    ret = check_device(devname, &handle);
+    strlcpy(src->devname, devname, sizeof(src->devname));
+    src->handle = -1;
+    src->stopFd = -1;
+    src->threadStarted = 0;
+    src->lastSequence = 0;
+    src->hasSequence = 0;
+    memset(src->pulseIndex, 0, sizeof(src->pulseIndex));
+    /* the samples of a previous open are cleared under the sequence
+       counter, a plain memset would tear a concurrent read */
+    memset(&src->working, 0, sizeof(src->working));
+    publish_pps(src);
+
+    ret = check_device(src->devname, &src->handle);
     if (ret < 0)
     {
         LOC_LOGV("%s:%d Could not find PPS source", __func__, __LINE__);
         return 0;
     }
 
-    pthread_mutex_init(&ts_lock,NULL);
+    src->stopFd = eventfd(0, EFD_CLOEXEC);
+    if (src->stopFd < 0)
+    {
+        LOC_LOGV("%s:%d eventfd() error %d", __func__, __LINE__, errno);
+        pps_destroy(src->handle);
+        return 0;
+    }
+    ret = pthread_create(&src->thread, NULL, &thread_handle, src);
+    if (ret != 0)
+    {
+        LOC_LOGV("%s:%d Could not create thread for %s", __func__, __LINE__, devname);
+        close(src->stopFd);
+        src->stopFd = -1;
+        pps_destroy(src->handle);
+        return 0;
+    }
+    src->threadStarted = 1;
+    return 1;
+}
 
-    pid = pthread_create(&thread,NULL,&thread_handle,NULL);
-    if(pid != 0)
+/* stops the fetch thread and closes the device; returns once the
+   thread is gone, within PPS_FETCH_WINDOW_NS */
+static void close_pps_source(struct pps_source *src)
+{
+    uint64_t one = 1;
+
+    if (src->threadStarted)
     {
-        LOC_LOGV("%s:%d Could not create thread in InitPPS", __func__, __LINE__);
+        if (write(src->stopFd, &one, sizeof(one)) != sizeof(one))
+        {
+            LOC_LOGV("%s:%d eventfd write error %d", __func__, __LINE__, errno);
+        }
+        pthread_join(src->thread, NULL);
+        src->threadStarted = 0;
+        close(src->stopFd);
+        src->stopFd = -1;
+        pps_destroy(src->handle);
+    }
+}
+
+pps_source *openPPSSource(const char *devname)
+{
+    pps_source *src;
+
+    if (NULL == devname)
+    {
+        return NULL;
+    }
+    src = (pps_source *)calloc(1, sizeof(*src));
+    if (NULL == src)
+    {
+        return NULL;
+    }
+    if (!open_pps_source(src, devname))
+    {
+        free(src);
+        return NULL;
+    }
+    return src;
+}
+
+void closePPSSource(pps_source *src)
+{
+    if (NULL != src)
+    {
+        close_pps_source(src);
+        free(src);
+    }
+}
+
+int getPPSSourceTime(pps_source *src, struct timespec *fineKernelTs,
+                     struct timespec *currentTs, struct timespec *fineUserTs)
+{
+    pps_snapshot_words snap;
+    int ret;
+
+    read_pps_snapshot(src, &snap, PPS_SAMPLE_WORDS);
+    *fineKernelTs = snap.snapshot.drsyncKernelTs;
+    *fineUserTs = snap.snapshot.drsyncUserTs;
+
+    ret = clock_gettime(CLOCK_BOOTTIME,currentTs);
+    if(ret != 0)
+    {
+       LOC_LOGV("%s:%d clock_gettime() error",__func__,__LINE__);
+       return 0;
+    }
+    return 1;
+}
+
+int getPPSSourceEstimate(pps_source *src, pps_estimate *estimate)
+{
+    pps_snapshot_words snap;
+
+    if (NULL == src || NULL == estimate) {
+        return 0;
+    }
+    read_pps_snapshot(src, &snap, PPS_SNAPSHOT_WORDS);
+    *estimate = snap.snapshot.estimate;
+    return (estimate->numCaptures > 0) ? 1 : 0;
+}
+
+int getPPSSourceHistory(pps_source *src, pps_capture *captures, int maxCaptures)
+{
+    pps_snapshot_words snap;
+    int i, count;
+
+    if (NULL == src || NULL == captures || maxCaptures <= 0) {
         return 0;
     }
+    read_pps_snapshot(src, &snap, PPS_SNAPSHOT_WORDS);
+    count = snap.snapshot.historyCount;
+    if (count > maxCaptures) {
+        count = maxCaptures;
+    }
+    for (i = 0; i < count; i++) {
+        uint32_t idx = (snap.snapshot.historyHead + snap.snapshot.historyCount - 1 - i) %
+                       PPS_HISTORY_SIZE;
+        captures[i] = snap.snapshot.history[idx];
+    }
+    return count;
+}
+
+int getPPSSourceStats(pps_source *src, pps_stats *stats)
+{
+    pps_snapshot_words snap;
+
+    if (NULL == src || NULL == stats) {
+        return 0;
+    }
+    read_pps_snapshot(src, &snap, PPS_SNAPSHOT_WORDS);
+    *stats = snap.snapshot.stats;
     return 1;
 }
 
+/*  opens the device and fetches from PPS source */
+int initPPS(char *devname)
+{
+    if (defaultSourceOpen)
+    {
+        LOC_LOGV("%s:%d PPS already initialized", __func__, __LINE__);
+        return 0;
+    }
+    defaultSourceOpen = open_pps_source(&defaultSource, devname);
+    return defaultSourceOpen;
+}
+
 /* stops fetching and closes the device */
 void deInitPPS()
 {
-    pthread_mutex_lock(&ts_lock);
-    isActive = 0;
-    pthread_mutex_unlock(&ts_lock);
-
-    pthread_mutex_destroy(&ts_lock);
-    pps_destroy(handle);
+    if (defaultSourceOpen)
+    {
+        close_pps_source(&defaultSource);
+        defaultSourceOpen = 0;
+    }
 }
 
 /* retrieves DRsync kernel timestamp,DRsync userspace timestamp
@@ -169,26 +666,26 @@ void deInitPPS()
 int getPPS(struct timespec *fineKernelTs ,struct timespec *currentTs,
            struct timespec *fineUserTs)
 {
-    int ret;
-
-    pthread_mutex_lock(&ts_lock);
-    fineKernelTs->tv_sec = drsyncKernelTs.tv_sec;
-    fineKernelTs->tv_nsec = drsyncKernelTs.tv_nsec;
+    return getPPSSourceTime(&defaultSource, fineKernelTs, currentTs, fineUserTs);
+}
 
-    fineUserTs->tv_sec = drsyncUserTs.tv_sec;
-    fineUserTs->tv_nsec = drsyncUserTs.tv_nsec;
+/* retrieves the fit of the recent pulses against CLOCK_BOOTTIME */
+/* Returns:
+ *     1 with @Param out estimate filled in,
+ *     0 if there are not enough pulses for an estimate yet
+ */
+int getPPSEstimate(pps_estimate *estimate)
+{
+    return getPPSSourceEstimate(&defaultSource, estimate);
+}
 
-    ret = clock_gettime(CLOCK_BOOTTIME,currentTs);
-    pthread_mutex_unlock(&ts_lock);
-    if(ret != 0)
-    {
-       LOC_LOGV("%s:%d clock_gettime() error",__func__,__LINE__);
-       return 0;
-    }
-    return 1;
+/* copies up to maxCaptures recent captures, newest first */
+/* Returns: number of captures copied */
+int getPPSHistory(pps_capture *captures, int maxCaptures)
+{
+    return getPPSSourceHistory(&defaultSource, captures, maxCaptures);
 }
 
 #ifdef __cplusplus
 }
 #endif
-
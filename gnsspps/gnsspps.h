@@ -28,16 +28,90 @@
 #ifndef _GNSSPPS_H
 #define _GNSSPPS_H
 
+#include <stdint.h>
+#include <time.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* number of recent pulses kept for the estimate */
+#define PPS_HISTORY_SIZE 32
+
+/* one PPS capture */
+typedef struct {
+    /* kernel timestamp of the pulse (CLOCK_REALTIME) */
+    struct timespec kernelTs;
+    /* the kernel timestamp moved to CLOCK_BOOTTIME */
+    struct timespec pulseBoottime;
+    /* CLOCK_BOOTTIME when user space received the pulse */
+    struct timespec userTs;
+} pps_capture;
+
+/* least squares fit of the recent pulses against CLOCK_BOOTTIME,
+   captures beyond 3 sigma of a first fit are left out */
+typedef struct {
+    /* captures used in the fit, 0 if there is no estimate yet */
+    uint32_t numCaptures;
+    /* fitted CLOCK_BOOTTIME of the latest pulse (GNSS whole second) */
+    struct timespec pulseBoottime;
+    /* fitted length of one GNSS second in CLOCK_BOOTTIME ns */
+    double periodNs;
+    /* CLOCK_BOOTTIME rate error, positive if it runs fast, ppb */
+    double driftPpb;
+    /* 1-sigma uncertainty of pulseBoottime, ns */
+    double offsetUncNs;
+    /* 1-sigma uncertainty of driftPpb */
+    double driftUncPpb;
+    /* pulse to user space delivery latency, ns */
+    double latencyMeanNs;
+    double latencyStdNs;
+} pps_estimate;
+
+/* capture statistics of one PPS device */
+typedef struct {
+    /* pulses captured */
+    uint64_t captures;
+    /* pulses missing from the 1 Hz train, not sent or not fetched */
+    uint64_t missedPulses;
+    /* times the pulse train broke and the history restarted */
+    uint32_t trainResets;
+    /* captures left out of the latest fit as outliers */
+    uint32_t rejectedCaptures;
+    /* RMS of the pulse times around the fit, ns */
+    double jitterNs;
+    /* largest pulse to user space delivery latency seen, ns */
+    double maxLatencyNs;
+} pps_stats;
+
+/* one PPS device with its own fetch thread */
+typedef struct pps_source pps_source;
+
+/* opens the device and starts fetching from it, NULL on failure */
+pps_source *openPPSSource(const char *devname);
+/* stops fetching, waits for the fetch thread and closes the device */
+void closePPSSource(pps_source *source);
+/* same as getPPS() for the given source */
+int getPPSSourceTime(pps_source *source, struct timespec *fineKernelTs,
+                     struct timespec *currentTs, struct timespec *fineUserTs);
+/* same as getPPSEstimate() for the given source */
+int getPPSSourceEstimate(pps_source *source, pps_estimate *estimate);
+/* same as getPPSHistory() for the given source */
+int getPPSSourceHistory(pps_source *source, pps_capture *captures, int maxCaptures);
+/* capture statistics, returns 0 on failure */
+int getPPSSourceStats(pps_source *source, pps_stats *stats);
+
+/* The functions below work on one default source */
 /*  opens the device and fetches from PPS source */
 int initPPS(char *devname);
 /* updates the fine time stamp */
 int getPPS(struct timespec *current_ts, struct timespec *current_boottime, struct timespec *last_boottime);
 /* stops fetching and closes the device */
 void deInitPPS();
+/* fit of the recent pulses, returns 0 if there is no estimate yet */
+int getPPSEstimate(pps_estimate *estimate);
+/* recent captures newest first, returns the number copied */
+int getPPSHistory(pps_capture *captures, int maxCaptures);
 
 #ifdef __cplusplus
 }
@@ -100,6 +100,30 @@ static __inline int pps_fetch(pps_handle handle, const int tsformat,
    return ret;
 }
 
+/* reads the latest assert event and its sequence number. With a zero
+   timeout the kernel does not wait for the next event */
+static __inline int pps_fetch_seq(pps_handle handle, const struct timespec *timeout,
+                                  pps_info *ppsinfobuf, unsigned int *sequence)
+{
+   struct pps_fdata fdata;
+   int ret;
+
+   fdata.timeout.sec = timeout->tv_sec;
+   fdata.timeout.nsec = timeout->tv_nsec;
+   fdata.timeout.flags = ~PPS_TIME_INVALID;
+   ret = ioctl(handle, PPS_FETCH, &fdata);
+   if (ret < 0)
+   {
+      return ret;
+   }
+
+   ppsinfobuf->tv_sec = fdata.info.assert_tu.sec;
+   ppsinfobuf->tv_nsec = fdata.info.assert_tu.nsec;
+   *sequence = fdata.info.assert_sequence;
+
+   return ret;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -34,6 +34,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <pthread.h>
 #include <wireless_data_service_v01.h>
 #include <loc_log.h>
 #include <qmi_client.h>
@@ -105,8 +106,57 @@ typedef struct {
     dsi_hndl_t dsi_net_handle;
     //Handle to caller's data
     ds_caller_data caller_data;
+    //Async open/start state, guarded by lock
+    pthread_mutex_t lock;
+    pthread_t start_thread;
+    bool start_thread_valid;
+    bool stop_requested;
 } ds_client_session_data;
 
+/*Emergency profile found by the last lookup. Reused by every call
+  until WDS reports a profile change, the WDS service goes down or
+  the modem restarts. Response buffers are kept here so a lookup
+  does not allocate.
+  The lookup holds lock across synchronous WDS requests, so the WDS
+  callbacks must not take it. They only bump generation, and a cached
+  profile is used only if it was found in the current generation.*/
+typedef struct {
+    pthread_mutex_t lock;
+    bool valid;
+    int profile_index;
+    int pdp_type;
+    //Value of generation when the cached profile was looked up
+    uint32_t valid_generation;
+    //Bumped atomically whenever the cached profile must be dropped
+    uint32_t generation;
+    //WDS client kept open for profile change indications
+    qmi_client_type wds_qmi_client;
+    bool wds_qmi_client_valid;
+    //Set atomically by the error callback
+    bool wds_qmi_client_down;
+    wds_get_profile_list_resp_msg_v01 profile_list_resp;
+    wds_get_profile_settings_resp_msg_v01 profile_settings_resp;
+} ds_client_profile_cache_type;
+
+static ds_client_profile_cache_type ds_profile_cache = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .valid = false,
+    .profile_index = -1,
+    .pdp_type = -1,
+    .valid_generation = 0,
+    .generation = 0,
+    .wds_qmi_client_valid = false,
+    .wds_qmi_client_down = false
+};
+
+/*Lock free, safe to call from the WDS callbacks*/
+static void ds_client_invalidate_profile_cache(const char *reason)
+{
+    LOC_LOGD("%s:%d]: Dropping cached profile: %s\n",
+             __func__, __LINE__, reason);
+    __atomic_add_fetch(&ds_profile_cache.generation, 1, __ATOMIC_SEQ_CST);
+}
+
 static void net_ev_cb
 (
   dsi_hndl_t handle,
@@ -154,7 +204,9 @@ static void net_ev_cb
 
 /*This function is called to obtain a handle to the QMI WDS service*/
 static ds_client_status_enum_type
-ds_client_qmi_ctrl_point_init(qmi_client_type *p_wds_qmi_client)
+ds_client_qmi_ctrl_point_init(qmi_client_type *p_wds_qmi_client,
+                              qmi_client_ind_cb ind_cb,
+                              void *ind_cb_data)
 {
     qmi_client_type wds_qmi_client, notifier = NULL;
     ds_client_status_enum_type status = E_DS_CLIENT_SUCCESS;
@@ -253,7 +305,7 @@ ds_client_qmi_ctrl_point_init(qmi_client_type *p_wds_qmi_client)
     LOC_LOGD("%s:%d]: Initializing WDS client with qmi_client_init\n", __func__,
              __LINE__);
     ret = qmi_client_init(&p_service_info[0], ds_client_service_object,
-                          NULL, NULL, NULL, &wds_qmi_client);
+                          ind_cb, ind_cb_data, NULL, &wds_qmi_client);
     if(ret != QMI_NO_ERR) {
         LOC_LOGE("%s:%d]: qmi_client_init Error. ret: %d\n", __func__, __LINE__, ret);
         status = E_DS_CLIENT_FAILURE_INTERNAL;
@@ -391,16 +443,11 @@ static ds_client_status_enum_type ds_client_get_profile_list(
 {
     ds_client_status_enum_type ret = E_DS_CLIENT_SUCCESS;
     ds_client_req_union_type req_union;
+    wds_get_profile_list_req_msg_v01 profile_list_req;
     LOC_LOGD("%s:%d]:Enter\n", __func__, __LINE__);
 
-    req_union.p_get_profile_list_req = NULL;
-    req_union.p_get_profile_list_req = (wds_get_profile_list_req_msg_v01 *)
-        calloc(1, sizeof(wds_get_profile_list_req_msg_v01));
-    if(req_union.p_get_profile_list_req == NULL) {
-        LOC_LOGE("%s:%d]: Could not allocate memory for"
-                 "wds_get_profile_list_req_msg_v01\n", __func__, __LINE__);
-        goto err;
-    }
+    memset(&profile_list_req, 0, sizeof(profile_list_req));
+    req_union.p_get_profile_list_req = &profile_list_req;
     //Populate required members of the request structure
     req_union.p_get_profile_list_req->profile_type_valid = 1;
     req_union.p_get_profile_list_req->profile_type = profile_type;
@@ -414,8 +461,6 @@ static ds_client_status_enum_type ds_client_get_profile_list(
     }
 err:
     LOC_LOGD("%s:%d]:Exit\n", __func__, __LINE__);
-    if(req_union.p_get_profile_list_req)
-        free(req_union.p_get_profile_list_req);
     return ret;
 }
 
@@ -514,36 +559,104 @@ err:
 
 }
 
-/**
- * @brief Prepares for call.
- *
- * Obtains a handle to the dsi_netctrl layer and looks up the profile
- * to make the call. As of now. It only searches for profiles that
- * support emergency calls.
- *
- * Function to open an emergency call. Does the following things:
- * - Obtains a handle to the WDS service
- * - Obtains a list of profiles configured in the modem
- * - Queries each profile and obtains settings to check if emergency calls
- *   are supported
- * - Returns the profile index that supports emergency calls
- * - Returns handle to dsi_netctrl
- *
- * @param[out] client_handle Client handle to initialize.
- * @param[in]  callback      Pointer to callback function table.
- * @param[in]  cookie        Client's cookie for using with callback calls.
- * @param[out] profile_index Pointer to profile index number.
- * @param[out] pdp_type      Pointer to PDP type.
- *
- * @return Operation result
- * @retval E_DS_CLIENT_SUCCESS    On success. Output parameters are initialized.
- * @retval E_DS_CLIENT_FAILURE... On error.
- */
-static  ds_client_status_enum_type ds_client_open_call
+/*Indication callback of the cached WDS client*/
+static void ds_client_wds_ind_cb
+(
+  qmi_client_type user_handle,
+  unsigned int msg_id,
+  void *ind_buf,
+  unsigned int ind_buf_len,
+  void *ind_cb_data
+)
+{
+    (void)user_handle;
+    (void)ind_buf;
+    (void)ind_buf_len;
+    (void)ind_cb_data;
+#ifdef QMI_WDS_PROFILE_CHANGED_IND_V01
+    if(msg_id == QMI_WDS_PROFILE_CHANGED_IND_V01) {
+        ds_client_invalidate_profile_cache("profile changed");
+        return;
+    }
+#endif
+    LOC_LOGV("%s:%d]: Ignoring WDS indication 0x%x\n", __func__, __LINE__, msg_id);
+}
+
+/*Error callback of the cached WDS client, service went down*/
+static void ds_client_wds_error_cb
+(
+  qmi_client_type user_handle,
+  qmi_client_error_type error,
+  void *err_cb_data
+)
+{
+    (void)user_handle;
+    (void)err_cb_data;
+    LOC_LOGE("%s:%d]: WDS service error %d\n", __func__, __LINE__, error);
+    //Can't release the client from its own callback, next lookup does
+    __atomic_store_n(&ds_profile_cache.wds_qmi_client_down, true, __ATOMIC_SEQ_CST);
+    ds_client_invalidate_profile_cache("WDS service down");
+}
+
+/*Opens the WDS client used for profile lookups and registers for
+  profile change indications. Called with ds_profile_cache.lock held*/
+static ds_client_status_enum_type ds_client_wds_client_open()
+{
+    ds_client_status_enum_type ret = E_DS_CLIENT_SUCCESS;
+
+    if(ds_profile_cache.wds_qmi_client_valid &&
+       __atomic_load_n(&ds_profile_cache.wds_qmi_client_down, __ATOMIC_SEQ_CST)) {
+        qmi_client_release(ds_profile_cache.wds_qmi_client);
+        ds_profile_cache.wds_qmi_client_valid = false;
+    }
+    if(ds_profile_cache.wds_qmi_client_valid) {
+        return E_DS_CLIENT_SUCCESS;
+    }
+
+    ret = ds_client_qmi_ctrl_point_init(&ds_profile_cache.wds_qmi_client,
+                                        ds_client_wds_ind_cb, NULL);
+    if(ret != E_DS_CLIENT_SUCCESS) {
+        LOC_LOGE("%s:%d]: ds_client_qmi_ctrl_point_init failed. ret: %d\n",
+                 __func__, __LINE__, ret);
+        return ret;
+    }
+    ds_profile_cache.wds_qmi_client_valid = true;
+    __atomic_store_n(&ds_profile_cache.wds_qmi_client_down, false, __ATOMIC_SEQ_CST);
+    qmi_client_register_error_cb(ds_profile_cache.wds_qmi_client,
+                                 ds_client_wds_error_cb, NULL);
+
+#ifdef QMI_WDS_CONFIGURE_PROFILE_EVENT_LIST_REQ_V01
+    {
+        wds_configure_profile_event_list_req_msg_v01 event_req;
+        wds_configure_profile_event_list_resp_msg_v01 event_resp;
+        qmi_client_error_type qmi_ret;
+
+        //All 3GPP profiles
+        memset(&event_req, 0, sizeof(event_req));
+        memset(&event_resp, 0, sizeof(event_resp));
+        event_req.profile_event_register_valid = 1;
+        event_req.profile_event_register_len = 1;
+        event_req.profile_event_register[0].profile_type = WDS_PROFILE_TYPE_3GPP_V01;
+        event_req.profile_event_register[0].profile_index = 0xFF;
+        qmi_ret = qmi_client_send_msg_sync(ds_profile_cache.wds_qmi_client,
+                                           QMI_WDS_CONFIGURE_PROFILE_EVENT_LIST_REQ_V01,
+                                           &event_req, sizeof(event_req),
+                                           &event_resp, sizeof(event_resp),
+                                           DS_CLIENT_SYNC_MSG_TIMEOUT);
+        if(qmi_ret != QMI_NO_ERR || event_resp.resp.result != QMI_RESULT_SUCCESS_V01) {
+            //Cache still works, it's just only dropped on SSR
+            LOC_LOGE("%s:%d]: Profile event registration failed. qmi_ret: %d\n",
+                     __func__, __LINE__, qmi_ret);
+        }
+    }
+#endif
+    return E_DS_CLIENT_SUCCESS;
+}
+
+/*Queries the modem for a profile that supports emergency calls.
+  Called with ds_profile_cache.lock held*/
+static ds_client_status_enum_type ds_client_lookup_emergency_profile
 (
-  dsClientHandleType *client_handle,
-  const ds_client_cb_data *callback,
-  void *cookie,
   int *profile_index,
   int *pdp_type
 )
@@ -553,65 +666,40 @@ static  ds_client_status_enum_type ds_client_open_call
     ds_client_resp_union_type profile_settings_resp_msg;
     wds_profile_identifier_type_v01 profile_identifier;
     uint32_t i=0;
-    dsi_hndl_t dsi_handle;
-    ds_client_session_data **ds_global_data = (ds_client_session_data **)client_handle;
     unsigned char call_profile_index_found = 0;
-    uint32_t emergency_profile_index=0;
-    qmi_client_type wds_qmi_client;
-
-    profile_list_resp_msg.p_get_profile_list_resp = NULL;
-    profile_settings_resp_msg.p_get_profile_setting_resp = NULL;
 
-    LOC_LOGD("%s:%d]:Enter\n", __func__, __LINE__);
-    if(callback == NULL || ds_global_data == NULL) {
-        LOC_LOGE("%s:%d]: Null callback parameter\n", __func__, __LINE__);
-        goto err;
-    }
-
-    ret = ds_client_qmi_ctrl_point_init(&wds_qmi_client);
+    ret = ds_client_wds_client_open();
     if(ret != E_DS_CLIENT_SUCCESS) {
-        LOC_LOGE("%s:%d]: ds_client_qmi_ctrl_point_init failed. ret: %d\n",
-                 __func__, __LINE__, ret);
-        goto err;
+        return ret;
     }
 
-    //Allocate memory for the response msg to obtain a list of profiles
-    profile_list_resp_msg.p_get_profile_list_resp = (wds_get_profile_list_resp_msg_v01 *)
-        calloc(1, sizeof(wds_get_profile_list_resp_msg_v01));
-    if(profile_list_resp_msg.p_get_profile_list_resp == NULL) {
-        LOC_LOGE("%s:%d]: Could not allocate memory for"
-                 "p_get_profile_list_resp\n", __func__, __LINE__);
-        ret = E_DS_CLIENT_FAILURE_NOT_ENOUGH_MEMORY;
-        goto err;
-    }
+    memset(&ds_profile_cache.profile_list_resp, 0,
+           sizeof(ds_profile_cache.profile_list_resp));
+    profile_list_resp_msg.p_get_profile_list_resp = &ds_profile_cache.profile_list_resp;
+    profile_settings_resp_msg.p_get_profile_setting_resp =
+        &ds_profile_cache.profile_settings_resp;
 
     LOC_LOGD("%s:%d]: Getting profile list\n", __func__, __LINE__);
-    ret = ds_client_get_profile_list(&wds_qmi_client,
+    ret = ds_client_get_profile_list(&ds_profile_cache.wds_qmi_client,
                                       &profile_list_resp_msg,
                                       WDS_PROFILE_TYPE_3GPP_V01);
     if(ret != E_DS_CLIENT_SUCCESS) {
         LOC_LOGE("%s:%d]: ds_client_get_profile_list failed. ret: %d\n",
                  __func__, __LINE__, ret);
-        goto err;
+        return ret;
     }
     LOC_LOGD("%s:%d]: Got profile list; length = %d\n", __func__, __LINE__,
              profile_list_resp_msg.p_get_profile_list_resp->profile_list_len);
 
-    //Allocate memory for the response msg to obtain profile settings
-    //We allocate memory for only one response msg and keep re-using it
-    profile_settings_resp_msg.p_get_profile_setting_resp =
-        (wds_get_profile_settings_resp_msg_v01 *)
-        calloc(1, sizeof(wds_get_profile_settings_resp_msg_v01));
-    if(profile_settings_resp_msg.p_get_profile_setting_resp == NULL) {
-        LOC_LOGE("%s:%d]: Could not allocate memory for"
-                 "p_get_profile_setting_resp\n", __func__, __LINE__);
-        ret = E_DS_CLIENT_FAILURE_NOT_ENOUGH_MEMORY;
-        goto err;
-    }
-
     //Loop over the list of profiles to find a profile that supports
     //emergency calls
     for(i=0; i < profile_list_resp_msg.p_get_profile_list_resp->profile_list_len; i++) {
+        //Since this struct is loaded with settings for each profile,
+        //it is important to clear out the memory to avoid values/flags
+        //from being carried over
+        memset((void *)profile_settings_resp_msg.p_get_profile_setting_resp,
+               0, sizeof(wds_get_profile_settings_resp_msg_v01));
+
         /*QMI_WDS_GET_PROFILE_SETTINGS_REQ requires an input data
           structure that is of type wds_profile_identifier_type_v01
           We have to fill that structure for each profile from the
@@ -623,13 +711,13 @@ static  ds_client_status_enum_type ds_client_open_call
         profile_identifier.profile_index =
             profile_list_resp_msg.p_get_profile_list_resp->profile_list[i].profile_index;
 
-        ret = ds_client_get_profile_settings(&wds_qmi_client,
+        ret = ds_client_get_profile_settings(&ds_profile_cache.wds_qmi_client,
                                              &profile_settings_resp_msg,
                                              &profile_identifier);
         if(ret != E_DS_CLIENT_SUCCESS) {
             LOC_LOGE("%s:%d]: ds_client_get_profile_settings failed. ret: %d\n",
                      __func__, __LINE__, ret);
-            goto err;
+            return ret;
         }
         LOC_LOGD("%s:%d]: Got profile setting for profile %d; name: %s\n",
                  __func__, __LINE__, i,
@@ -640,7 +728,7 @@ static  ds_client_status_enum_type ds_client_open_call
                 LOC_LOGD("%s:%d]: Found emergency profile in profile %d"
                          , __func__, __LINE__, i);
                 call_profile_index_found = 1;
-                emergency_profile_index = profile_identifier.profile_index;
+                *profile_index = profile_identifier.profile_index;
 
                 if(profile_settings_resp_msg.p_get_profile_setting_resp->pdp_type_valid) {
                     *pdp_type = (int)profile_settings_resp_msg.p_get_profile_setting_resp->pdp_type;
@@ -674,52 +762,231 @@ static  ds_client_status_enum_type ds_client_open_call
                 LOC_LOGE("%s:%d]: Emergency profile valid but not supported in profile: %d "
                          , __func__, __LINE__, i);
         }
-        //Since this struct is loaded with settings for the next profile,
-        //it is important to clear out the memory to avoid values/flags
-        //from being carried over
-        memset((void *)profile_settings_resp_msg.p_get_profile_setting_resp,
-               0, sizeof(wds_get_profile_settings_resp_msg_v01));
     }
 
-    //Release qmi client handle
-    if(qmi_client_release(wds_qmi_client) != QMI_NO_ERR) {
-        LOC_LOGE("%s:%d]: Could not release qmi client handle\n",
+    if(!call_profile_index_found) {
+        LOC_LOGE("%s:%d]: Could not find a profile that supports emergency calls",
                  __func__, __LINE__);
-        ret = E_DS_CLIENT_FAILURE_GENERAL;
+        return E_DS_CLIENT_FAILURE_GENERAL;
     }
+    return E_DS_CLIENT_SUCCESS;
+}
 
-    if(call_profile_index_found) {
-        *profile_index = emergency_profile_index;
-        *ds_global_data = (ds_client_session_data *)calloc(1, sizeof(ds_client_session_data));
-        if(*ds_global_data == NULL) {
-            LOC_LOGE("%s:%d]: Could not allocate memory for ds_global_data. Failing\n",
-                     __func__, __LINE__);
-            ret = E_DS_CLIENT_FAILURE_NOT_ENOUGH_MEMORY;
-            goto err;
+/*Returns the emergency profile, from the cache when possible*/
+static ds_client_status_enum_type ds_client_get_emergency_profile
+(
+  int *profile_index,
+  int *pdp_type
+)
+{
+    ds_client_status_enum_type ret = E_DS_CLIENT_SUCCESS;
+    uint32_t generation;
+
+    pthread_mutex_lock(&ds_profile_cache.lock);
+    //Sampled before the lookup, a change during it leaves the result stale
+    generation = __atomic_load_n(&ds_profile_cache.generation, __ATOMIC_SEQ_CST);
+    if(ds_profile_cache.valid && ds_profile_cache.valid_generation == generation) {
+        *profile_index = ds_profile_cache.profile_index;
+        *pdp_type = ds_profile_cache.pdp_type;
+        LOC_LOGD("%s:%d]: Using cached profile %d; pdp_type: %d\n",
+                 __func__, __LINE__, *profile_index, *pdp_type);
+    }
+    else {
+        ret = ds_client_lookup_emergency_profile(profile_index, pdp_type);
+        if(ret == E_DS_CLIENT_SUCCESS) {
+            ds_profile_cache.profile_index = *profile_index;
+            ds_profile_cache.pdp_type = *pdp_type;
+            ds_profile_cache.valid_generation = generation;
+            ds_profile_cache.valid = true;
         }
+    }
+    pthread_mutex_unlock(&ds_profile_cache.lock);
+    return ret;
+}
 
-        (*ds_global_data)->caller_data.event_cb = callback->event_cb;
-        (*ds_global_data)->caller_data.caller_cookie = cookie;
-        dsi_handle = dsi_get_data_srvc_hndl(net_ev_cb, &(*ds_global_data)->caller_data);
-        if(dsi_handle == NULL) {
-            LOC_LOGE("%s:%d]: Could not get data handle. Retry Later\n",
-                     __func__, __LINE__);
-            ret = E_DS_CLIENT_RETRY_LATER;
-            goto err;
-        }
-        else
-            (*ds_global_data)->dsi_net_handle = dsi_handle;
+/*Allocates the session and obtains its dsi handle*/
+static ds_client_status_enum_type ds_client_session_create
+(
+  ds_client_session_data **ds_global_data,
+  const ds_client_cb_data *callback,
+  void *cookie
+)
+{
+    dsi_hndl_t dsi_handle;
+
+    *ds_global_data = (ds_client_session_data *)calloc(1, sizeof(ds_client_session_data));
+    if(*ds_global_data == NULL) {
+        LOC_LOGE("%s:%d]: Could not allocate memory for ds_global_data. Failing\n",
+                 __func__, __LINE__);
+        return E_DS_CLIENT_FAILURE_NOT_ENOUGH_MEMORY;
     }
-    else {
-        LOC_LOGE("%s:%d]: Could not find a profile that supports emergency calls",
+    pthread_mutex_init(&(*ds_global_data)->lock, NULL);
+
+    (*ds_global_data)->caller_data.event_cb = callback->event_cb;
+    (*ds_global_data)->caller_data.caller_cookie = cookie;
+    dsi_handle = dsi_get_data_srvc_hndl(net_ev_cb, &(*ds_global_data)->caller_data);
+    if(dsi_handle == NULL) {
+        LOC_LOGE("%s:%d]: Could not get data handle. Retry Later\n",
                  __func__, __LINE__);
+        return E_DS_CLIENT_RETRY_LATER;
+    }
+    (*ds_global_data)->dsi_net_handle = dsi_handle;
+    return E_DS_CLIENT_SUCCESS;
+}
+
+/*Releases the dsi handle and frees the session, the start thread
+  must be joined already*/
+static void ds_client_session_destroy(ds_client_session_data **ds_global_data)
+{
+    if((*ds_global_data)->dsi_net_handle != NULL) {
+        dsi_rel_data_srvc_hndl((*ds_global_data)->dsi_net_handle);
+        (*ds_global_data)->dsi_net_handle = NULL;
+    }
+    pthread_mutex_destroy(&(*ds_global_data)->lock);
+    free(*ds_global_data);
+    *ds_global_data = NULL;
+}
+
+/**
+ * @brief Prepares for call.
+ *
+ * Obtains a handle to the dsi_netctrl layer and looks up the profile
+ * to make the call. As of now. It only searches for profiles that
+ * support emergency calls.
+ *
+ * Function to open an emergency call. Does the following things:
+ * - Returns the cached emergency profile if there is one, else
+ *   - Obtains a handle to the WDS service
+ *   - Obtains a list of profiles configured in the modem
+ *   - Queries each profile and obtains settings to check if emergency calls
+ *     are supported
+ * - Returns the profile index that supports emergency calls
+ * - Returns handle to dsi_netctrl
+ *
+ * @param[out] client_handle Client handle to initialize.
+ * @param[in]  callback      Pointer to callback function table.
+ * @param[in]  cookie        Client's cookie for using with callback calls.
+ * @param[out] profile_index Pointer to profile index number.
+ * @param[out] pdp_type      Pointer to PDP type.
+ *
+ * @return Operation result
+ * @retval E_DS_CLIENT_SUCCESS    On success. Output parameters are initialized.
+ * @retval E_DS_CLIENT_FAILURE... On error.
+ */
+static  ds_client_status_enum_type ds_client_open_call
+(
+  dsClientHandleType *client_handle,
+  const ds_client_cb_data *callback,
+  void *cookie,
+  int *profile_index,
+  int *pdp_type
+)
+{
+    ds_client_status_enum_type ret = E_DS_CLIENT_FAILURE_GENERAL;
+    ds_client_session_data **ds_global_data = (ds_client_session_data **)client_handle;
+
+    LOC_LOGD("%s:%d]:Enter\n", __func__, __LINE__);
+    if(callback == NULL || ds_global_data == NULL) {
+        LOC_LOGE("%s:%d]: Null callback parameter\n", __func__, __LINE__);
+        goto err;
+    }
+
+    ret = ds_client_get_emergency_profile(profile_index, pdp_type);
+    if(ret != E_DS_CLIENT_SUCCESS) {
+        goto err;
+    }
+
+    ret = ds_client_session_create(ds_global_data, callback, cookie);
+err:
+    LOC_LOGD("%s:%d]:Exit\n", __func__, __LINE__);
+    return ret;
+}
+
+/*Body of the async open: profile lookup and call start, off the
+  caller's thread. Failures are reported through event_cb*/
+static void *ds_client_start_call_thread(void *arg)
+{
+    ds_client_session_data *ds_global_data = (ds_client_session_data *)arg;
+    ds_client_status_enum_type ret;
+    int profile_index = -1;
+    int pdp_type = -1;
+
+    ret = ds_client_get_emergency_profile(&profile_index, &pdp_type);
+
+    pthread_mutex_lock(&ds_global_data->lock);
+    if(ret == E_DS_CLIENT_SUCCESS && ds_global_data->stop_requested) {
+        LOC_LOGD("%s:%d]: Stopped before start\n", __func__, __LINE__);
         ret = E_DS_CLIENT_FAILURE_GENERAL;
     }
+    else if(ret == E_DS_CLIENT_SUCCESS) {
+        ret = ds_client_start_call((dsClientHandleType)ds_global_data,
+                                   profile_index, pdp_type);
+    }
+    pthread_mutex_unlock(&ds_global_data->lock);
+
+    if(ret != E_DS_CLIENT_SUCCESS) {
+        LOC_LOGE("%s:%d]: Async call start failed. ret: %d\n",
+                 __func__, __LINE__, ret);
+        ds_global_data->caller_data.event_cb(E_DS_CLIENT_DATA_CALL_DISCONNECTED,
+                                             ds_global_data->caller_data.caller_cookie);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Opens and starts an emergency data call without blocking.
+ *
+ * The handle is valid on return. The profile lookup and call start
+ * run on a separate thread, the outcome is reported through the
+ * callback: E_DS_CLIENT_DATA_CALL_CONNECTED when the call is up, or
+ * E_DS_CLIENT_DATA_CALL_DISCONNECTED if it could not be started.
+ * On error the handle is released again and left NULL; if the start
+ * thread could not be created E_DS_CLIENT_DATA_CALL_DISCONNECTED is
+ * reported as well.
+ *
+ * @param[out] client_handle Client handle to initialize.
+ * @param[in]  callback      Pointer to callback function table.
+ * @param[in]  cookie        Client's cookie for using with callback calls.
+ *
+ * @return Operation result
+ * @retval E_DS_CLIENT_SUCCESS    On success, result follows via callback.
+ * @retval E_DS_CLIENT_FAILURE... On error.
+ */
+static ds_client_status_enum_type ds_client_open_and_start_call_async
+(
+  dsClientHandleType *client_handle,
+  const ds_client_cb_data *callback,
+  void *cookie
+)
+{
+    ds_client_status_enum_type ret = E_DS_CLIENT_FAILURE_GENERAL;
+    ds_client_session_data **ds_global_data = (ds_client_session_data **)client_handle;
+
+    LOC_LOGD("%s:%d]:Enter\n", __func__, __LINE__);
+    if(callback == NULL || ds_global_data == NULL) {
+        LOC_LOGE("%s:%d]: Null callback parameter\n", __func__, __LINE__);
+        goto err;
+    }
+
+    ret = ds_client_session_create(ds_global_data, callback, cookie);
+    if(ret != E_DS_CLIENT_SUCCESS) {
+        //The caller gets no handle to close on error
+        if(*ds_global_data != NULL) {
+            ds_client_session_destroy(ds_global_data);
+        }
+        goto err;
+    }
+
+    if(pthread_create(&(*ds_global_data)->start_thread, NULL,
+                      ds_client_start_call_thread, *ds_global_data) != 0) {
+        LOC_LOGE("%s:%d]: Could not create start thread\n", __func__, __LINE__);
+        ds_client_session_destroy(ds_global_data);
+        callback->event_cb(E_DS_CLIENT_DATA_CALL_DISCONNECTED, cookie);
+        ret = E_DS_CLIENT_FAILURE_GENERAL;
+        goto err;
+    }
+    (*ds_global_data)->start_thread_valid = true;
 err:
-    if(profile_list_resp_msg.p_get_profile_list_resp)
-        free(profile_list_resp_msg.p_get_profile_list_resp);
-    if(profile_settings_resp_msg.p_get_profile_setting_resp)
-        free(profile_settings_resp_msg.p_get_profile_setting_resp);
     LOC_LOGD("%s:%d]:Exit\n", __func__, __LINE__);
     return ret;
 }
@@ -745,6 +1012,9 @@ static ds_client_status_enum_type ds_client_stop_call(dsClientHandleType client_
         goto err;
     }
 
+    //Held so an async start can't race with the stop
+    pthread_mutex_lock(&p_ds_global_data->lock);
+    p_ds_global_data->stop_requested = true;
     if(dsi_stop_data_call(p_ds_global_data->dsi_net_handle) == DSI_SUCCESS) {
         LOC_LOGD("%s:%d]: Sent request to stop data call\n", __func__, __LINE__);
     }
@@ -752,8 +1022,8 @@ static ds_client_status_enum_type ds_client_stop_call(dsClientHandleType client_
         LOC_LOGE("%s:%d]: Could not send request to stop data call\n",
                  __func__, __LINE__);
         ret = E_DS_CLIENT_FAILURE_GENERAL;
-        goto err;
     }
+    pthread_mutex_unlock(&p_ds_global_data->lock);
 
 err:
     LOC_LOGD("%s:%d]:Exit\n", __func__, __LINE__);
@@ -775,10 +1045,11 @@ static void ds_client_close_call(dsClientHandleType *client_handle)
         LOC_LOGE("%s:%d]: Null argument received. Failing\n", __func__, __LINE__);
         goto err;
     }
-    dsi_rel_data_srvc_hndl((*ds_global_data)->dsi_net_handle);
-    (*ds_global_data)->dsi_net_handle = NULL;
-    free(*ds_global_data);
-    *ds_global_data = NULL;
+    if((*ds_global_data)->start_thread_valid) {
+        pthread_join((*ds_global_data)->start_thread, NULL);
+        (*ds_global_data)->start_thread_valid = false;
+    }
+    ds_client_session_destroy(ds_global_data);
     LOC_LOGD("%s:%d]: Released Data handle\n", __func__, __LINE__);
 err:
     LOC_LOGD("%s:%d]:Exit\n", __func__, __LINE__);
@@ -801,6 +1072,11 @@ static ds_client_status_enum_type ds_client_init(bool is_ssr)
 {
   ds_client_status_enum_type ret = E_DS_CLIENT_SUCCESS;
   int dsi_mode = (is_ssr)?DSI_MODE_SSR:DSI_MODE_GENERAL;
+  if(is_ssr)
+  {
+    //Profiles may have been reprovisioned while the modem was down
+    ds_client_invalidate_profile_cache("modem restart");
+  }
   if(DSI_SUCCESS != dsi_init(dsi_mode))
   {
     ret = E_DS_CLIENT_FAILURE_GENERAL;
@@ -827,6 +1103,15 @@ static ds_client_status_enum_type ds_client_release()
 {
   ds_client_status_enum_type ret = E_DS_CLIENT_SUCCESS;
 
+  pthread_mutex_lock(&ds_profile_cache.lock);
+  ds_profile_cache.valid = false;
+  if(ds_profile_cache.wds_qmi_client_valid)
+  {
+    qmi_client_release(ds_profile_cache.wds_qmi_client);
+    ds_profile_cache.wds_qmi_client_valid = false;
+  }
+  pthread_mutex_unlock(&ds_profile_cache.lock);
+
   if(DSI_SUCCESS != dsi_release(DSI_MODE_GENERAL))
   {
     ret = E_DS_CLIENT_FAILURE_GENERAL;
@@ -845,7 +1130,8 @@ static const ds_client_iface_type iface =
   .pfn_start_call = ds_client_start_call,
   .pfn_stop_call  = ds_client_stop_call,
   .pfn_close_call = ds_client_close_call,
-  .pfn_release    = ds_client_release
+  .pfn_release    = ds_client_release,
+  .pfn_open_and_start_call_async = ds_client_open_and_start_call_async
 };
 
 /**
@@ -253,6 +253,38 @@ typedef void ds_client_close_call_type
  */
 typedef ds_client_status_enum_type ds_client_release_type();
 
+/**
+ * @brief Opens and starts an emergency data call without blocking.
+ *
+ * Combines @a ds_client_open_call_type and @a ds_client_start_call_type.
+ * The handle is valid on return; the profile lookup and call start run
+ * asynchronously. The emergency profile is cached between calls, so only
+ * the first call after init, a profile change or a modem restart pays for
+ * the WDS profile queries.
+ *
+ * The outcome is reported through the callback:
+ * E_DS_CLIENT_DATA_CALL_CONNECTED when the call is up, or
+ * E_DS_CLIENT_DATA_CALL_DISCONNECTED if it could not be started.
+ * The handle must be released with @a ds_client_close_call_type.
+ * On error the handle is already released and left NULL; a start
+ * thread that could not be created is also reported as
+ * E_DS_CLIENT_DATA_CALL_DISCONNECTED.
+ *
+ * @param[out] client_handle Client handle to initialize.
+ * @param[in]  callback      Pointer to callback function table.
+ * @param[in]  cookie        Client's cookie for using with callback calls.
+ *
+ * @return Operation result
+ * @retval E_DS_CLIENT_SUCCESS    On success, result follows via callback.
+ * @retval E_DS_CLIENT_FAILURE... On error.
+ */
+typedef ds_client_status_enum_type ds_client_open_and_start_call_async_type
+(
+  dsClientHandleType *client_handle,
+  const ds_client_cb_data *callback,
+  void *cookie
+);
+
 /**
  * @brief DS client functional interface table
  *
@@ -269,6 +301,7 @@ typedef struct
   ds_client_stop_call_type  *pfn_stop_call;
   ds_client_close_call_type *pfn_close_call;
   ds_client_release_type    *pfn_release;
+  ds_client_open_and_start_call_async_type *pfn_open_and_start_call_async;
 } ds_client_iface_type;
 
 /**
@@ -25,6 +25,16 @@ LOCAL_SHARED_LIBRARIES := \
 
 LOCAL_SRC_FILES = \
     LocApiV02.cpp \
+    LocSessionMux.cpp \
+    LocSampleInjector.cpp \
+    LocSensorInjector.cpp \
+    LocVehicleSensorInjector.cpp \
+    LocPpsTime.cpp \
+    LocNmeaSplitter.cpp \
+    LocNmeaFanout.cpp \
+    LocNmeaGenerator.cpp \
+    LocSvReportFilter.cpp \
+    LocSvPolyCache.cpp \
     loc_api_v02_log.c \
     loc_api_v02_client.c \
     loc_api_sync_req.c \
@@ -42,6 +52,7 @@ LOCAL_HEADER_LIBRARIES := \
     libloc_core_headers \
     libgps.utils_headers \
     libloc_ds_api_headers \
+    libgnsspps_headers \
     libloc_pla_headers \
     liblocation_api_headers
 LOCAL_CFLAGS += $(GNSS_CFLAGS)
@@ -35,6 +35,7 @@
 #include <string.h>
 #include <math.h>
 #include <dlfcn.h>
+#include <pthread.h>
 
 #include <LocApiV02.h>
 #include <loc_api_v02_log.h>
@@ -92,6 +93,79 @@ const float CarrierFrequencies[] = {
 /* the time, in seconds, to wait for user response for NI  */
 #define LOC_NI_NO_RESPONSE_TIME 20
 
+/* ATL latency trace in loc_net_iface, used only if the HAL already
+   loaded it */
+#ifdef USE_GLIB
+#define LOC_NET_IFACE_LIB_NAME "libloc_net_iface.so.1"
+#else
+#define LOC_NET_IFACE_LIB_NAME "libloc_net_iface.so"
+#endif
+#define LOC_NET_TRACE_ATL_REQUEST_FN "LocNetTrace_atlRequest"
+#define LOC_NET_TRACE_ATL_OPEN_STATUS_FN "LocNetTrace_atlOpenStatus"
+typedef uint32_t LocNetTraceAtlRequestFn(int32_t connHandle, int agpsType);
+typedef void LocNetTraceAtlOpenStatusFn(int32_t connHandle, bool isSuccess);
+
+/* trace the ATL open stages seen here into loc_net_iface, no-op when
+   that library isn't loaded. The HAL may load it after the first ATL
+   event, so the lookup is retried on every event until the library is
+   found; it is then kept referenced so the cached pointers stay valid */
+static pthread_mutex_t sLocNetTraceMutex = PTHREAD_MUTEX_INITIALIZER;
+static bool sLocNetTraceResolved = false;
+static LocNetTraceAtlRequestFn *sTraceAtlRequestFn = NULL;
+static LocNetTraceAtlOpenStatusFn *sTraceAtlOpenStatusFn = NULL;
+
+/* true once the lookup is settled, the pointers may still be NULL if
+   the library has neither symbol */
+static bool resolveLocNetTrace()
+{
+  if (__atomic_load_n(&sLocNetTraceResolved, __ATOMIC_ACQUIRE))
+  {
+    return true;
+  }
+  pthread_mutex_lock(&sLocNetTraceMutex);
+  if (!sLocNetTraceResolved)
+  {
+    void *handle = dlopen(LOC_NET_IFACE_LIB_NAME, RTLD_NOW | RTLD_NOLOAD);
+    if (NULL == handle)
+    {
+      LOC_LOGV("%s:%d]: %s not loaded yet, ATL event not traced",
+               __func__, __LINE__, LOC_NET_IFACE_LIB_NAME);
+    }
+    else
+    {
+      sTraceAtlRequestFn = (LocNetTraceAtlRequestFn*)dlsym(
+          handle, LOC_NET_TRACE_ATL_REQUEST_FN);
+      sTraceAtlOpenStatusFn = (LocNetTraceAtlOpenStatusFn*)dlsym(
+          handle, LOC_NET_TRACE_ATL_OPEN_STATUS_FN);
+      if (NULL == sTraceAtlRequestFn && NULL == sTraceAtlOpenStatusFn)
+      {
+        LOC_LOGD("%s:%d]: %s has no ATL trace, disabled",
+                 __func__, __LINE__, LOC_NET_IFACE_LIB_NAME);
+        dlclose(handle);
+      }
+      __atomic_store_n(&sLocNetTraceResolved, true, __ATOMIC_RELEASE);
+    }
+  }
+  pthread_mutex_unlock(&sLocNetTraceMutex);
+  return __atomic_load_n(&sLocNetTraceResolved, __ATOMIC_ACQUIRE);
+}
+
+static void traceAtlRequest(uint32_t connHandle, LocAGpsType agpsType)
+{
+  if (resolveLocNetTrace() && NULL != sTraceAtlRequestFn)
+  {
+    sTraceAtlRequestFn((int32_t)connHandle, (int)agpsType);
+  }
+}
+
+static void traceAtlOpenStatus(int connHandle, bool isSuccess)
+{
+  if (resolveLocNetTrace() && NULL != sTraceAtlOpenStatusFn)
+  {
+    sTraceAtlOpenStatusFn((int32_t)connHandle, isSuccess);
+  }
+}
+
 /* Gaussian 2D scaling table - scale from x% to 68% confidence */
 struct conf_scaler_to_68_pair {
     uint8_t confidence;
@@ -107,9 +181,52 @@ const struct conf_scaler_to_68_pair confScalers[CONF_SCALER_ARRAY_MAX] = {
 
 /*fixed timestamp uncertainty 10 milli second */
 static int ap_timestamp_uncertainty = 0;
+/* PPS device used to timestamp reports with the time they were measured
+   instead of the time they arrived and to refine injected time, empty to
+   disable */
+static char pps_timestamping_device[LOC_MAX_PARAM_STRING];
+/* allowance for the QMI transport delay of a PPS refined time injection */
+#define PPS_TIME_INJECT_TRANSPORT_UNC_MS (2)
+/* local socket NMEA readers connect to for the shared memory ring, empty
+   to disable */
+static char nmea_fanout_socket[LOC_MAX_PARAM_STRING];
+/* size of the shared NMEA ring in bytes, rounded up to a power of 2 */
+static uint32_t nmea_fanout_ring_size = 64 * 1024;
+/* sentence types reported to the location engine, e.g. "GGA,RMC,GSV";
+   empty for all. Fan-out readers choose their own. */
+static char nmea_report_types[LOC_MAX_PARAM_STRING];
+/* 1 to generate GGA, RMC, GSA, GSV and VTG on the AP from the position
+   and SV reports, the modem only sends the other types. 2 to keep modem
+   NMEA and log where the AP generated sentences differ from it */
+#define NMEA_AP_SYNTHESIS_ON      (1)
+#define NMEA_AP_SYNTHESIS_COMPARE (2)
+static uint32_t nmea_ap_synthesis = 0;
+/* how many NMEA reports or epochs to average the CPU cost over */
+#define NMEA_CPU_STATS_INTERVAL (100)
+/* an SV report is only passed on if an SV came or went, its flags changed
+   or its C/N0 (dB-Hz) or elevation (degrees) moved by the threshold, or
+   the last one passed is SV_REPORT_MAX_AGE_MS old. SV_REPORT_MAX_AGE_MS
+   of 0, the default, turns the filter off and passes every report */
+static uint32_t sv_report_cn0_threshold = 2;
+static uint32_t sv_report_elevation_threshold = 1;
+static uint32_t sv_report_max_age_ms = 0;
+/* SV polynomials are dropped SV_POLY_MAX_AGE_SEC after they were reported
+   and not evaluated further than SV_POLY_MAX_DT_SEC from their T0 */
+static uint32_t sv_poly_max_age_sec = 1800;
+static uint32_t sv_poly_max_dt_sec = 900;
 static loc_param_s_type gps_conf_param_table[] =
 {
-        {"AP_TIMESTAMP_UNCERTAINTY",&ap_timestamp_uncertainty,NULL,'n'}
+        {"AP_TIMESTAMP_UNCERTAINTY",&ap_timestamp_uncertainty,NULL,'n'},
+        {"PPS_TIMESTAMPING_DEVICE",&pps_timestamping_device,NULL,'s'},
+        {"NMEA_FANOUT_SOCKET",&nmea_fanout_socket,NULL,'s'},
+        {"NMEA_FANOUT_RING_SIZE",&nmea_fanout_ring_size,NULL,'n'},
+        {"NMEA_REPORT_TYPES",&nmea_report_types,NULL,'s'},
+        {"NMEA_AP_SYNTHESIS",&nmea_ap_synthesis,NULL,'n'},
+        {"SV_REPORT_CN0_THRESHOLD",&sv_report_cn0_threshold,NULL,'n'},
+        {"SV_REPORT_ELEVATION_THRESHOLD",&sv_report_elevation_threshold,NULL,'n'},
+        {"SV_REPORT_MAX_AGE_MS",&sv_report_max_age_ms,NULL,'n'},
+        {"SV_POLY_MAX_AGE_SEC",&sv_poly_max_age_sec,NULL,'n'},
+        {"SV_POLY_MAX_DT_SEC",&sv_poly_max_dt_sec,NULL,'n'}
 };
 
 /* static event callbacks that call the LocApiV02 callbacks*/
@@ -206,6 +323,23 @@ locClientCallbacksType globalCallbacks =
     globalErrorCb
 };
 
+/* current CLOCK_BOOTTIME in milliseconds, the time base of the
+   injected sensor samples; 0 on failure */
+static int64_t getBootTimeMs()
+{
+    return (int64_t)(LocSampleInjectorBase::getBootTimeNs() / 1000000);
+}
+
+/* CPU time of the calling thread in nanoseconds, 0 on failure */
+static uint64_t getThreadCpuTimeNs()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 static void getInterSystemTimeBias(const char* interSystem,
                                    Gnss_InterSystemBiasStructType &interSystemBias,
                                    const qmiLocInterSystemBiasStructT_v02* pInterSysBias)
@@ -228,20 +362,55 @@ LocApiV02 :: LocApiV02(const MsgTask* msgTask,
     dsLibraryHandle(NULL),
     dsClientIface(NULL),
     dsClientHandle(NULL),
+    mDsClientRequested(false),
+    mDsClientInitialized(false),
     mGnssMeasurementSupported(sup_unknown),
     mQmiMask(0), mInSession(false),
-    mEngineOn(false), mMeasurementsStarted(false)
+    mEngineOn(false), mMeasurementsStarted(false),
+    mOutdoorTripBatchingSupported(false), mInOutdoorTripBatching(false),
+    mUpdateTbfOnTheFlySupported(false), mEngineSessionStarted(false),
+    mSensorInjector(NULL), mVehicleSensorInjector(NULL), mNmeaFanout(NULL),
+    mNmeaReportTypes(LOC_NMEA_TYPE_MASK_ALL), mNmeaGenerator(NULL),
+    mNmeaComparator(NULL), mModemNmeaTypes(0),
+    mCriteriaUpdate(0)
 {
   // initialize loc_sync_req interface
   loc_sync_req_init();
 
   UTIL_READ_CONF(LOC_PATH_GPS_CONF,gps_conf_param_table);
+
+  if ('\0' != pps_timestamping_device[0]) {
+      mPpsTime.open(pps_timestamping_device);
+  }
+
+  mNmeaReportTypes = LocNmeaSplitter::parseTypeMask(nmea_report_types);
+  if (NMEA_AP_SYNTHESIS_ON == nmea_ap_synthesis ||
+      NMEA_AP_SYNTHESIS_COMPARE == nmea_ap_synthesis) {
+      mNmeaGenerator = new LocNmeaGenerator();
+  }
+  if (NMEA_AP_SYNTHESIS_COMPARE == nmea_ap_synthesis) {
+      mNmeaComparator = new LocNmeaComparator();
+  }
+  mSvReportFilter.configure(sv_report_cn0_threshold, sv_report_elevation_threshold,
+                            sv_report_max_age_ms);
+  mSvPolyCache.configure(sv_poly_max_age_sec * 1000, sv_poly_max_dt_sec);
+
+  if ('\0' != nmea_fanout_socket[0]) {
+      mNmeaFanout = new LocNmeaFanoutServer(nmea_fanout_socket, nmea_fanout_ring_size);
+      if (!mNmeaFanout->start()) {
+          delete mNmeaFanout;
+          mNmeaFanout = NULL;
+      }
+  }
 }
 
 /* Destructor for LocApiV02 */
 LocApiV02 :: ~LocApiV02()
 {
     close();
+    delete mNmeaFanout;
+    delete mNmeaGenerator;
+    delete mNmeaComparator;
 }
 
 LocApiBase* getLocApi(const MsgTask *msgTask,
@@ -376,19 +545,21 @@ LocApiV02 :: open(LOC_API_ADAPTER_EVENT_MASK_T mask)
                             QMI_LOC_MASK_AON_DISTANCE_BASED_TRACKING_SUPPORTED_V02) {
                             LOC_LOGD("%s:%d]: DBT 2.0 is supported.\n", __func__, __LINE__);
                         }
-                        if (queryAonConfigInd.aonCapability |
+                        if (queryAonConfigInd.aonCapability &
                             QMI_LOC_MASK_AON_UPDATE_TBF_SUPPORTED_V02) {
                             LOC_LOGD("%s:%d]: Updating tracking TBF on the fly is supported.\n",
                                      __func__, __LINE__);
                             supportedMsgList |=
                                 (1 << LOC_API_ADAPTER_MESSAGE_UPDATE_TBF_ON_THE_FLY);
+                            mUpdateTbfOnTheFlySupported = true;
                         }
-                        if (queryAonConfigInd.aonCapability |
+                        if (queryAonConfigInd.aonCapability &
                             QMI_LOC_MASK_AON_OUTDOOR_TRIP_BATCHING_SUPPORTED_V02) {
                             LOC_LOGD("%s:%d]: OTB is supported.\n",
                                      __func__, __LINE__);
                             supportedMsgList |=
                                 (1 << LOC_API_ADAPTER_MESSAGE_OUTDOOR_TRIP_BATCHING);
+                            mOutdoorTripBatchingSupported = true;
                         }
                     } else {
                         LOC_LOGE("%s:%d]: AON capability is invalid.\n", __func__, __LINE__);
@@ -469,6 +640,14 @@ void LocApiV02 :: registerEventMask(LOC_API_ADAPTER_EVENT_MASK_T adapterMask)
 locClientEventMaskType LocApiV02 :: adjustMaskIfNoSession(locClientEventMaskType qmiMask)
 {
     locClientEventMaskType oldQmiMask = qmiMask;
+    // NMEA is generated from the position and SV reports, the modem
+    // only reports the types left to it, or all of them to compare
+    if (NULL != mNmeaGenerator && (qmiMask & QMI_LOC_EVENT_MASK_NMEA_V02)) {
+        qmiMask |= QMI_LOC_EVENT_MASK_POSITION_REPORT_V02 | QMI_LOC_EVENT_MASK_GNSS_SV_INFO_V02;
+        if (NULL == mNmeaComparator && 0 == mModemNmeaTypes) {
+            qmiMask &= ~QMI_LOC_EVENT_MASK_NMEA_V02;
+        }
+    }
     if (!mInSession) {
         locClientEventMaskType clearMask = QMI_LOC_EVENT_MASK_POSITION_REPORT_V02 |
                                            QMI_LOC_EVENT_MASK_GNSS_SV_INFO_V02 |
@@ -478,6 +657,10 @@ locClientEventMaskType LocApiV02 :: adjustMaskIfNoSession(locClientEventMaskType
 
         qmiMask = qmiMask & ~clearMask;
     }
+    // injected sensor samples are in AP time, the engine has to sync to it
+    if (NULL != mSensorInjector.load() || NULL != mVehicleSensorInjector.load()) {
+        qmiMask |= QMI_LOC_EVENT_MASK_TIME_SYNC_REQ_V02;
+    }
     LOC_LOGd("oldQmiMask=%" PRIu64 " qmiMask=%" PRIu64 " mInSession: %d",
             oldQmiMask, qmiMask, mInSession);
     return qmiMask;
@@ -485,6 +668,10 @@ locClientEventMaskType LocApiV02 :: adjustMaskIfNoSession(locClientEventMaskType
 
 enum loc_api_adapter_err LocApiV02 :: close()
 {
+  // the injector sends on the client handle from its own thread
+  stopSensorInjection();
+  stopVehicleSensorInjection();
+
   enum loc_api_adapter_err rtv =
       // success if either client is already invalid, or
       // we successfully close the handle
@@ -495,13 +682,107 @@ enum loc_api_adapter_err LocApiV02 :: close()
   mMask = 0;
   mQmiMask = 0;
   mInSession = false;
+  // sessions from before the close must not shape the criteria after re-open
+  mSessionMux.clear();
+  mSvPolyCache.clear();
+  mOutdoorTripBatchingSupported = false;
+  mInOutdoorTripBatching = false;
+  mUpdateTbfOnTheFlySupported = false;
+  mEngineSessionStarted = false;
   clientHandle = LOC_CLIENT_INVALID_HANDLE_VALUE;
 
   return rtv;
 }
 
-/* start positioning session */
-enum loc_api_adapter_err LocApiV02 :: startFix(const LocPosMode& fixCriteria)
+/* fill in a QMI_LOC_START_REQ from the loc eng fix criteria */
+void LocApiV02 :: convertStartReq(const LocPosMode& fixCriteria,
+                                  qmiLocStartReqMsgT_v02& start_msg)
+{
+  memset (&start_msg, 0, sizeof(start_msg));
+
+  start_msg.minInterval_valid = 1;
+  start_msg.minInterval = fixCriteria.min_interval;
+
+  start_msg.horizontalAccuracyLevel_valid = 1;
+
+  if (fixCriteria.preferred_accuracy <= 100)
+  {
+      // fix needs high accuracy
+      start_msg.horizontalAccuracyLevel =  eQMI_LOC_ACCURACY_HIGH_V02;
+  }
+  else if (fixCriteria.preferred_accuracy <= LOC_LOW_ACCURACY_THRESHOLD_M)
+  {
+      //fix needs med accuracy
+      start_msg.horizontalAccuracyLevel =  eQMI_LOC_ACCURACY_MED_V02;
+  }
+  else
+  {
+      //fix needs low accuracy
+      start_msg.horizontalAccuracyLevel =  eQMI_LOC_ACCURACY_LOW_V02;
+      // limit the scanning max time to 1 min and TBF to 10 min
+      // this is to control the power cost for gps for LOW accuracy
+      start_msg.positionReportTimeout_valid = 1;
+      start_msg.positionReportTimeout = 60000;
+      // the session mux decimates at this same interval
+      start_msg.minInterval = LocSessionMux::getEngineInterval(fixCriteria);
+  }
+
+  start_msg.fixRecurrence_valid = 1;
+  if(LOC_GPS_POSITION_RECURRENCE_SINGLE == fixCriteria.recurrence)
+  {
+      start_msg.fixRecurrence = eQMI_LOC_RECURRENCE_SINGLE_V02;
+  }
+  else
+  {
+      start_msg.fixRecurrence = eQMI_LOC_RECURRENCE_PERIODIC_V02;
+  }
+
+  //dummy session id
+  // TBD: store session ID, check for session id in pos reports.
+  start_msg.sessionId = LOC_API_V02_DEF_SESSION_ID;
+
+  //Set whether position report can be shared with other LOC clients
+  start_msg.sharePosition_valid = 1;
+  start_msg.sharePosition = fixCriteria.share_position;
+
+  if (fixCriteria.credentials[0] != 0) {
+      int size1 = sizeof(start_msg.applicationId.applicationName);
+      int size2 = sizeof(fixCriteria.credentials);
+      int len = ((size1 < size2) ? size1 : size2) - 1;
+      memcpy(start_msg.applicationId.applicationName,
+             fixCriteria.credentials,
+             len);
+
+      size1 = sizeof(start_msg.applicationId.applicationProvider);
+      size2 = sizeof(fixCriteria.provider);
+      len = ((size1 < size2) ? size1 : size2) - 1;
+      memcpy(start_msg.applicationId.applicationProvider,
+             fixCriteria.provider,
+             len);
+
+      start_msg.applicationId_valid = 1;
+  }
+
+  // config Altitude Assumed
+  start_msg.configAltitudeAssumed_valid = 1;
+  start_msg.configAltitudeAssumed = eQMI_LOC_ALTITUDE_ASSUMED_IN_GNSS_SV_INFO_DISABLED_V02;
+}
+
+/* true if newCriteria differs from the running session only in
+   TBF and / or accuracy, i.e. it can be applied without a restart */
+bool LocApiV02 :: isTbfOrAccuracyOnlyChange(const LocPosMode& newCriteria) const
+{
+  return newCriteria.mode == mFixCriteria.mode &&
+         newCriteria.recurrence == mFixCriteria.recurrence &&
+         newCriteria.share_position == mFixCriteria.share_position &&
+         0 == strncmp(newCriteria.credentials, mFixCriteria.credentials,
+                      sizeof(newCriteria.credentials)) &&
+         0 == strncmp(newCriteria.provider, mFixCriteria.provider,
+                      sizeof(newCriteria.provider));
+}
+
+/* start the engine tracking session, or restart it with new criteria */
+enum loc_api_adapter_err LocApiV02 :: sendStartFix(const LocPosMode& fixCriteria)
 {
   locClientStatusEnumType status;
   locClientReqUnionType req_union;
@@ -512,7 +793,6 @@ enum loc_api_adapter_err LocApiV02 :: startFix(const LocPosMode& fixCriteria)
   qmiLocSetOperationModeIndMsgT_v02 set_mode_ind;
 
     // clear all fields, validity masks
-  memset (&start_msg, 0, sizeof(start_msg));
   memset (&set_mode_msg, 0, sizeof(set_mode_msg));
   memset (&set_mode_ind, 0, sizeof(set_mode_ind));
 
@@ -521,6 +801,8 @@ enum loc_api_adapter_err LocApiV02 :: startFix(const LocPosMode& fixCriteria)
 
   mInSession = true;
   mMeasurementsStarted = true;
+  // report the SVs of the new session right away
+  mSvReportFilter.reset();
   registerEventMask(mMask);
 
   // fill in the start request
@@ -568,84 +850,51 @@ enum loc_api_adapter_err LocApiV02 :: startFix(const LocPosMode& fixCriteria)
       {
           LOC_LOGE ("%s:%d]: set operation mode timed out\n", __func__, __LINE__);
       }
-      start_msg.minInterval_valid = 1;
-      start_msg.minInterval = fixCriteria.min_interval;
+      convertStartReq(fixCriteria, start_msg);
 
-      start_msg.horizontalAccuracyLevel_valid = 1;
+      req_union.pStartReq = &start_msg;
 
-      if (fixCriteria.preferred_accuracy <= 100)
-      {
-          // fix needs high accuracy
-          start_msg.horizontalAccuracyLevel =  eQMI_LOC_ACCURACY_HIGH_V02;
-      }
-      else if (fixCriteria.preferred_accuracy <= 1000)
-      {
-          //fix needs med accuracy
-          start_msg.horizontalAccuracyLevel =  eQMI_LOC_ACCURACY_MED_V02;
-      }
-      else
-      {
-          //fix needs low accuracy
-          start_msg.horizontalAccuracyLevel =  eQMI_LOC_ACCURACY_LOW_V02;
-          // limit the scanning max time to 1 min and TBF to 10 min
-          // this is to control the power cost for gps for LOW accuracy
-          start_msg.positionReportTimeout_valid = 1;
-          start_msg.positionReportTimeout = 60000;
-          if (start_msg.minInterval < 600000) {
-              start_msg.minInterval = 600000;
-          }
+      status = locClientSendReq(QMI_LOC_START_REQ_V02, req_union);
+      if (eLOC_CLIENT_SUCCESS == status) {
+          mFixCriteria = fixCriteria;
+          mEngineSessionStarted = true;
       }
+  }
 
-      start_msg.fixRecurrence_valid = 1;
-      if(LOC_GPS_POSITION_RECURRENCE_SINGLE == fixCriteria.recurrence)
-      {
-          start_msg.fixRecurrence = eQMI_LOC_RECURRENCE_SINGLE_V02;
-      }
-      else
-      {
-          start_msg.fixRecurrence = eQMI_LOC_RECURRENCE_PERIODIC_V02;
-      }
+  return convertErr(status);
+}
 
-      //dummy session id
-      // TBD: store session ID, check for session id in pos reports.
-      start_msg.sessionId = LOC_API_V02_DEF_SESSION_ID;
-
-      //Set whether position report can be shared with other LOC clients
-      start_msg.sharePosition_valid = 1;
-      start_msg.sharePosition = fixCriteria.share_position;
-
-      if (fixCriteria.credentials[0] != 0) {
-          int size1 = sizeof(start_msg.applicationId.applicationName);
-          int size2 = sizeof(fixCriteria.credentials);
-          int len = ((size1 < size2) ? size1 : size2) - 1;
-          memcpy(start_msg.applicationId.applicationName,
-                 fixCriteria.credentials,
-                 len);
-
-          size1 = sizeof(start_msg.applicationId.applicationProvider);
-          size2 = sizeof(fixCriteria.provider);
-          len = ((size1 < size2) ? size1 : size2) - 1;
-          memcpy(start_msg.applicationId.applicationProvider,
-                 fixCriteria.provider,
-                 len);
-
-          start_msg.applicationId_valid = 1;
-      }
+/* apply new TBF / accuracy to the running session. The engine keeps
+   the session (and its measurements) alive, so no fix gap is created.
+   Only valid if mUpdateTbfOnTheFlySupported */
+enum loc_api_adapter_err LocApiV02 :: updateFixCriteria(const LocPosMode& fixCriteria)
+{
+  locClientStatusEnumType status;
+  locClientReqUnionType req_union;
+  qmiLocStartReqMsgT_v02 start_msg;
 
-      // config Altitude Assumed
-      start_msg.configAltitudeAssumed_valid = 1;
-      start_msg.configAltitudeAssumed = eQMI_LOC_ALTITUDE_ASSUMED_IN_GNSS_SV_INFO_DISABLED_V02;
+  LOC_LOGD("%s:%d]: TBF %u -> %u, accuracy %u -> %u\n", __func__, __LINE__,
+           mFixCriteria.min_interval, fixCriteria.min_interval,
+           mFixCriteria.preferred_accuracy, fixCriteria.preferred_accuracy);
 
-      req_union.pStartReq = &start_msg;
+  // re-sending START on the same session id while tracking only updates
+  // the criteria, SET_OPERATION_MODE is not needed as the mode is unchanged
+  convertStartReq(fixCriteria, start_msg);
+  req_union.pStartReq = &start_msg;
 
-      status = locClientSendReq(QMI_LOC_START_REQ_V02, req_union);
+  status = locClientSendReq(QMI_LOC_START_REQ_V02, req_union);
+  if (eLOC_CLIENT_SUCCESS == status) {
+      mFixCriteria = fixCriteria;
+  } else {
+      LOC_LOGE("%s:%d]: error = %s\n", __func__, __LINE__,
+               loc_get_v02_client_status_name(status));
   }
 
   return convertErr(status);
 }
 
-/* stop a positioning session */
-enum loc_api_adapter_err LocApiV02 :: stopFix()
+/* stop the engine tracking session */
+enum loc_api_adapter_err LocApiV02 :: sendStopFix()
 {
   locClientStatusEnumType status;
   locClientReqUnionType req_union;
@@ -664,6 +913,7 @@ enum loc_api_adapter_err LocApiV02 :: stopFix()
   status = locClientSendReq(QMI_LOC_STOP_REQ_V02, req_union);
 
   mInSession = false;
+  mEngineSessionStarted = false;
   // if engine on never happend, deregister events
   // without waiting for Engine Off
   if (!mEngineOn) {
@@ -679,22 +929,126 @@ enum loc_api_adapter_err LocApiV02 :: stopFix()
   return convertErr(status);
 }
 
-/* set the positioning fix criteria */
-enum loc_api_adapter_err LocApiV02 :: setPositionMode(
-  const LocPosMode& posMode)
+/* bring the engine session in line with the criteria of all logical
+   sessions. The engine is only restarted if the aggregate criteria
+   changed in a way that can not be applied on the fly. */
+enum loc_api_adapter_err LocApiV02 :: applySessionCriteria()
 {
-    if(isInSession())
-    {
+    LocPosMode aggregate;
+
+    if (!mSessionMux.getAggregateCriteria(aggregate)) {
+        return mEngineSessionStarted ? sendStopFix() : LOC_API_ADAPTER_ERR_SUCCESS;
+    }
+
+    if (!mEngineSessionStarted) {
+        return sendStartFix(aggregate);
+    }
+
+    bool onTheFly = isTbfOrAccuracyOnlyChange(aggregate);
+    if (onTheFly &&
+        aggregate.min_interval == mFixCriteria.min_interval &&
+        aggregate.preferred_accuracy == mFixCriteria.preferred_accuracy) {
+        LOC_LOGV("%s:%d]: aggregate criteria unchanged\n", __func__, __LINE__);
+        return LOC_API_ADAPTER_ERR_SUCCESS;
+    }
+
+    enum loc_api_adapter_err err;
+    onTheFly = onTheFly && mUpdateTbfOnTheFlySupported;
+    if (onTheFly) {
+        LOC_LOGD ("%s:%d]: fix is in progress updating TBF / accuracy "
+                  "on the fly\n", __func__, __LINE__);
+        err = updateFixCriteria(aggregate);
+    } else {
         //fix is in progress, send a restart
         LOC_LOGD ("%s:%d]: fix is in progress restarting the fix with new "
                   "criteria\n", __func__, __LINE__);
+        err = sendStartFix(aggregate);
+    }
+
+    // time the gap to the next fix, see reportPosition
+    if (LOC_API_ADAPTER_ERR_SUCCESS == err) {
+        mCriteriaUpdate = (getBootTimeMs() << 1) | (onTheFly ? 1 : 0);
+    }
+    return err;
+}
+
+/* start positioning session */
+enum loc_api_adapter_err LocApiV02 :: startFix(const LocPosMode& fixCriteria)
+{
+    mSessionMux.setDefaultSession(fixCriteria);
+    return applySessionCriteria();
+}
+
+/* stop a positioning session */
+enum loc_api_adapter_err LocApiV02 :: stopFix()
+{
+    mSessionMux.removeSession(LOC_SESSION_MUX_DEFAULT_ID);
+    if (mSessionMux.isEmpty()) {
+        // always let the engine know, even if the start had failed
+        return sendStopFix();
+    }
+    return applySessionCriteria();
+}
 
-        return( startFix(posMode));
+/* set the positioning fix criteria */
+enum loc_api_adapter_err LocApiV02 :: setPositionMode(
+  const LocPosMode& posMode)
+{
+    if(isInSession() && mSessionMux.hasSession(LOC_SESSION_MUX_DEFAULT_ID))
+    {
+        mSessionMux.setDefaultSession(posMode);
+        return applySessionCriteria();
     }
 
     return LOC_API_ADAPTER_ERR_SUCCESS;
 }
 
+/* re-apply the session criteria on the msg task */
+void LocApiV02 :: postApplySessionCriteria()
+{
+    struct MsgApplySessionCriteria : public LocMsg {
+        LocApiV02* mpLocApiV02;
+        inline MsgApplySessionCriteria(LocApiV02* pLocApiV02) :
+                LocMsg(), mpLocApiV02(pLocApiV02) {}
+        inline virtual void proc() const {
+            mpLocApiV02->applySessionCriteria();
+        }
+    };
+    sendMsg(new MsgApplySessionCriteria(this));
+}
+
+/* start a logical tracking session on top of the engine session */
+uint32_t LocApiV02 :: startTrackingSession(const LocPosMode& criteria,
+                                           const LocSessionFixCb& fixCb)
+{
+    uint32_t sessionId = mSessionMux.addSession(criteria, fixCb);
+    postApplySessionCriteria();
+    return sessionId;
+}
+
+/* change the criteria of a logical tracking session */
+bool LocApiV02 :: updateTrackingSession(uint32_t sessionId, const LocPosMode& criteria)
+{
+    if (LOC_SESSION_MUX_DEFAULT_ID == sessionId ||
+        !mSessionMux.updateSession(sessionId, criteria)) {
+        return false;
+    }
+    postApplySessionCriteria();
+    return true;
+}
+
+/* stop a logical tracking session, the engine keeps running
+   as long as other sessions are active */
+bool LocApiV02 :: stopTrackingSession(uint32_t sessionId)
+{
+    if (LOC_SESSION_MUX_DEFAULT_ID == sessionId ||
+        !mSessionMux.removeSession(sessionId)) {
+        return false;
+    }
+    postApplySessionCriteria();
+    return true;
+}
+
 /* inject time into the position engine */
 enum loc_api_adapter_err LocApiV02 ::
     setTime(LocGpsUtcTime time, int64_t timeReference, int uncertainty)
@@ -714,6 +1068,22 @@ enum loc_api_adapter_err LocApiV02 ::
 
   inject_time_msg.timeUnc = uncertainty;
 
+  // the injected time only has to name the second of the last PPS pulse,
+  // the fraction of the second comes from the pulse
+  struct timespec coarseBootTime;
+  int64_t ppsUtcMs;
+  float ppsUncMs;
+  if (mPpsTime.isOpen() && clock_gettime(CLOCK_BOOTTIME, &coarseBootTime) == 0 &&
+      mPpsTime.getUtcTime(inject_time_msg.timeUtc, coarseBootTime, uncertainty,
+                          ppsUtcMs, ppsUncMs))
+  {
+    LOC_LOGD("%s:%d]: PPS refined time %" PRId64 " ms (was %" PRIu64 " +/- %d ms)",
+             __func__, __LINE__, ppsUtcMs, inject_time_msg.timeUtc, uncertainty);
+    inject_time_msg.timeUtc = ppsUtcMs;
+    // whole ms in the message, plus the time the request takes to arrive
+    inject_time_msg.timeUnc = (uint32_t)ceil(ppsUncMs) + 1 + PPS_TIME_INJECT_TRANSPORT_UNC_MS;
+  }
+
   req_union.pInjectUtcTimeReq = &inject_time_msg;
 
   LOC_LOGV ("%s:%d]: uncertainty = %d\n", __func__, __LINE__,
@@ -1562,6 +1932,7 @@ enum loc_api_adapter_err LocApiV02 :: atlOpenStatus(
               loc_get_v02_qmi_status_name(conn_status_ind.status));
   }
 
+  traceAtlOpenStatus(handle, 0 != is_succ);
   return convertErr(result);
 
 }
@@ -1678,6 +2049,15 @@ enum loc_api_adapter_err LocApiV02 :: setNMEATypes (uint32_t typesMask)
 
   LOC_LOGD(" %s:%d]: setNMEATypes, mask = %u\n", __func__, __LINE__,typesMask);
 
+  // generated on the AP, the modem only formats the types the generator
+  // does not cover, e.g. proprietary ones. All of them to compare.
+  if (NULL != mNmeaGenerator) {
+      mNmeaGenerator->setTypes(LocNmeaGenerator::fromQmiNmeaMask(typesMask));
+      if (NULL == mNmeaComparator) {
+          typesMask &= ~LocNmeaGenerator::toQmiNmeaMask(LOC_NMEA_TYPE_MASK_ALL);
+      }
+  }
+
   memset(&setNmeaTypesReqMsg, 0, sizeof(setNmeaTypesReqMsg));
   memset(&setNmeaTypesIndMsg, 0, sizeof(setNmeaTypesIndMsg));
 
@@ -1698,6 +2078,11 @@ enum loc_api_adapter_err LocApiV02 :: setNMEATypes (uint32_t typesMask)
                   loc_get_v02_client_status_name(result),
                   loc_get_v02_qmi_status_name(setNmeaTypesIndMsg.status));
   }
+  // the NMEA event is only needed while the modem has types left
+  else if (NULL != mNmeaGenerator && typesMask != mModemNmeaTypes) {
+      mModemNmeaTypes = typesMask;
+      registerEventMask(mMask);
+  }
 
   return convertErr(result);
 }
@@ -2245,12 +2630,93 @@ enum loc_api_adapter_err LocApiV02 :: convertErr(
   }
 }
 
+/* answer the engine's time sync request with the AP (sensor) time it
+   arrived and the time the answer is sent. The receive time is taken here
+   in the QMI callback, as early as possible; the answer is built and sent
+   on the msg task */
+void LocApiV02 :: reportTimeSyncRequest(
+    const qmiLocEventTimeSyncReqIndMsgT_v02* timeSyncReq)
+{
+    struct MsgInjectTimeSyncData : public LocMsg {
+        LocApiV02* mpLocApiV02;
+        uint32_t mRefCounter;
+        uint32_t mRxTime;
+        inline MsgInjectTimeSyncData(LocApiV02* pLocApiV02, uint32_t refCounter,
+                                     uint32_t rxTime) :
+                LocMsg(), mpLocApiV02(pLocApiV02), mRefCounter(refCounter),
+                mRxTime(rxTime) {}
+        inline virtual void proc() const {
+            mpLocApiV02->injectTimeSyncData(mRefCounter, mRxTime);
+        }
+    };
+    // sensor time is boot time in ms, the same as the injected samples
+    sendMsg(new MsgInjectTimeSyncData(this, timeSyncReq->refCounter,
+                                      (uint32_t)getBootTimeMs()));
+}
+
+void LocApiV02 :: injectTimeSyncData(uint32_t refCounter, uint32_t rxTime)
+{
+    qmiLocInjectTimeSyncDataReqMsgT_v02 timeSyncData;
+    locClientReqUnionType req_union;
+    locClientStatusEnumType status;
+
+    memset(&timeSyncData, 0, sizeof(timeSyncData));
+    timeSyncData.refCounter = refCounter;
+    timeSyncData.sensorProcRxTime = rxTime;
+
+    req_union.pInjectTimeSyncReq = &timeSyncData;
+    timeSyncData.sensorProcTxTime = (uint32_t)getBootTimeMs();
+    status = locClientSendReq(QMI_LOC_INJECT_TIME_SYNC_DATA_REQ_V02, req_union);
+    if (eLOC_CLIENT_SUCCESS != status) {
+        LOC_LOGE("%s:%d]: inject time sync data failed. status: %s",
+                 __func__, __LINE__, loc_get_v02_client_status_name(status));
+    }
+    LOC_LOGV("%s:%d]: refCounter %u rx %u tx %u", __func__, __LINE__,
+             timeSyncData.refCounter, timeSyncData.sensorProcRxTime,
+             timeSyncData.sensorProcTxTime);
+}
+
+/* The report arrives after QMI transport and decoding; with a PPS fit the
+   boot time at which GNSS time had the report's phase is known, and that
+   is when the measurement was taken. apTimeStamp is left alone if there
+   is no usable fit or the derived time is after the arrival time */
+bool LocApiV02 :: ppsTimeStamp(double gnssMsOfSecond, float gnssTimeUncMs,
+                               struct timespec& apTimeStamp,
+                               float& apTimeStampUncertaintyMs)
+{
+    struct timespec measTime;
+    float uncMs;
+
+    if (!mPpsTime.isOpen() ||
+        !mPpsTime.gnssPhaseToBootTime(gnssMsOfSecond, apTimeStamp, measTime, uncMs)) {
+        return false;
+    }
+
+    LOC_LOGV("%s:%d]: arrival %ld.%09ld measured %ld.%09ld unc %f ms",
+             __func__, __LINE__, apTimeStamp.tv_sec, apTimeStamp.tv_nsec,
+             measTime.tv_sec, measTime.tv_nsec, uncMs + gnssTimeUncMs);
+    apTimeStamp = measTime;
+    apTimeStampUncertaintyMs = uncMs + gnssTimeUncMs;
+    return true;
+}
+
 /* convert position report to loc eng format and send the converted
    position to loc eng */
 
 void LocApiV02 :: reportPosition (
   const qmiLocEventPositionReportIndMsgT_v02 *location_report_ptr)
 {
+    if (NULL != mNmeaGenerator) {
+        if (mMask & (LOC_API_ADAPTER_BIT_NMEA_POSITION_REPORT |
+                     LOC_API_ADAPTER_BIT_NMEA_1HZ_REPORT)) {
+            reportSynthesizedNmea(location_report_ptr);
+        }
+        // registered for NMEA only
+        if (!(mMask & LOC_API_ADAPTER_BIT_PARSED_POSITION_REPORT)) {
+            return;
+        }
+    }
+
     UlpLocation location;
     LocPosTechMask tech_Mask = LOC_POS_TECH_MASK_DEFAULT;
     LOC_LOGD("Reporting position from V2 Adapter\n");
@@ -2269,9 +2735,42 @@ void LocApiV02 :: reportPosition (
        locationExtended.timeStamp.apTimeStampUncertaintyMs = FLT_MAX;
        LOC_LOGE("%s:%d Error in clock_gettime() ",__func__, __LINE__);
     }
+    if (FLT_MAX != locationExtended.timeStamp.apTimeStampUncertaintyMs &&
+        location_report_ptr->gpsTime_valid)
+    {
+       ppsTimeStamp(location_report_ptr->gpsTime.gpsTimeOfWeekMs % 1000,
+                    location_report_ptr->timeUnc_valid ? location_report_ptr->timeUnc : 0,
+                    locationExtended.timeStamp.apTimeStamp,
+                    locationExtended.timeStamp.apTimeStampUncertaintyMs);
+    }
     LOC_LOGD("%s:%d QMI_PosPacketTime  %ld (sec)  %ld (nsec)", __func__, __LINE__,
                  locationExtended.timeStamp.apTimeStamp.tv_sec,
                  locationExtended.timeStamp.apTimeStamp.tv_nsec);
+
+    // first fix after a criteria change, record how long the track was interrupted
+    int64_t criteriaUpdate = 0;
+    if (location_report_ptr->sessionStatus == eQMI_LOC_SESS_STATUS_SUCCESS_V02) {
+        criteriaUpdate = mCriteriaUpdate.exchange(0);
+    }
+    if (0 != criteriaUpdate) {
+        bool onTheFly = (0 != (criteriaUpdate & 1));
+        int64_t gapMs = getBootTimeMs() - (criteriaUpdate >> 1);
+        FixGapStats& stats = onTheFly ? mOnTheFlyGapStats : mRestartGapStats;
+        stats.count++;
+        stats.totalGapMs += gapMs;
+        if (gapMs > stats.maxGapMs) {
+            stats.maxGapMs = gapMs;
+        }
+        LOC_LOGD("%s:%d]: fix gap after %s: %" PRId64 " ms, avg on the fly: %" PRId64
+                 " ms (%u), avg restart: %" PRId64 " ms (%u)", __func__, __LINE__,
+                 onTheFly ? "TBF update" : "restart", gapMs,
+                 mOnTheFlyGapStats.count ?
+                     mOnTheFlyGapStats.totalGapMs / mOnTheFlyGapStats.count : 0,
+                 mOnTheFlyGapStats.count,
+                 mRestartGapStats.count ?
+                     mRestartGapStats.totalGapMs / mRestartGapStats.count : 0,
+                 mRestartGapStats.count);
+    }
     // Process the position from final and intermediate reports
 
     if( (location_report_ptr->sessionStatus == eQMI_LOC_SESS_STATUS_SUCCESS_V02) ||
@@ -2508,12 +3007,26 @@ void LocApiV02 :: reportPosition (
                locationExtended.gpsTime.gpsTimeOfWeekMs = location_report_ptr->gpsTime.gpsTimeOfWeekMs;
             }
 
-            LocApiBase::reportPosition(location,
-                                       locationExtended,
-                                       (location_report_ptr->sessionStatus ==
-                                        eQMI_LOC_SESS_STATUS_IN_PROGRESS_V02 ?
-                                        LOC_SESS_INTERMEDIATE : LOC_SESS_SUCCESS),
-                                       tech_Mask);
+            enum loc_sess_status sessStatus =
+                    (location_report_ptr->sessionStatus ==
+                     eQMI_LOC_SESS_STATUS_IN_PROGRESS_V02 ?
+                     LOC_SESS_INTERMEDIATE : LOC_SESS_SUCCESS);
+
+            // fan out to the logical sessions the fix is due for
+            bool criteriaChanged = false;
+            bool reportToEngine =
+                    mSessionMux.dispatch(location, locationExtended, sessStatus,
+                                         tech_Mask, getBootTimeMs(), criteriaChanged);
+            if (criteriaChanged) {
+                postApplySessionCriteria();
+            }
+
+            if (reportToEngine) {
+                LocApiBase::reportPosition(location,
+                                           locationExtended,
+                                           sessStatus,
+                                           tech_Mask);
+            }
         }
     }
     else
@@ -2543,6 +3056,14 @@ void  LocApiV02 :: reportSv (
             gnss_report_ptr->svList_valid,
             gnss_report_ptr->altitudeAssumed);
 
+  if (NULL != mNmeaGenerator) {
+    mNmeaGenerator->updateSvs(*gnss_report_ptr);
+    // registered for NMEA only
+    if (!(mMask & LOC_API_ADAPTER_BIT_SATELLITE_REPORT)) {
+      return;
+    }
+  }
+
   num_svs_max = 0;
 
   SvNotify.size = sizeof(GnssSvNotification);
@@ -2646,6 +3167,10 @@ void  LocApiV02 :: reportSv (
     }
   }
 
+  if (!mSvReportFilter.check(SvNotify, getBootTimeMs())) {
+    LOC_LOGV ("%s:%d]: SV report unchanged, not sent\n", __func__, __LINE__);
+    return;
+  }
   LOC_LOGV ("%s:%d]: firing SV callback\n", __func__, __LINE__);
   LocApiBase::reportSv(SvNotify);
 }
@@ -2668,6 +3193,21 @@ void  LocApiV02 :: reportSvMeasurement (
     svMeasurementSet.timeStamp.apTimeStampUncertaintyMs = FLT_MAX;
     LOC_LOGE("%s:%d Error in clock_gettime() ",__func__, __LINE__);
   }
+  if (FLT_MAX != svMeasurementSet.timeStamp.apTimeStampUncertaintyMs &&
+      gnss_raw_measurement_ptr->systemTime_valid)
+  {
+    // system time = systemMsec - systemClkTimeBias
+    double msOfSecond = fmod(gnss_raw_measurement_ptr->systemTime.systemMsec % 1000 -
+                             (double)gnss_raw_measurement_ptr->systemTime.systemClkTimeBias,
+                             1000.0);
+    if (msOfSecond < 0)
+    {
+      msOfSecond += 1000.0;
+    }
+    ppsTimeStamp(msOfSecond, gnss_raw_measurement_ptr->systemTime.systemClkTimeUncMs,
+                 svMeasurementSet.timeStamp.apTimeStamp,
+                 svMeasurementSet.timeStamp.apTimeStampUncertaintyMs);
+  }
   LOC_LOGD("%s:%d QMI_MeasPacketTime  %ld (sec)  %ld (nsec)",__func__,__LINE__,
             svMeasurementSet.timeStamp.apTimeStamp.tv_sec,
             svMeasurementSet.timeStamp.apTimeStamp.tv_nsec);
@@ -3081,6 +3621,7 @@ void  LocApiV02 :: reportSvPolynomial (
       svPolynomial.enhancedIOD = gnss_sv_poly_ptr->enhancedIOD;
     }
 
+    mSvPolyCache.update(*gnss_sv_poly_ptr, getBootTimeMs());
     LocApiBase::reportSvPolynomial(svPolynomial);
 
     LOC_LOGV("[SV_POLY_QMI] SV-Id:%d\n", svPolynomial.gnssSvId);
@@ -3172,8 +3713,8 @@ void LocApiV02 :: reportFixSessionState (
   reportStatus(status);
 }
 
-/* convert NMEA report to loc eng format and send the converted
-   report to loc eng */
+/* split an NMEA report into sentences, dropping the ones with a bad
+   checksum, and send the wanted types to loc eng and the fan-out */
 void LocApiV02 :: reportNmea (
   const qmiLocEventNmeaIndMsgT_v02 *nmea_report_ptr)
 {
@@ -3181,27 +3722,93 @@ void LocApiV02 :: reportNmea (
         return;
     }
 
+    uint64_t startCpuNs = getThreadCpuTimeNs();
     const char* p_nmea = NULL;
     uint32_t q_nmea_len = 0;
 
     if (nmea_report_ptr->expandedNmea_valid) {
         p_nmea = nmea_report_ptr->expandedNmea;
-        q_nmea_len = strlen(nmea_report_ptr->expandedNmea);
-        if (q_nmea_len > QMI_LOC_EXPANDED_NMEA_STRING_MAX_LENGTH_V02) {
-            q_nmea_len = QMI_LOC_EXPANDED_NMEA_STRING_MAX_LENGTH_V02;
-        }
+        q_nmea_len = strnlen(nmea_report_ptr->expandedNmea,
+                             QMI_LOC_EXPANDED_NMEA_STRING_MAX_LENGTH_V02);
     }
     else
     {
         p_nmea = nmea_report_ptr->nmea;
-        q_nmea_len = strlen(nmea_report_ptr->nmea);
-        if (q_nmea_len > QMI_LOC_NMEA_STRING_MAX_LENGTH_V02) {
-            q_nmea_len = QMI_LOC_NMEA_STRING_MAX_LENGTH_V02;
+        q_nmea_len = strnlen(nmea_report_ptr->nmea, QMI_LOC_NMEA_STRING_MAX_LENGTH_V02);
+    }
+
+    if ((NULL == p_nmea) || (0 == q_nmea_len)) {
+        return;
+    }
+
+    LocNmeaSplitter splitter(p_nmea, q_nmea_len);
+    LocNmeaSentence sentence;
+    while (splitter.next(sentence)) {
+        dispatchNmeaSentence(sentence);
+        if (NULL != mNmeaComparator) {
+            mNmeaComparator->addModem(sentence);
+        }
+    }
+    if (NULL != mNmeaComparator) {
+        mNmeaComparator->endModemReport();
+    }
+    if (splitter.getInvalid() > 0) {
+        LOC_LOGW("%s:%d]: dropped %u NMEA sentences with a bad checksum",
+                 __func__, __LINE__, splitter.getInvalid());
+    }
+    flushNmea(startCpuNs, mModemNmeaCpuStats, "modem");
+}
+
+void LocApiV02 :: reportSynthesizedNmea(
+  const qmiLocEventPositionReportIndMsgT_v02 *location_report_ptr)
+{
+    uint64_t startCpuNs = getThreadCpuTimeNs();
+    const LocNmeaSentence* sentences = NULL;
+    uint32_t count = mNmeaGenerator->generate(*location_report_ptr, sentences);
+
+    // the modem NMEA is the one passed on while comparing
+    if (NULL != mNmeaComparator) {
+        mNmeaComparator->addGenerated(sentences, count);
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            dispatchNmeaSentence(sentences[i]);
         }
     }
+    flushNmea(startCpuNs, mApNmeaCpuStats, "AP");
+}
 
-    if ((NULL != p_nmea) && (q_nmea_len > 0)) {
-        LocApiBase::reportNmea(p_nmea, q_nmea_len);
+void LocApiV02 :: dispatchNmeaSentence(const LocNmeaSentence& sentence)
+{
+    if (mNmeaReportTypes & LOC_NMEA_TYPE_MASK(sentence.type)) {
+        // loc eng consumers treat the sentence as a C string. It is a
+        // slice of the QMI indication buffer or of the generator's, both
+        // writable with room for a NUL after the last sentence, so it is
+        // terminated in place for the call rather than copied
+        char* end = const_cast<char*>(sentence.start) + sentence.length;
+        char saved = *end;
+        *end = '\0';
+        LocApiBase::reportNmea(sentence.start, sentence.length);
+        *end = saved;
+    }
+    // readers on the fan-out socket filter by the type in the ring
+    if (NULL != mNmeaFanout) {
+        mNmeaFanout->append(sentence.start, sentence.length, sentence.type);
+    }
+}
+
+/* ends the batch, and keeps track of what NMEA costs so modem and AP
+   generated NMEA can be compared on a device */
+void LocApiV02 :: flushNmea(uint64_t startCpuNs, NmeaCpuStats& stats, const char* source)
+{
+    if (NULL != mNmeaFanout) {
+        mNmeaFanout->commit();
+    }
+
+    stats.cpuNs += getThreadCpuTimeNs() - startCpuNs;
+    if (++stats.count >= NMEA_CPU_STATS_INTERVAL) {
+        LOC_LOGD("%s:%d]: %s NMEA: %" PRIu64 " ns CPU per report over %u reports",
+                 __func__, __LINE__, source, stats.cpuNs / stats.count, stats.count);
+        stats = NmeaCpuStats();
     }
 }
 
@@ -3218,17 +3825,21 @@ void LocApiV02 :: reportAtlRequest(
     {
     case eQMI_LOC_WWAN_TYPE_INTERNET_V02:
       agpsType = LOC_AGPS_TYPE_WWAN_ANY;
+      traceAtlRequest(connHandle, agpsType);
       requestATL(connHandle, agpsType);
       break;
     case eQMI_LOC_WWAN_TYPE_AGNSS_V02:
       agpsType = LOC_AGPS_TYPE_SUPL;
+      traceAtlRequest(connHandle, agpsType);
       requestATL(connHandle, agpsType);
       break;
     case eQMI_LOC_WWAN_TYPE_AGNSS_EMERGENCY_V02:
+      traceAtlRequest(connHandle, LOC_AGPS_TYPE_SUPL_ES);
       requestSuplES(connHandle);
       break;
     default:
       agpsType = LOC_AGPS_TYPE_WWAN_ANY;
+      traceAtlRequest(connHandle, agpsType);
       requestATL(connHandle, agpsType);
       break;
     }
@@ -4019,6 +4630,11 @@ void LocApiV02 :: eventCb(locClientHandleType /*clientHandle*/,
       requestXtraData();
       break;
 
+    // time sync request
+    case QMI_LOC_EVENT_TIME_SYNC_REQ_IND_V02:
+      reportTimeSyncRequest(eventPayload.pTimeSyncReqEvent);
+      break;
+
     // time request
     case QMI_LOC_EVENT_INJECT_TIME_REQ_IND_V02:
       LOC_LOGD("%s:%d]: Time request\n", __func__,
@@ -4074,6 +4690,13 @@ void LocApiV02 :: errorCb(locClientHandleType /*handle*/,
 
     handleEngineDownEvent();
 
+    /* the engine restarted without our sessions, the adapter restarts
+       its own on the engine up event */
+    mSessionMux.clear();
+    /* polynomials from before the restart may have been superseded
+       without the engine telling us */
+    mSvPolyCache.clear();
+
     /* immediately send the engine up event so that
     the loc engine re-initializes the adapter and the
     loc-api_v02 interface */
@@ -4111,8 +4734,54 @@ static const ds_client_cb_data ds_client_cb = {
 };
 
 int LocApiV02 :: initDataServiceClient(bool isDueToSsr)
+{
+    /* Most boots never make an emergency data call, so the library and
+       its WDS client are only set up on first use. Once loaded, an
+       init (e.g. after SSR) goes straight to the library. */
+    mDsClientRequested = true;
+    if (NULL == dsClientIface)
+    {
+      LOC_LOGD("%s:%d]: Deferring ds client load until first use",
+               __func__, __LINE__);
+      return 0;
+    }
+    return startDataServiceClient(isDueToSsr);
+}
+
+int LocApiV02 :: startDataServiceClient(bool isDueToSsr)
 {
     int ret=0;
+    if (NULL != dsClientIface->pfn_init)
+    {
+      ds_client_status_enum_type dsret = dsClientIface->pfn_init(isDueToSsr);
+      if (dsret != E_DS_CLIENT_SUCCESS)
+      {
+        LOC_LOGE("%s:%d]: Error during client initialization %d",
+                 __func__, __LINE__,
+                 (int)dsret);
+
+        ret = 3;
+      }
+    }
+    else
+    {
+      LOC_LOGE("%s:%d]: dsClientIface->pfn_init == NULL",
+               __func__, __LINE__);
+      ret = 2;
+    }
+    mDsClientInitialized = (0 == ret);
+    LOC_LOGD("%s:%d]: ret = %d\n", __func__, __LINE__,ret);
+    return ret;
+}
+
+int LocApiV02 :: loadDataServiceClient()
+{
+    int ret=0;
+    if (mDsClientInitialized)
+    {
+      return ret;
+    }
+
     if (NULL == dsLibraryHandle)
     {
       dsLibraryHandle = dlopen(DS_CLIENT_LIB_NAME, RTLD_NOW);
@@ -4153,34 +4822,30 @@ int LocApiV02 :: initDataServiceClient(bool isDueToSsr)
         }
       }
     }
-    if (NULL != dsClientIface && NULL != dsClientIface->pfn_init)
+    if (NULL == dsClientIface)
     {
-      ds_client_status_enum_type dsret = dsClientIface->pfn_init(isDueToSsr);
-      if (dsret != E_DS_CLIENT_SUCCESS)
-      {
-        LOC_LOGE("%s:%d]: Error during client initialization %d",
-                 __func__, __LINE__,
-                 (int)dsret);
-
-        ret = 3;
-      }
+      LOC_LOGE("%s:%d]: dsClientIface == NULL",
+               __func__, __LINE__);
+      return (0 != ret) ? ret : 2;
     }
-    else
-    {
-      if (NULL == dsClientIface)
-      {
-          LOC_LOGE("%s:%d]: dsClientIface == NULL",
-                   __func__, __LINE__);
-      }
-      else
-      {
-          LOC_LOGE("%s:%d]: dsClientIface->pfn_init == NULL",
-                   __func__, __LINE__);
-      }
-      ret = 2;
-    }
-    LOC_LOGD("%s:%d]: ret = %d\n", __func__, __LINE__,ret);
-    return ret;
+    return startDataServiceClient(false);
+}
+
+void LocApiV02 :: prewarmDataServiceClient()
+{
+    struct MsgPrewarmDataServiceClient : public LocMsg {
+        LocApiV02* mpLocApiV02;
+        inline MsgPrewarmDataServiceClient(LocApiV02* pLocApiV02) :
+                LocMsg(), mpLocApiV02(pLocApiV02) {}
+        inline virtual void proc() const {
+            if (mpLocApiV02->mDsClientRequested) {
+                mpLocApiV02->loadDataServiceClient();
+            } else {
+                LOC_LOGD("%s:%d]: ds client was not initialized", __func__, __LINE__);
+            }
+        }
+    };
+    sendMsg(new MsgPrewarmDataServiceClient(this));
 }
 
 int LocApiV02 :: openAndStartDataCall()
@@ -4190,6 +4855,46 @@ int LocApiV02 :: openAndStartDataCall()
     int pdp_type = -1;
     ds_client_status_enum_type result = E_DS_CLIENT_FAILURE_NOT_INITIALIZED;
 
+    if (!mDsClientRequested)
+    {
+      LOC_LOGE("%s:%d]: ds client was not initialized", __func__, __LINE__);
+      return (int)LOC_API_ADAPTER_ERR_UNSUPPORTED;
+    }
+    if (0 != loadDataServiceClient())
+    {
+        LOC_LOGE("%s:%d]: ds client not available", __func__, __LINE__);
+        return (int)LOC_API_ADAPTER_ERR_UNSUPPORTED;
+    }
+
+    if (NULL != dsClientIface &&
+        NULL != dsClientIface->pfn_open_and_start_call_async)
+    {
+      /* Profile lookup and call start run off this thread, the outcome
+         comes back through ds_client_event_cb */
+      result = dsClientIface->pfn_open_and_start_call_async(&dsClientHandle,
+                                                            &ds_client_cb,
+                                                            (void *)this);
+      if (E_DS_CLIENT_SUCCESS == result)
+      {
+        LOC_LOGD("%s:%d]: Request to start Emergency call queued\n",
+                 __func__, __LINE__);
+        ret = LOC_API_ADAPTER_ERR_SUCCESS;
+      }
+      else if (E_DS_CLIENT_RETRY_LATER == result)
+      {
+        LOC_LOGE("%s:%d]: Could not start emergency call. Retry after delay\n",
+                 __func__, __LINE__);
+        ret = LOC_API_ADAPTER_ERR_ENGINE_BUSY;
+      }
+      else
+      {
+        LOC_LOGE("%s:%d]: Unable to bring up emergency call using DS. result = %d",
+                 __func__, __LINE__, (int)result);
+        ret = LOC_API_ADAPTER_ERR_UNSUPPORTED;
+      }
+      return (int)ret;
+    }
+
     if (NULL != dsClientIface &&
         NULL != dsClientIface->pfn_open_call &&
         NULL != dsClientIface->pfn_start_call)
@@ -4281,6 +4986,8 @@ void LocApiV02 :: releaseDataServiceClient()
         NULL != dsClientIface->pfn_release)
     {
       dsClientIface->pfn_release();
+      mDsClientInitialized = false;
+      mDsClientRequested = false;
       ret = 0;
     }
 
@@ -4762,6 +5469,270 @@ void LocApiV02 :: cacheGnssMeasurementSupport()
     LOC_LOGV("%s:%d]: mGnssMeasurementSupported is %d\n", __func__, __LINE__, mGnssMeasurementSupported);
 }
 
+/* start an outdoor trip batching session; the engine batches fixes on
+   its own and only wakes the AP once tripDistance has been covered */
+enum loc_api_adapter_err LocApiV02 ::
+startOutdoorTripBatching(uint32_t tripDistance, uint32_t tripTbf, uint32_t timeout)
+{
+    locClientStatusEnumType status;
+    locClientReqUnionType req_union;
+    qmiLocStartOutdoorTripBatchingReqMsgT_v02 startOtbReq;
+    qmiLocStartOutdoorTripBatchingIndMsgT_v02 startOtbInd;
+
+    if (!mOutdoorTripBatchingSupported) {
+        LOC_LOGE("%s:%d]: OTB is not supported by the modem", __func__, __LINE__);
+        return LOC_API_ADAPTER_ERR_UNSUPPORTED;
+    }
+
+    memset(&startOtbReq, 0, sizeof(startOtbReq));
+    memset(&startOtbInd, 0, sizeof(startOtbInd));
+
+    startOtbReq.batchDistance = tripDistance;
+    startOtbReq.minTimeInterval = tripTbf;
+    if (timeout > 0) {
+        startOtbReq.fixSessionTimeout_valid = 1;
+        startOtbReq.fixSessionTimeout = timeout;
+    }
+    // only batch positions that satisfy the trip criteria
+    startOtbReq.batchAllPos_valid = 1;
+    startOtbReq.batchAllPos = false;
+
+    LOC_LOGD("%s:%d]: distance: %u m, tbf: %u ms, timeout: %u ms",
+             __func__, __LINE__, tripDistance, tripTbf, timeout);
+
+    req_union.pStartOutdoorTripBatchingReq = &startOtbReq;
+    status = locSyncSendReq(QMI_LOC_START_OUTDOOR_TRIP_BATCHING_REQ_V02,
+                            req_union, LOC_ENGINE_SYNC_REQUEST_TIMEOUT,
+                            QMI_LOC_START_OUTDOOR_TRIP_BATCHING_IND_V02,
+                            &startOtbInd);
+    if (status != eLOC_CLIENT_SUCCESS || startOtbInd.status != eQMI_LOC_SUCCESS_V02) {
+        LOC_LOGE("%s:%d]: Start OTB failed. status: %s, ind status:%s\n",
+                 __func__, __LINE__,
+                 loc_get_v02_client_status_name(status),
+                 loc_get_v02_qmi_status_name(startOtbInd.status));
+        return (status != eLOC_CLIENT_SUCCESS) ?
+               convertErr(status) : LOC_API_ADAPTER_ERR_GENERAL_FAILURE;
+    }
+
+    mInOutdoorTripBatching = true;
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+}
+
+/* stop the outdoor trip batching session */
+enum loc_api_adapter_err LocApiV02 :: stopOutdoorTripBatching()
+{
+    locClientStatusEnumType status;
+    locClientReqUnionType req_union;
+    qmiLocStopBatchingReqMsgT_v02 stopBatchingReq;
+    qmiLocStopBatchingIndMsgT_v02 stopBatchingInd;
+
+    if (!mInOutdoorTripBatching) {
+        LOC_LOGD("%s:%d]: no OTB session in progress", __func__, __LINE__);
+        return LOC_API_ADAPTER_ERR_SUCCESS;
+    }
+
+    memset(&stopBatchingReq, 0, sizeof(stopBatchingReq));
+    memset(&stopBatchingInd, 0, sizeof(stopBatchingInd));
+
+    stopBatchingReq.transactionId = LOC_API_V02_DEF_SESSION_ID;
+    stopBatchingReq.batchType_valid = 1;
+    stopBatchingReq.batchType = eQMI_LOC_OUTDOOR_TRIP_BATCHING_V02;
+
+    req_union.pStopBatchingReq = &stopBatchingReq;
+    status = locSyncSendReq(QMI_LOC_STOP_BATCHING_REQ_V02,
+                            req_union, LOC_ENGINE_SYNC_REQUEST_TIMEOUT,
+                            QMI_LOC_STOP_BATCHING_IND_V02,
+                            &stopBatchingInd);
+    if (status != eLOC_CLIENT_SUCCESS || stopBatchingInd.status != eQMI_LOC_SUCCESS_V02) {
+        LOC_LOGE("%s:%d]: Stop OTB failed. status: %s, ind status:%s\n",
+                 __func__, __LINE__,
+                 loc_get_v02_client_status_name(status),
+                 loc_get_v02_qmi_status_name(stopBatchingInd.status));
+        return (status != eLOC_CLIENT_SUCCESS) ?
+               convertErr(status) : LOC_API_ADAPTER_ERR_GENERAL_FAILURE;
+    }
+
+    mInOutdoorTripBatching = false;
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+}
+
+/* query the distance covered since the OTB session was started. This is
+   answered by the engine from its running total, so no batched fixes have
+   to be read out (and the batch is left untouched) */
+enum loc_api_adapter_err LocApiV02 ::
+queryAccumulatedTripDistance(uint32_t &accumulatedTripDistance,
+                             uint32_t &numOfBatchedPositions)
+{
+    locClientStatusEnumType status;
+    locClientReqUnionType req_union;
+    qmiLocQueryOTBAccumulatedDistanceIndMsgT_v02 queryOtbInd;
+
+    accumulatedTripDistance = 0;
+    numOfBatchedPositions = 0;
+
+    if (!mInOutdoorTripBatching) {
+        LOC_LOGE("%s:%d]: no OTB session in progress", __func__, __LINE__);
+        return LOC_API_ADAPTER_ERR_INVALID_PARAMETER;
+    }
+
+    memset(&queryOtbInd, 0, sizeof(queryOtbInd));
+
+    //Passing req_union as a parameter even though this request has no payload
+    //since NULL or 0 gives an error during compilation
+    req_union.pQueryOTBAccumulatedDistanceReq = NULL;
+    status = locSyncSendReq(QMI_LOC_QUERY_OTB_ACCUMULATED_DISTANCE_REQ_V02,
+                            req_union, LOC_ENGINE_SYNC_REQUEST_TIMEOUT,
+                            QMI_LOC_QUERY_OTB_ACCUMULATED_DISTANCE_IND_V02,
+                            &queryOtbInd);
+    if (status != eLOC_CLIENT_SUCCESS || queryOtbInd.status != eQMI_LOC_SUCCESS_V02) {
+        LOC_LOGE("%s:%d]: Query OTB distance failed. status: %s, ind status:%s\n",
+                 __func__, __LINE__,
+                 loc_get_v02_client_status_name(status),
+                 loc_get_v02_qmi_status_name(queryOtbInd.status));
+        return (status != eLOC_CLIENT_SUCCESS) ?
+               convertErr(status) : LOC_API_ADAPTER_ERR_GENERAL_FAILURE;
+    }
+
+    accumulatedTripDistance = queryOtbInd.accumulatedDistance;
+    numOfBatchedPositions = queryOtbInd.batchedPosition;
+    LOC_LOGV("%s:%d]: accumulated distance: %u m, batched positions: %u",
+             __func__, __LINE__, accumulatedTripDistance, numOfBatchedPositions);
+
+    return LOC_API_ADAPTER_ERR_SUCCESS;
+}
+
+/* start streaming samples from source to the engine. Samples are
+   staged per sensor type and sent once a type fills a request or its
+   oldest sample has waited latencyBudgetMs */
+bool LocApiV02 :: startSensorInjection(LocSensorSource* source, uint32_t latencyBudgetMs)
+{
+    if (NULL != mSensorInjector) {
+        LOC_LOGE("%s:%d]: sensor injection already running", __func__, __LINE__);
+        delete source;
+        return false;
+    }
+
+    LocSensorDataSender sender = [this] (const qmiLocInjectSensorDataReqMsgT_v02& req) {
+        locClientReqUnionType req_union;
+        req_union.pInjectSensorDataReq = &req;
+        // fire and forget, the indication only echoes the opaque id
+        locClientStatusEnumType status =
+            locClientSendReq(QMI_LOC_INJECT_SENSOR_DATA_REQ_V02, req_union);
+        if (eLOC_CLIENT_SUCCESS != status) {
+            LOC_LOGE("%s:%d]: inject sensor data failed. status: %s",
+                     __func__, __LINE__, loc_get_v02_client_status_name(status));
+        }
+        return eLOC_CLIENT_SUCCESS == status;
+    };
+
+    LocSensorInjector* injector = new LocSensorInjector(source, sender, latencyBudgetMs);
+    if (!injector->start()) {
+        delete injector;
+        return false;
+    }
+    // published only once running, the QMI thread checks it in adjustMaskIfNoSession
+    mSensorInjector = injector;
+    registerEventMask(mMask);
+    return true;
+}
+
+void LocApiV02 :: stopSensorInjection()
+{
+    // unpublish before stopping so that no other thread sees a dying injector
+    LocSensorInjector* injector = mSensorInjector.exchange(NULL);
+    if (NULL != injector) {
+        injector->stop();
+        LOC_LOGD("%s:%d]: sent %" PRIu64 " samples in %" PRIu64 " messages, "
+                 "dropped %" PRIu64, __func__, __LINE__,
+                 injector->getSamplesSent(), injector->getMessagesSent(),
+                 injector->getSamplesDropped());
+        delete injector;
+        if (LOC_CLIENT_INVALID_HANDLE_VALUE != clientHandle) {
+            registerEventMask(mMask);
+        }
+    }
+}
+
+/* start streaming vehicle samples from source to the engine. The
+   vehicle time base is mapped onto boot time, samples are sent once a
+   type fills a request or its oldest sample has waited latencyBudgetMs */
+bool LocApiV02 :: startVehicleSensorInjection(LocVehicleSensorSource* source,
+                                              uint32_t latencyBudgetMs)
+{
+    if (NULL != mVehicleSensorInjector) {
+        LOC_LOGE("%s:%d]: vehicle sensor injection already running", __func__, __LINE__);
+        delete source;
+        return false;
+    }
+
+    LocVehicleSensorDataSender sender =
+        [this] (const qmiLocInjectVehicleSensorDataReqMsgT_v02& req) {
+        locClientReqUnionType req_union;
+        req_union.pInjectVehicleSensorDataReq = &req;
+        locClientStatusEnumType status =
+            locClientSendReq(QMI_LOC_INJECT_VEHICLE_SENSOR_DATA_REQ_V02, req_union);
+        if (eLOC_CLIENT_SUCCESS != status) {
+            LOC_LOGE("%s:%d]: inject vehicle sensor data failed. status: %s",
+                     __func__, __LINE__, loc_get_v02_client_status_name(status));
+        }
+        return eLOC_CLIENT_SUCCESS == status;
+    };
+
+    LocVehicleSensorInjector* injector =
+            new LocVehicleSensorInjector(source, sender, latencyBudgetMs);
+    if (!injector->start()) {
+        delete injector;
+        return false;
+    }
+    mVehicleSensorInjector = injector;
+    registerEventMask(mMask);
+    return true;
+}
+
+void LocApiV02 :: stopVehicleSensorInjection()
+{
+    LocVehicleSensorInjector* injector = mVehicleSensorInjector.exchange(NULL);
+    if (NULL != injector) {
+        injector->stop();
+        LOC_LOGD("%s:%d]: sent %" PRIu64 " samples in %" PRIu64 " messages, "
+                 "dropped %" PRIu64, __func__, __LINE__,
+                 injector->getSamplesSent(), injector->getMessagesSent(),
+                 injector->getSamplesDropped());
+        delete injector;
+        if (LOC_CLIENT_INVALID_HANDLE_VALUE != clientHandle) {
+            registerEventMask(mMask);
+        }
+    }
+}
+
+uint32_t LocApiV02 :: evaluateSvPolynomials(uint16_t gpsWeek, double gpsTowSec,
+                                            int32_t leapSeconds, LocSvPolyState* states,
+                                            uint32_t maxStates)
+{
+    if (NULL == states || 0 == maxStates) {
+        return 0;
+    }
+    return mSvPolyCache.evaluate(gpsWeek, gpsTowSec, leapSeconds, getBootTimeMs(),
+                                 states, maxStates);
+}
+
+uint32_t evaluateSvPolynomials(LocApiV02* locApi, uint16_t gpsWeek, double gpsTowSec,
+                               int32_t leapSeconds, LocSvPolyState* states,
+                               uint32_t maxStates)
+{
+    if (NULL == locApi) {
+        return 0;
+    }
+    return locApi->evaluateSvPolynomials(gpsWeek, gpsTowSec, leapSeconds, states, maxStates);
+}
+
+void prewarmDataServiceClient(LocApiV02* locApi)
+{
+    if (NULL != locApi) {
+        locApi->prewarmDataServiceClient();
+    }
+}
+
 locClientStatusEnumType LocApiV02::locSyncSendReq(uint32_t req_id,
         locClientReqUnionType req_payload, uint32_t timeout_msec,
         uint32_t ind_id, void* ind_payload_ptr) {
@@ -34,8 +34,17 @@
 #include <ds_client.h>
 #include <LocApiBase.h>
 #include <loc_api_v02_client.h>
+#include <LocSessionMux.h>
+#include <LocSensorInjector.h>
+#include <LocVehicleSensorInjector.h>
+#include <LocPpsTime.h>
+#include <LocNmeaFanout.h>
+#include <LocNmeaGenerator.h>
+#include <LocSvReportFilter.h>
+#include <LocSvPolyCache.h>
 #include <vector>
 #include <functional>
+#include <atomic>
 
 #define LOC_SEND_SYNC_REQ(NAME, ID, REQ)  \
     int rv = true; \
@@ -84,11 +93,71 @@ private:
   const ds_client_iface_type *dsClientIface;
   /* ds client handle */
   dsClientHandleType dsClientHandle;
+  /* ds client library is loaded lazily, on the first data call.
+     Requested is set by initDataServiceClient(), initialized once
+     pfn_init succeeded */
+  bool mDsClientRequested;
+  bool mDsClientInitialized;
   enum supported_status mGnssMeasurementSupported;
   locClientEventMaskType mQmiMask;
   bool mInSession;
   bool mEngineOn;
   bool mMeasurementsStarted;
+  bool mOutdoorTripBatchingSupported;
+  bool mInOutdoorTripBatching;
+  bool mUpdateTbfOnTheFlySupported;
+  /* logical tracking sessions served by the engine session */
+  LocSessionMux mSessionMux;
+  /* QMI_LOC_START_REQ sent and not stopped yet */
+  bool mEngineSessionStarted;
+  /* streams AP sensor samples to the engine, NULL when not running.
+     Atomic as the QMI thread tests them while close() tears them down */
+  std::atomic<LocSensorInjector*> mSensorInjector;
+  /* streams vehicle (CAN) samples to the engine, NULL when not running */
+  std::atomic<LocVehicleSensorInjector*> mVehicleSensorInjector;
+  /* PPS fit used to timestamp reports and refine injected time, open if
+     PPS_TIMESTAMPING_DEVICE is set */
+  LocPpsTime mPpsTime;
+  /* shared memory NMEA fan-out, NULL unless NMEA_FANOUT_SOCKET is set */
+  LocNmeaFanoutServer* mNmeaFanout;
+  /* NMEA sentence types passed on to the engine, from NMEA_REPORT_TYPES */
+  LocNmeaTypeMask mNmeaReportTypes;
+  /* formats NMEA from position and SV reports in place of the modem,
+     NULL unless NMEA_AP_SYNTHESIS is set */
+  LocNmeaGenerator* mNmeaGenerator;
+  /* checks generated against modem NMEA, NULL unless NMEA_AP_SYNTHESIS
+     is 2 */
+  LocNmeaComparator* mNmeaComparator;
+  /* QMI NMEA types left to the modem while generating */
+  uint32_t mModemNmeaTypes;
+  /* CPU spent handling NMEA, per modem report or per generated epoch */
+  struct NmeaCpuStats {
+      uint32_t count;
+      uint64_t cpuNs;
+      NmeaCpuStats() : count(0), cpuNs(0) {}
+  };
+  NmeaCpuStats mModemNmeaCpuStats;
+  NmeaCpuStats mApNmeaCpuStats;
+  /* drops SV reports that hardly differ from the last one passed */
+  LocSvReportFilter mSvReportFilter;
+  /* SV polynomials from the engine, for evaluateSvPolynomials() */
+  LocSvPolyCache mSvPolyCache;
+  /* fix criteria of the running session */
+  LocPosMode mFixCriteria;
+  /* time of the last in-session criteria change shifted left by one,
+     with bit 0 set if it was applied on the fly; 0 once the next fix
+     arrived. Packed so both are published together, written on the
+     msg task, consumed in the QMI callback */
+  std::atomic<int64_t> mCriteriaUpdate;
+  /* gap between a criteria change and the next fix */
+  struct FixGapStats {
+      uint32_t count;
+      int64_t totalGapMs;
+      int64_t maxGapMs;
+      FixGapStats() : count(0), totalGapMs(0), maxGapMs(0) {}
+  };
+  FixGapStats mOnTheFlyGapStats;
+  FixGapStats mRestartGapStats;
   std::vector<Resender> mResenders;
 
   /* Convert event mask from loc eng to loc_api_v02 format */
@@ -152,6 +221,16 @@ private:
      report to loc eng */
   void reportNmea (const qmiLocEventNmeaIndMsgT_v02 *nmea_report_ptr);
 
+  /* generate NMEA for an epoch from the position report */
+  void reportSynthesizedNmea(
+    const qmiLocEventPositionReportIndMsgT_v02 *location_report_ptr);
+
+  /* pass one sentence on to loc eng and the fan-out; flushNmea() ends
+     the batch. The byte after the sentence must be writable, it is
+     briefly overwritten with a NUL */
+  void dispatchNmeaSentence(const LocNmeaSentence& sentence);
+  void flushNmea(uint64_t startCpuNs, NmeaCpuStats& stats, const char* source);
+
   /* convert and report an ATL request to loc engine */
   void reportAtlRequest(
     const qmiLocEventLocationServerConnectionReqIndMsgT_v02
@@ -173,6 +252,30 @@ private:
   void reportOdcpiRequest(
     const qmiLocEventWifiReqIndMsgT_v02& odcpiReq);
 
+  /* answer a time sync request from the engine */
+  void reportTimeSyncRequest(const qmiLocEventTimeSyncReqIndMsgT_v02* timeSyncReq);
+  /* msg task: answer a time sync request received at rxTime */
+  void injectTimeSyncData(uint32_t refCounter, uint32_t rxTime);
+
+  /* replace an arrival timestamp with the PPS derived time of the
+     measurement, given the GNSS time phase the report carries */
+  bool ppsTimeStamp(double gnssMsOfSecond, float gnssTimeUncMs,
+                    struct timespec& apTimeStamp, float& apTimeStampUncertaintyMs);
+
+  /* convert fix criteria from loc eng to a QMI_LOC start request */
+  static void convertStartReq(const LocPosMode& fixCriteria,
+                              qmiLocStartReqMsgT_v02& start_msg);
+  bool isTbfOrAccuracyOnlyChange(const LocPosMode& newCriteria) const;
+  enum loc_api_adapter_err updateFixCriteria(const LocPosMode& fixCriteria);
+  enum loc_api_adapter_err sendStartFix(const LocPosMode& fixCriteria);
+  enum loc_api_adapter_err sendStopFix();
+  enum loc_api_adapter_err applySessionCriteria();
+  void postApplySessionCriteria();
+  /* dlopen the ds client library if needed and initialize it */
+  int loadDataServiceClient();
+  /* pfn_init of the loaded ds client library */
+  int startDataServiceClient(bool isDueToSsr);
+
   void registerEventMask(LOC_API_ADAPTER_EVENT_MASK_T adapterMask);
   locClientEventMaskType adjustMaskIfNoSession(locClientEventMaskType qmiMask);
   void cacheGnssMeasurementSupport();
@@ -204,6 +307,11 @@ public:
 
   void ds_client_event_cb(ds_client_status_enum_type result);
 
+  /* load and initialize the ds client library on the msg task ahead of
+     the first emergency data call, e.g. when entering emergency mode.
+     Does nothing unless initDataServiceClient() was called */
+  void prewarmDataServiceClient();
+
   virtual enum loc_api_adapter_err startFix(const LocPosMode& posMode);
 
   virtual enum loc_api_adapter_err stopFix();
@@ -211,6 +319,14 @@ public:
   virtual enum loc_api_adapter_err
     setPositionMode(const LocPosMode& mode);
 
+  /* Logical tracking sessions multiplexed onto the engine session.
+     Each session gets the fixes decimated to its own interval.
+     Returns the session id. */
+  uint32_t startTrackingSession(const LocPosMode& criteria,
+                                const LocSessionFixCb& fixCb);
+  bool updateTrackingSession(uint32_t sessionId, const LocPosMode& criteria);
+  bool stopTrackingSession(uint32_t sessionId);
+
   virtual enum loc_api_adapter_err
     setTime(LocGpsUtcTime time, int64_t timeReference, int uncertainty);
 
@@ -287,6 +403,26 @@ public:
   virtual int getGpsLock(void);
   virtual int setSvMeasurementConstellation(const qmiLocGNSSConstellEnumT_v02 svConstellation);
   virtual LocationError setXtraVersionCheck(uint32_t check);
+  /* Outdoor trip batching */
+  virtual enum loc_api_adapter_err
+      startOutdoorTripBatching(uint32_t tripDistance, uint32_t tripTbf, uint32_t timeout);
+  virtual enum loc_api_adapter_err stopOutdoorTripBatching();
+  virtual enum loc_api_adapter_err
+      queryAccumulatedTripDistance(uint32_t &accumulatedTripDistance,
+                                   uint32_t &numOfBatchedPositions);
+  /* Sensor data injection, source is owned by LocApiV02 from here on */
+  virtual bool startSensorInjection(LocSensorSource* source, uint32_t latencyBudgetMs);
+  virtual void stopSensorInjection();
+  /* Vehicle sensor and odometry injection, source is owned by LocApiV02
+     from here on */
+  virtual bool startVehicleSensorInjection(LocVehicleSensorSource* source,
+                                           uint32_t latencyBudgetMs);
+  virtual void stopVehicleSensorInjection();
+  /* Position, velocity and clock correction of every SV with a cached
+     polynomial at the given GPS time. leapSeconds (GPS - UTC) is needed
+     for GLONASS. Returns the number of states filled. */
+  uint32_t evaluateSvPolynomials(uint16_t gpsWeek, double gpsTowSec, int32_t leapSeconds,
+                                 LocSvPolyState* states, uint32_t maxStates);
   virtual void installAGpsCert(const LocDerEncodedCertificate* pData,
                                size_t length,
                                uint32_t slotBitMask);
@@ -314,4 +450,14 @@ public:
 extern "C" LocApiBase* getLocApi(const MsgTask* msgTask,
                                  LOC_API_ADAPTER_EVENT_MASK_T exMask,
                                  ContextBase *context);
+/* LocApiV02::evaluateSvPolynomials() for callers that look it up by
+   name, like the RTK/PPP layer. The caller converts the LocApiBase it
+   holds itself, this library can't check the type of one without RTTI.
+   Returns 0 if locApi is NULL */
+extern "C" uint32_t evaluateSvPolynomials(LocApiV02* locApi, uint16_t gpsWeek,
+                                          double gpsTowSec, int32_t leapSeconds,
+                                          LocSvPolyState* states, uint32_t maxStates);
+/* LocApiV02::prewarmDataServiceClient() for callers that look it up by
+   name, same as evaluateSvPolynomials() */
+extern "C" void prewarmDataServiceClient(LocApiV02* locApi);
 #endif //LOC_API_V_0_2_H
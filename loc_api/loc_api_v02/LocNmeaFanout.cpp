@@ -0,0 +1,585 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_NmeaFanout"
+
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <LocNmeaFanout.h>
+#include <loc_pla.h>
+#include <log_util.h>
+
+#define LOC_NMEA_FANOUT_MAX_CLIENTS (16)
+
+static inline uint32_t alignRecord(uint32_t length)
+{
+    return (LOC_NMEA_RING_RECORD_HEADER + length + 7) & ~7u;
+}
+
+static int createMemFd(const char* name)
+{
+#ifdef __NR_memfd_create
+    return syscall(__NR_memfd_create, name, 1 /* MFD_CLOEXEC */);
+#else
+    (void)name;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*--------------------------------------------------------------------
+ * LocNmeaFanoutServer
+ *-------------------------------------------------------------------*/
+LocNmeaFanoutServer::LocNmeaFanoutServer(const char* socketPath, uint32_t ringSize) :
+    mDataSize(4096), mMapSize(0), mRingFd(-1), mReaderFd(-1), mMap(NULL),
+    mHeader(NULL), mData(NULL), mWritePos(0), mBatchTypes(0), mListenFd(-1), mStopFd(-1),
+    mBatchesPublished(0), mNotificationsDropped(0)
+{
+    strlcpy(mSocketPath, socketPath, sizeof(mSocketPath));
+    while (mDataSize < ringSize) {
+        mDataSize <<= 1;
+    }
+}
+
+LocNmeaFanoutServer::~LocNmeaFanoutServer()
+{
+    stop();
+}
+
+bool LocNmeaFanoutServer::createRing()
+{
+    char path[32];
+
+    mRingFd = createMemFd("loc_nmea_ring");
+    if (mRingFd < 0) {
+        LOC_LOGE("%s:%d]: memfd_create failed, errno %d", __func__, __LINE__, errno);
+        return false;
+    }
+    mMapSize = sizeof(LocNmeaRingHeader) + mDataSize;
+    mMapSize = (mMapSize + 7) & ~7u;
+    if (ftruncate(mRingFd, mMapSize) != 0) {
+        LOC_LOGE("%s:%d]: ftruncate failed, errno %d", __func__, __LINE__, errno);
+        return false;
+    }
+    mMap = (uint8_t*)mmap(NULL, mMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, mRingFd, 0);
+    if (MAP_FAILED == mMap) {
+        mMap = NULL;
+        LOC_LOGE("%s:%d]: mmap failed, errno %d", __func__, __LINE__, errno);
+        return false;
+    }
+
+    // readers get a read only descriptor so they can't map the ring writable
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", mRingFd);
+    mReaderFd = open(path, O_RDONLY | O_CLOEXEC);
+    if (mReaderFd < 0) {
+        LOC_LOGE("%s:%d]: failed to reopen ring read only, errno %d",
+                 __func__, __LINE__, errno);
+        return false;
+    }
+
+    mHeader = new (mMap) LocNmeaRingHeader;
+    mHeader->magic = LOC_NMEA_RING_MAGIC;
+    mHeader->version = LOC_NMEA_RING_VERSION;
+    mHeader->dataSize = mDataSize;
+    mHeader->headerSize = (sizeof(LocNmeaRingHeader) + 7) & ~7u;
+    mHeader->writePos.store(0, std::memory_order_release);
+    mHeader->reservePos.store(0, std::memory_order_release);
+    mData = mMap + mHeader->headerSize;
+    mWritePos = 0;
+    return true;
+}
+
+bool LocNmeaFanoutServer::createSocket()
+{
+    struct sockaddr_un addr;
+
+    mListenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (mListenFd < 0) {
+        LOC_LOGE("%s:%d]: socket failed, errno %d", __func__, __LINE__, errno);
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy(addr.sun_path, mSocketPath, sizeof(addr.sun_path));
+    unlink(mSocketPath);
+    if (bind(mListenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(mListenFd, LOC_NMEA_FANOUT_MAX_CLIENTS) != 0) {
+        LOC_LOGE("%s:%d]: failed to listen on %s, errno %d",
+                 __func__, __LINE__, mSocketPath, errno);
+        return false;
+    }
+
+    mStopFd = eventfd(0, EFD_CLOEXEC);
+    if (mStopFd < 0) {
+        LOC_LOGE("%s:%d]: eventfd failed, errno %d", __func__, __LINE__, errno);
+        return false;
+    }
+    return true;
+}
+
+bool LocNmeaFanoutServer::start()
+{
+    if (NULL != mMap) {
+        return true;
+    }
+    if (!createRing() || !createSocket() || !mThread.start("LocNmeaFanout", new Acceptor(this))) {
+        cleanup();
+        return false;
+    }
+    LOC_LOGD("%s:%d]: serving NMEA on %s, ring %u bytes",
+             __func__, __LINE__, mSocketPath, mDataSize);
+    return true;
+}
+
+void LocNmeaFanoutServer::stop()
+{
+    if (mStopFd >= 0) {
+        uint64_t one = 1;
+        if (write(mStopFd, &one, sizeof(one)) != sizeof(one)) {
+            LOC_LOGE("%s:%d]: eventfd write failed, errno %d", __func__, __LINE__, errno);
+        }
+        mThread.stop();
+    }
+    cleanup();
+}
+
+void LocNmeaFanoutServer::cleanup()
+{
+    {
+        std::lock_guard<std::mutex> lock(mClientsMutex);
+        for (size_t i = 0; i < mClients.size(); i++) {
+            close(mClients[i].fd);
+        }
+        mClients.clear();
+    }
+    if (mListenFd >= 0) {
+        close(mListenFd);
+        mListenFd = -1;
+        unlink(mSocketPath);
+    }
+    if (mStopFd >= 0) {
+        close(mStopFd);
+        mStopFd = -1;
+    }
+    if (NULL != mMap) {
+        munmap(mMap, mMapSize);
+        mMap = NULL;
+        mHeader = NULL;
+        mData = NULL;
+    }
+    if (mReaderFd >= 0) {
+        close(mReaderFd);
+        mReaderFd = -1;
+    }
+    if (mRingFd >= 0) {
+        close(mRingFd);
+        mRingFd = -1;
+    }
+}
+
+void LocNmeaFanoutServer::acceptClient()
+{
+    int fd = accept4(mListenFd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mClientsMutex);
+    if (mClients.size() >= LOC_NMEA_FANOUT_MAX_CLIENTS) {
+        LOC_LOGE("%s:%d]: too many NMEA readers", __func__, __LINE__);
+        close(fd);
+        return;
+    }
+
+    LocNmeaFanoutHello hello;
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = LOC_NMEA_RING_MAGIC;
+    hello.version = LOC_NMEA_RING_VERSION;
+    hello.mapSize = mMapSize;
+    hello.startPos = mHeader->writePos.load(std::memory_order_acquire);
+
+    struct iovec iov = { &hello, sizeof(hello) };
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &mReaderFd, sizeof(int));
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(hello)) {
+        LOC_LOGE("%s:%d]: failed to send ring to reader, errno %d",
+                 __func__, __LINE__, errno);
+        close(fd);
+        return;
+    }
+    Client client = { fd, LOC_NMEA_TYPE_MASK_ALL };
+    mClients.push_back(client);
+    LOC_LOGD("%s:%d]: NMEA reader %d connected, %zu readers",
+             __func__, __LINE__, fd, mClients.size());
+}
+
+/* a reader only ever sends its type mask; anything else means it left */
+void LocNmeaFanoutServer::readClient(int fd)
+{
+    LocNmeaTypeMask types;
+    ssize_t ret = recv(fd, &types, sizeof(types), MSG_DONTWAIT);
+
+    if (ret < 0 && (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mClientsMutex);
+    for (std::vector<Client>::iterator it = mClients.begin(); it != mClients.end(); ++it) {
+        if (it->fd != fd) {
+            continue;
+        }
+        if ((ssize_t)sizeof(types) == ret) {
+            it->types = types;
+            LOC_LOGD("%s:%d]: NMEA reader %d wants types 0x%x",
+                     __func__, __LINE__, fd, types);
+        } else {
+            mClients.erase(it);
+            close(fd);
+            LOC_LOGD("%s:%d]: NMEA reader %d gone", __func__, __LINE__, fd);
+        }
+        break;
+    }
+}
+
+/* accepts readers, takes their type masks and notices the ones that
+   went away */
+bool LocNmeaFanoutServer::Acceptor::run()
+{
+    struct pollfd fds[2 + LOC_NMEA_FANOUT_MAX_CLIENTS];
+    nfds_t count = 0;
+
+    fds[count].fd = mServer->mStopFd;
+    fds[count++].events = POLLIN;
+    fds[count].fd = mServer->mListenFd;
+    fds[count++].events = POLLIN;
+    {
+        std::lock_guard<std::mutex> lock(mServer->mClientsMutex);
+        for (size_t i = 0; i < mServer->mClients.size(); i++) {
+            fds[count].fd = mServer->mClients[i].fd;
+            fds[count++].events = POLLIN;
+        }
+    }
+
+    if (poll(fds, count, -1) < 0) {
+        return (EINTR == errno);
+    }
+    if (fds[0].revents) {
+        return false;
+    }
+    if (fds[1].revents & POLLIN) {
+        mServer->acceptClient();
+    }
+    for (nfds_t i = 2; i < count; i++) {
+        if (fds[i].revents) {
+            mServer->readClient(fds[i].fd);
+        }
+    }
+    return true;
+}
+
+void LocNmeaFanoutServer::append(const char* sentence, uint32_t length, LocNmeaType type)
+{
+    if (NULL == mMap || 0 == length) {
+        return;
+    }
+    // a record may take at most half the ring so a reader can always get one
+    uint32_t recordSize = alignRecord(length);
+    if (recordSize > mDataSize / 2) {
+        length = mDataSize / 2 - LOC_NMEA_RING_RECORD_HEADER;
+        recordSize = alignRecord(length);
+    }
+
+    uint32_t offset = (uint32_t)(mWritePos & (mDataSize - 1));
+    uint32_t padding = (offset + recordSize > mDataSize) ? mDataSize - offset : 0;
+    // a batch larger than the ring would overwrite its own start before
+    // anyone saw it, publish what is there first
+    if (mWritePos + padding + recordSize -
+            mHeader->writePos.load(std::memory_order_relaxed) > mDataSize) {
+        commit();
+    }
+    // announce the bytes about to change before touching them
+    mHeader->reservePos.store(mWritePos + padding + recordSize, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (padding > 0) {
+        uint32_t wrap = LOC_NMEA_RING_WRAP;
+        memcpy(mData + offset, &wrap, sizeof(wrap));
+        mWritePos += padding;
+        offset = 0;
+    }
+    uint32_t recordType = type;
+    memcpy(mData + offset, &length, sizeof(length));
+    memcpy(mData + offset + sizeof(length), &recordType, sizeof(recordType));
+    memcpy(mData + offset + LOC_NMEA_RING_RECORD_HEADER, sentence, length);
+    mWritePos += recordSize;
+    mBatchTypes |= LOC_NMEA_TYPE_MASK(type);
+}
+
+void LocNmeaFanoutServer::commit()
+{
+    if (NULL == mMap || 0 == mBatchTypes) {
+        return;
+    }
+    mHeader->writePos.store(mWritePos, std::memory_order_release);
+    mBatchesPublished++;
+
+    std::lock_guard<std::mutex> lock(mClientsMutex);
+    for (size_t i = 0; i < mClients.size(); i++) {
+        if (0 == (mClients[i].types & mBatchTypes)) {
+            continue;
+        }
+        if (send(mClients[i].fd, &mWritePos, sizeof(mWritePos),
+                 MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+            // full socket: a slow reader, it catches up from the ring later
+            mNotificationsDropped++;
+        }
+    }
+    mBatchTypes = 0;
+}
+
+/*--------------------------------------------------------------------
+ * LocNmeaFanoutClient
+ *-------------------------------------------------------------------*/
+LocNmeaFanoutClient::LocNmeaFanoutClient() :
+    mSocket(-1), mMap(NULL), mMapSize(0), mHeader(NULL), mData(NULL),
+    mReadPos(0), mLost(0), mTypes(LOC_NMEA_TYPE_MASK_ALL)
+{
+}
+
+LocNmeaFanoutClient::~LocNmeaFanoutClient()
+{
+    disconnect();
+}
+
+bool LocNmeaFanoutClient::connect(const char* socketPath)
+{
+    struct sockaddr_un addr;
+    LocNmeaFanoutHello hello;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &hello, sizeof(hello) };
+    struct msghdr msg;
+    int ringFd = -1;
+
+    mSocket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (mSocket < 0) {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy(addr.sun_path, socketPath, sizeof(addr.sun_path));
+    if (::connect(mSocket, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        LOC_LOGE("%s:%d]: connect to %s failed, errno %d", __func__, __LINE__, socketPath, errno);
+        disconnect();
+        return false;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(mSocket, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(hello) ||
+        LOC_NMEA_RING_MAGIC != hello.magic || LOC_NMEA_RING_VERSION != hello.version) {
+        LOC_LOGE("%s:%d]: bad hello from %s", __func__, __LINE__, socketPath);
+        disconnect();
+        return false;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); NULL != cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type) {
+            memcpy(&ringFd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (ringFd < 0) {
+        disconnect();
+        return false;
+    }
+
+    mMap = (uint8_t*)mmap(NULL, hello.mapSize, PROT_READ, MAP_SHARED, ringFd, 0);
+    close(ringFd);
+    if (MAP_FAILED == mMap) {
+        mMap = NULL;
+        disconnect();
+        return false;
+    }
+    mMapSize = hello.mapSize;
+    mHeader = (const LocNmeaRingHeader*)mMap;
+    mData = mMap + mHeader->headerSize;
+    mReadPos = hello.startPos;
+    mLost = 0;
+    return (LOC_NMEA_TYPE_MASK_ALL == mTypes) || setTypeMask(mTypes);
+}
+
+void LocNmeaFanoutClient::disconnect()
+{
+    if (NULL != mMap) {
+        munmap(mMap, mMapSize);
+        mMap = NULL;
+        mHeader = NULL;
+        mData = NULL;
+    }
+    if (mSocket >= 0) {
+        close(mSocket);
+        mSocket = -1;
+    }
+}
+
+bool LocNmeaFanoutClient::setTypeMask(LocNmeaTypeMask types)
+{
+    mTypes = types;
+    if (mSocket < 0) {
+        return true;
+    }
+    return send(mSocket, &types, sizeof(types), MSG_NOSIGNAL) == (ssize_t)sizeof(types);
+}
+
+/* true if the writer has reserved, and may be writing, the bytes at
+   pos. Called after copying from pos */
+bool LocNmeaFanoutClient::isOverwritten(uint64_t pos) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return mHeader->reservePos.load(std::memory_order_relaxed) - pos > mHeader->dataSize;
+}
+
+/* the writer lapped this reader, continue at the last complete record */
+void LocNmeaFanoutClient::skipLapped()
+{
+    mLost++;
+    mReadPos = mHeader->writePos.load(std::memory_order_acquire);
+}
+
+/* copies out the record at the read position, then checks that the
+   writer did not reach into it meanwhile. Records of unwanted types
+   are skipped by their header alone. Returns the length, 0 if there
+   is nothing new */
+int LocNmeaFanoutClient::readRecord(char* buf, size_t bufLen, LocNmeaType* type)
+{
+    uint32_t dataSize = mHeader->dataSize;
+
+    while (true) {
+        uint64_t writePos = mHeader->writePos.load(std::memory_order_acquire);
+        if (writePos == mReadPos) {
+            return 0;
+        }
+        if (writePos - mReadPos > dataSize) {
+            skipLapped();
+            return 0;
+        }
+
+        uint32_t offset = (uint32_t)(mReadPos & (dataSize - 1));
+        uint32_t length;
+        uint32_t recordType;
+        memcpy(&length, mData + offset, sizeof(length));
+        memcpy(&recordType, mData + offset + sizeof(length), sizeof(recordType));
+        if (isOverwritten(mReadPos)) {
+            skipLapped();
+            return 0;
+        }
+        if (LOC_NMEA_RING_WRAP == length) {
+            mReadPos += dataSize - offset;
+            continue;
+        }
+        // records start 8 byte aligned, so the header always fits
+        if (length > dataSize - offset - LOC_NMEA_RING_RECORD_HEADER) {
+            LOC_LOGE("%s:%d]: bad record length %u at %" PRIu64,
+                     __func__, __LINE__, length, mReadPos);
+            skipLapped();
+            return 0;
+        }
+        if (recordType >= LOC_NMEA_TYPE_COUNT ||
+            0 == (mTypes & LOC_NMEA_TYPE_MASK(recordType))) {
+            mReadPos += alignRecord(length);
+            continue;
+        }
+        size_t copyLen = std::min<size_t>(length, bufLen);
+        memcpy(buf, mData + offset + LOC_NMEA_RING_RECORD_HEADER, copyLen);
+        if (isOverwritten(mReadPos)) {
+            skipLapped();
+            return 0;
+        }
+        mReadPos += alignRecord(length);
+        if (NULL != type) {
+            *type = (LocNmeaType)recordType;
+        }
+        return (int)copyLen;
+    }
+}
+
+/* empties the notification socket, false if the server closed it */
+bool LocNmeaFanoutClient::drainNotifications()
+{
+    uint64_t writePos;
+    ssize_t ret;
+
+    while ((ret = recv(mSocket, &writePos, sizeof(writePos), MSG_DONTWAIT)) > 0) {
+    }
+    return !(0 == ret || (ret < 0 && EAGAIN != errno && EWOULDBLOCK != errno &&
+                          EINTR != errno));
+}
+
+int LocNmeaFanoutClient::read(char* buf, size_t bufLen, int timeoutMs, LocNmeaType* type)
+{
+    if (NULL == mMap) {
+        return -1;
+    }
+
+    int len = readRecord(buf, bufLen, type);
+    if (len > 0) {
+        return len;
+    }
+
+    struct pollfd pfd = { mSocket, POLLIN, 0 };
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return 0;
+    }
+    if (!drainNotifications()) {
+        return -1;
+    }
+    return readRecord(buf, bufLen, type);
+}
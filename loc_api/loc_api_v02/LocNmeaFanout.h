@@ -0,0 +1,191 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_NMEA_FANOUT_H
+#define LOC_NMEA_FANOUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <LocThread.h>
+#include <LocNmeaSplitter.h>
+
+#define LOC_NMEA_RING_MAGIC     (0x414D4E4Cu)   /* "LNMA" */
+#define LOC_NMEA_RING_VERSION   (3)
+
+/* Layout of the shared memory ring. Records of
+ *   uint32_t length | uint32_t LocNmeaType | sentence, padded to 8 bytes
+ * follow the header back to back. A record never wraps; if it does not
+ * fit before the end of the data area a record with length
+ * LOC_NMEA_RING_WRAP is written and the next record starts at offset 0.
+ * writePos counts bytes ever written and is only advanced once a record
+ * is complete. reservePos is advanced before the writer touches any
+ * byte, to the end of what it is about to write; a reader re-checks it
+ * after copying a record and drops the copy if the writer reached into
+ * it. Readers keep their own position and are never waited for: if the
+ * writer laps them they skip ahead and count the loss. A batch never
+ * laps itself, the writer publishes early instead. */
+struct LocNmeaRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    /* size of the data area, a power of 2 */
+    uint32_t dataSize;
+    uint32_t headerSize;
+    std::atomic<uint64_t> writePos;
+    std::atomic<uint64_t> reservePos;
+};
+
+#define LOC_NMEA_RING_WRAP          (0xFFFFFFFFu)
+#define LOC_NMEA_RING_RECORD_HEADER (8)
+
+/* First message on a new connection, sent with the read only ring fd */
+struct LocNmeaFanoutHello {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t mapSize;
+    uint32_t reserved;
+    /* position the reader starts at */
+    uint64_t startPos;
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocNmeaFanoutServer
+ *
+ * Functionality:
+ * Fans NMEA out to local processes. Each batch is written once into a
+ * memfd backed ring that every reader maps read only, one record per
+ * sentence tagged with its type. Readers connect to a SOCK_SEQPACKET
+ * unix socket, receive the ring fd, may send back a LocNmeaTypeMask of
+ * the sentences they want, and are then sent the new write position
+ * after every batch holding one of those. Notifications are sent non
+ * blocking; a reader whose socket is full just misses them and catches
+ * up from the ring on the next one.
+ *-------------------------------------------------------------------*/
+class LocNmeaFanoutServer {
+
+public:
+    /* ringSize is rounded up to a power of 2 */
+    LocNmeaFanoutServer(const char* socketPath, uint32_t ringSize);
+    ~LocNmeaFanoutServer();
+
+    bool start();
+    void stop();
+
+    /* called by the single producer: append() the sentences of a batch,
+       then commit() to make them visible and wake the readers */
+    void append(const char* sentence, uint32_t length, LocNmeaType type);
+    void commit();
+
+    inline uint64_t getBatchesPublished() const { return mBatchesPublished; }
+    inline uint64_t getNotificationsDropped() const { return mNotificationsDropped; }
+
+private:
+    /* new'ed by start(), owned and deleted by mThread */
+    class Acceptor : public LocRunnable {
+        LocNmeaFanoutServer* mServer;
+    public:
+        inline Acceptor(LocNmeaFanoutServer* server) : mServer(server) {}
+        virtual bool run();
+    };
+
+    char mSocketPath[108];
+    uint32_t mDataSize;
+    uint32_t mMapSize;
+    int mRingFd;
+    /* read only reopen of mRingFd, handed to readers */
+    int mReaderFd;
+    uint8_t* mMap;
+    LocNmeaRingHeader* mHeader;
+    uint8_t* mData;
+    /* producer only */
+    uint64_t mWritePos;
+    LocNmeaTypeMask mBatchTypes;
+    int mListenFd;
+    int mStopFd;
+    std::mutex mClientsMutex;
+    struct Client {
+        int fd;
+        LocNmeaTypeMask types;
+    };
+    std::vector<Client> mClients;
+    uint64_t mBatchesPublished;
+    uint64_t mNotificationsDropped;
+    LocThread mThread;
+
+    bool createRing();
+    bool createSocket();
+    void acceptClient();
+    void readClient(int fd);
+    void cleanup();
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocNmeaFanoutClient
+ *
+ * Functionality:
+ * Reader side of LocNmeaFanoutServer, for use in consumer processes.
+ *-------------------------------------------------------------------*/
+class LocNmeaFanoutClient {
+
+public:
+    LocNmeaFanoutClient();
+    ~LocNmeaFanoutClient();
+
+    bool connect(const char* socketPath);
+    void disconnect();
+
+    /* Only sentences of these types are returned, and the server only
+       wakes this reader for them. Everything by default. */
+    bool setTypeMask(LocNmeaTypeMask types);
+
+    /* Copies the next sentence into buf, waiting up to timeoutMs for one.
+       Returns its length (truncated to bufLen), 0 on timeout and -1 if
+       the server went away. type is set if not NULL. */
+    int read(char* buf, size_t bufLen, int timeoutMs, LocNmeaType* type = NULL);
+
+    /* times the writer lapped this reader and data was skipped */
+    inline uint64_t getLost() const { return mLost; }
+
+private:
+    int mSocket;
+    uint8_t* mMap;
+    uint32_t mMapSize;
+    const LocNmeaRingHeader* mHeader;
+    const uint8_t* mData;
+    uint64_t mReadPos;
+    uint64_t mLost;
+    LocNmeaTypeMask mTypes;
+
+    int readRecord(char* buf, size_t bufLen, LocNmeaType* type);
+    bool isOverwritten(uint64_t pos) const;
+    void skipLapped();
+    bool drainNotifications();
+};
+
+#endif /* LOC_NMEA_FANOUT_H */
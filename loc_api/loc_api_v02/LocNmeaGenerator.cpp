@@ -0,0 +1,786 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_NmeaGenerator"
+
+#include <string.h>
+#include <math.h>
+#include <LocNmeaGenerator.h>
+#include <log_util.h>
+
+#define MS_PER_DAY       (86400000ULL)
+#define MPS_TO_KNOTS     (1.943844)
+#define MPS_TO_KMPH      (3.6)
+#define NMEA_GSA_MAX_SVS (12)
+#define NMEA_GSV_PER_MSG (4)
+
+static const char* const sTalkers[] = { "GP", "GL", "GA", "GB", "GQ" };
+
+/* appends NMEA fields to a fixed buffer; on overflow the sentence is
+   dropped by end() */
+class NmeaWriter {
+    char* mBuf;
+    uint32_t mSize;
+    uint32_t mLen;
+    bool mOverflow;
+
+    inline void put(char c)
+    {
+        if (mLen < mSize) {
+            mBuf[mLen++] = c;
+        } else {
+            mOverflow = true;
+        }
+    }
+
+public:
+    inline NmeaWriter(char* buf, uint32_t size) :
+        mBuf(buf), mSize(size), mLen(0), mOverflow(false) {}
+
+    inline void begin(const char* talker, const char* type)
+    {
+        put('$');
+        str(talker);
+        str(type);
+    }
+
+    inline void comma() { put(','); }
+
+    inline void chr(char c) { put(c); }
+
+    inline void str(const char* s)
+    {
+        while ('\0' != *s) {
+            put(*s++);
+        }
+    }
+
+    /* decimal, zero padded to minDigits */
+    void uint(uint32_t value, int minDigits)
+    {
+        char digits[10];
+        int n = 0;
+        do {
+            digits[n++] = '0' + value % 10;
+            value /= 10;
+        } while (value > 0);
+        while (n < minDigits) {
+            put('0');
+            minDigits--;
+        }
+        while (n > 0) {
+            put(digits[--n]);
+        }
+    }
+
+    /* rounded to the given number of decimals */
+    void fixed(double value, int decimals)
+    {
+        static const uint32_t sScale[] = { 1, 10, 100, 1000, 10000, 100000 };
+        if (value < 0) {
+            put('-');
+            value = -value;
+        }
+        uint64_t scaled = (uint64_t)(value * sScale[decimals] + 0.5);
+        uint((uint32_t)(scaled / sScale[decimals]), 1);
+        if (decimals > 0) {
+            put('.');
+            uint((uint32_t)(scaled % sScale[decimals]), decimals);
+        }
+    }
+
+    /* (d)ddmm.mmmmm,H; rounded as a whole so minutes never read 60 */
+    void coordinate(double degrees, int degreeDigits, char positive, char negative)
+    {
+        char hemisphere = (degrees < 0) ? negative : positive;
+        uint64_t minutes = (uint64_t)(fabs(degrees) * 60 * 100000 + 0.5);
+        uint((uint32_t)(minutes / (60 * 100000)), degreeDigits);
+        minutes %= 60 * 100000;
+        uint((uint32_t)(minutes / 100000), 2);
+        put('.');
+        uint((uint32_t)(minutes % 100000), 5);
+        comma();
+        put(hemisphere);
+    }
+
+    /* hhmmss.ss */
+    void utcTime(uint64_t utcMs)
+    {
+        uint32_t msOfDay = (uint32_t)(utcMs % MS_PER_DAY);
+        uint(msOfDay / 3600000, 2);
+        uint(msOfDay / 60000 % 60, 2);
+        uint(msOfDay / 1000 % 60, 2);
+        put('.');
+        uint(msOfDay % 1000 / 10, 2);
+    }
+
+    /* ddmmyy, civil from days since 1970 */
+    void utcDate(uint64_t utcMs)
+    {
+        int64_t z = (int64_t)(utcMs / MS_PER_DAY) + 719468;
+        int64_t era = z / 146097;
+        uint32_t doe = (uint32_t)(z - era * 146097);
+        uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        uint32_t mp = (5 * doy + 2) / 153;
+        uint32_t day = doy - (153 * mp + 2) / 5 + 1;
+        uint32_t month = mp < 10 ? mp + 3 : mp - 9;
+        uint32_t year = (uint32_t)(yoe + era * 400) + (month <= 2);
+        uint(day, 2);
+        uint(month, 2);
+        uint(year % 100, 2);
+    }
+
+    /* appends *hh<CR><LF>, returns the sentence length or 0 if it did
+       not fit */
+    uint32_t end()
+    {
+        uint8_t checksum = 0;
+        for (uint32_t i = 1; i < mLen && i < mSize; i++) {
+            checksum ^= (uint8_t)mBuf[i];
+        }
+        static const char sHex[] = "0123456789ABCDEF";
+        put('*');
+        put(sHex[checksum >> 4]);
+        put(sHex[checksum & 0xF]);
+        put('\r');
+        put('\n');
+        return mOverflow ? 0 : mLen;
+    }
+};
+
+LocNmeaGenerator::LocNmeaGenerator() :
+    mTypes(LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GGA) | LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_RMC) |
+           LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSA) | LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSV) |
+           LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_VTG)),
+    mSvCount(0), mLength(0), mCount(0)
+{
+}
+
+LocNmeaTypeMask LocNmeaGenerator::fromQmiNmeaMask(uint32_t qmiMask)
+{
+    LocNmeaTypeMask types = 0;
+
+    if (qmiMask & (QMI_LOC_NMEA_MASK_GGA_V02 | QMI_LOC_NMEA_MASK_GAGGA_V02)) {
+        types |= LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GGA);
+    }
+    if (qmiMask & (QMI_LOC_NMEA_MASK_RMC_V02 | QMI_LOC_NMEA_MASK_GARMC_V02)) {
+        types |= LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_RMC);
+    }
+    if (qmiMask & (QMI_LOC_NMEA_MASK_GSA_V02 | QMI_LOC_NMEA_MASK_GNGSA_V02 |
+                   QMI_LOC_NMEA_MASK_GAGSA_V02 | QMI_LOC_NMEA_MASK_PQGSA_V02)) {
+        types |= LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSA);
+    }
+    if (qmiMask & (QMI_LOC_NMEA_MASK_GSV_V02 | QMI_LOC_NMEA_MASK_GLGSV_V02 |
+                   QMI_LOC_NMEA_MASK_GAGSV_V02 | QMI_LOC_NMEA_MASK_PQGSV_V02)) {
+        types |= LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSV);
+    }
+    if (qmiMask & (QMI_LOC_NMEA_MASK_VTG_V02 | QMI_LOC_NMEA_MASK_GAVTG_V02)) {
+        types |= LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_VTG);
+    }
+    return types;
+}
+
+uint32_t LocNmeaGenerator::toQmiNmeaMask(LocNmeaTypeMask types)
+{
+    uint32_t qmiMask = 0;
+
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GGA)) {
+        qmiMask |= QMI_LOC_NMEA_MASK_GGA_V02 | QMI_LOC_NMEA_MASK_GAGGA_V02;
+    }
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_RMC)) {
+        qmiMask |= QMI_LOC_NMEA_MASK_RMC_V02 | QMI_LOC_NMEA_MASK_GARMC_V02;
+    }
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSA)) {
+        qmiMask |= QMI_LOC_NMEA_MASK_GSA_V02 | QMI_LOC_NMEA_MASK_GNGSA_V02 |
+                   QMI_LOC_NMEA_MASK_GAGSA_V02 | QMI_LOC_NMEA_MASK_PQGSA_V02;
+    }
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSV)) {
+        qmiMask |= QMI_LOC_NMEA_MASK_GSV_V02 | QMI_LOC_NMEA_MASK_GLGSV_V02 |
+                   QMI_LOC_NMEA_MASK_GAGSV_V02 | QMI_LOC_NMEA_MASK_PQGSV_V02;
+    }
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_VTG)) {
+        qmiMask |= QMI_LOC_NMEA_MASK_VTG_V02 | QMI_LOC_NMEA_MASK_GAVTG_V02;
+    }
+    return qmiMask;
+}
+
+/* SV info ids: GPS 1-32, SBAS 33-64 and 120-158, GLONASS 65-96,
+   QZSS 193-197, BDS 201-237, Galileo 301-336 */
+bool LocNmeaGenerator::toNmeaSv(uint32_t qmiSystem, uint16_t gnssSvId, Sv& sv)
+{
+    switch (qmiSystem) {
+    case eQMI_LOC_SV_SYSTEM_GPS_V02:
+        sv.constellation = GPS;
+        sv.nmeaId = gnssSvId;
+        return true;
+    case eQMI_LOC_SV_SYSTEM_SBAS_V02:
+        // NMEA numbers SBAS PRN 120-158 as 33-71 under GP
+        sv.constellation = GPS;
+        sv.nmeaId = (gnssSvId >= 120) ? gnssSvId - 87 : gnssSvId;
+        return true;
+    case eQMI_LOC_SV_SYSTEM_GLONASS_V02:
+        sv.constellation = GLONASS;
+        sv.nmeaId = gnssSvId;
+        return true;
+    case eQMI_LOC_SV_SYSTEM_GALILEO_V02:
+        sv.constellation = GALILEO;
+        sv.nmeaId = gnssSvId - 300;
+        return true;
+    case eQMI_LOC_SV_SYSTEM_BDS_V02:
+        sv.constellation = BDS;
+        sv.nmeaId = gnssSvId - 200;
+        return true;
+    case eQMI_LOC_SV_SYSTEM_QZSS_V02:
+        sv.constellation = QZSS;
+        sv.nmeaId = gnssSvId - 192;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool LocNmeaGenerator::usedSvToNmea(uint16_t gnssSvId, Sv& sv)
+{
+    if (gnssSvId >= 1 && gnssSvId <= 64) {
+        return toNmeaSv(eQMI_LOC_SV_SYSTEM_GPS_V02, gnssSvId, sv);
+    } else if (gnssSvId >= 65 && gnssSvId <= 96) {
+        return toNmeaSv(eQMI_LOC_SV_SYSTEM_GLONASS_V02, gnssSvId, sv);
+    } else if (gnssSvId >= 120 && gnssSvId <= 158) {
+        return toNmeaSv(eQMI_LOC_SV_SYSTEM_SBAS_V02, gnssSvId, sv);
+    } else if (gnssSvId >= 193 && gnssSvId <= 197) {
+        return toNmeaSv(eQMI_LOC_SV_SYSTEM_QZSS_V02, gnssSvId, sv);
+    } else if (gnssSvId >= 201 && gnssSvId <= 237) {
+        return toNmeaSv(eQMI_LOC_SV_SYSTEM_BDS_V02, gnssSvId, sv);
+    } else if (gnssSvId >= 301 && gnssSvId <= 336) {
+        return toNmeaSv(eQMI_LOC_SV_SYSTEM_GALILEO_V02, gnssSvId, sv);
+    }
+    return false;
+}
+
+void LocNmeaGenerator::updateSvs(const qmiLocEventGnssSvInfoIndMsgT_v02& svInfo)
+{
+    uint32_t count = svInfo.svList_valid ? svInfo.svList_len : 0;
+    if (count > QMI_LOC_SV_INFO_LIST_MAX_SIZE_V02) {
+        count = QMI_LOC_SV_INFO_LIST_MAX_SIZE_V02;
+    }
+
+    mSvCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const qmiLocSvInfoStructT_v02& info = svInfo.svList[i];
+        Sv& sv = mSvs[mSvCount];
+        if (!(info.validMask & QMI_LOC_SV_INFO_MASK_VALID_SYSTEM_V02) ||
+            !(info.validMask & QMI_LOC_SV_INFO_MASK_VALID_GNSS_SVID_V02) ||
+            !toNmeaSv(info.system, info.gnssSvId, sv)) {
+            continue;
+        }
+        sv.elevation = (info.validMask & QMI_LOC_SV_INFO_MASK_VALID_ELEVATION_V02) ?
+                (int16_t)lroundf(info.elevation) : -1;
+        sv.azimuth = (info.validMask & QMI_LOC_SV_INFO_MASK_VALID_AZIMUTH_V02) ?
+                (int16_t)lroundf(info.azimuth) % 360 : -1;
+        sv.snr = (info.validMask & QMI_LOC_SV_INFO_MASK_VALID_SNR_V02) && info.snr > 0 ?
+                (int16_t)lroundf(info.snr) : -1;
+        mSvCount++;
+    }
+}
+
+void LocNmeaGenerator::push(uint32_t length, LocNmeaType type)
+{
+    if (0 == length || mCount >= LOC_NMEA_GENERATOR_MAX_SENTENCES) {
+        LOC_LOGE("%s:%d]: no room for NMEA type %d", __func__, __LINE__, type);
+        return;
+    }
+    mSentences[mCount].start = mBuffer + mLength;
+    mSentences[mCount].length = length;
+    mSentences[mCount].type = type;
+    mCount++;
+    mLength += length;
+}
+
+/* $--GGA,hhmmss.ss,llll.lllll,a,yyyyy.yyyyy,a,q,nn,h.h,a.a,M,g.g,M,, */
+void LocNmeaGenerator::addGga(const qmiLocEventPositionReportIndMsgT_v02& position,
+                              const char* talker, bool fix, uint32_t numUsed)
+{
+    NmeaWriter w(mBuffer + mLength, LOC_NMEA_GENERATOR_BUFFER_SIZE - mLength);
+
+    w.begin(talker, "GGA");
+    w.comma();
+    if (position.timestampUtc_valid) {
+        w.utcTime(position.timestampUtc);
+    }
+    w.comma();
+    if (fix) {
+        w.coordinate(position.latitude, 2, 'N', 'S');
+        w.comma();
+        w.coordinate(position.longitude, 3, 'E', 'W');
+        w.comma();
+        // 1: GNSS fix, 6: dead reckoning or other estimate
+        bool gnss = !position.technologyMask_valid ||
+                (position.technologyMask & QMI_LOC_POS_TECH_MASK_SATELLITE_V02);
+        w.chr(gnss ? '1' : '6');
+    } else {
+        w.str(",,,,0");
+    }
+    w.comma();
+    w.uint(numUsed, 2);
+    w.comma();
+    if (position.DOP_valid) {
+        w.fixed(position.DOP.HDOP, 1);
+    }
+    w.comma();
+    if (fix && position.altitudeWrtMeanSeaLevel_valid) {
+        w.fixed(position.altitudeWrtMeanSeaLevel, 1);
+    }
+    w.str(",M,");
+    if (fix && position.altitudeWrtMeanSeaLevel_valid && position.altitudeWrtEllipsoid_valid) {
+        w.fixed(position.altitudeWrtEllipsoid - position.altitudeWrtMeanSeaLevel, 1);
+    }
+    w.str(",M,,");
+    push(w.end(), LOC_NMEA_TYPE_GGA);
+}
+
+/* $--RMC,hhmmss.ss,A,llll.lllll,a,yyyyy.yyyyy,a,x.x,x.x,ddmmyy,x.x,a,m */
+void LocNmeaGenerator::addRmc(const qmiLocEventPositionReportIndMsgT_v02& position,
+                              const char* talker, bool fix)
+{
+    NmeaWriter w(mBuffer + mLength, LOC_NMEA_GENERATOR_BUFFER_SIZE - mLength);
+    bool gnss = !position.technologyMask_valid ||
+            (position.technologyMask & QMI_LOC_POS_TECH_MASK_SATELLITE_V02);
+
+    w.begin(talker, "RMC");
+    w.comma();
+    if (position.timestampUtc_valid) {
+        w.utcTime(position.timestampUtc);
+    }
+    w.comma();
+    w.chr(fix ? 'A' : 'V');
+    w.comma();
+    if (fix) {
+        w.coordinate(position.latitude, 2, 'N', 'S');
+        w.comma();
+        w.coordinate(position.longitude, 3, 'E', 'W');
+    } else {
+        w.str(",,,");
+    }
+    w.comma();
+    if (fix && position.speedHorizontal_valid) {
+        w.fixed(position.speedHorizontal * MPS_TO_KNOTS, 1);
+    }
+    w.comma();
+    if (fix && position.heading_valid) {
+        w.fixed(position.heading, 1);
+    }
+    w.comma();
+    if (position.timestampUtc_valid) {
+        w.utcDate(position.timestampUtc);
+    }
+    w.comma();
+    if (fix && position.magneticDeviation_valid) {
+        w.fixed(fabsf(position.magneticDeviation), 1);
+        w.comma();
+        w.chr(position.magneticDeviation < 0 ? 'W' : 'E');
+    } else {
+        w.comma();
+    }
+    w.comma();
+    // mode: A autonomous, E estimated, N not valid
+    w.chr(!fix ? 'N' : (gnss ? 'A' : 'E'));
+    push(w.end(), LOC_NMEA_TYPE_RMC);
+}
+
+/* $--VTG,x.x,T,,M,x.x,N,x.x,K,m */
+void LocNmeaGenerator::addVtg(const qmiLocEventPositionReportIndMsgT_v02& position,
+                              const char* talker, bool fix)
+{
+    NmeaWriter w(mBuffer + mLength, LOC_NMEA_GENERATOR_BUFFER_SIZE - mLength);
+    bool gnss = !position.technologyMask_valid ||
+            (position.technologyMask & QMI_LOC_POS_TECH_MASK_SATELLITE_V02);
+
+    w.begin(talker, "VTG");
+    w.comma();
+    if (fix && position.heading_valid) {
+        w.fixed(position.heading, 1);
+    }
+    w.str(",T,,M,");
+    if (fix && position.speedHorizontal_valid) {
+        w.fixed(position.speedHorizontal * MPS_TO_KNOTS, 1);
+    }
+    w.str(",N,");
+    if (fix && position.speedHorizontal_valid) {
+        w.fixed(position.speedHorizontal * MPS_TO_KMPH, 1);
+    }
+    w.str(",K,");
+    w.chr(!fix ? 'N' : (gnss ? 'A' : 'E'));
+    push(w.end(), LOC_NMEA_TYPE_VTG);
+}
+
+/* $GNGSA,A,x,{12 used ids},p.p,h.h,v.v,s */
+void LocNmeaGenerator::addGsa(const qmiLocEventPositionReportIndMsgT_v02& position, bool fix,
+                              int constellation, const uint8_t* ids, uint32_t count)
+{
+    NmeaWriter w(mBuffer + mLength, LOC_NMEA_GENERATOR_BUFFER_SIZE - mLength);
+
+    w.begin("GN", "GSA");
+    w.str(",A,");
+    w.chr(!fix ? '1' :
+          ((position.altitudeAssumed_valid && position.altitudeAssumed) ? '2' : '3'));
+    for (uint32_t i = 0; i < NMEA_GSA_MAX_SVS; i++) {
+        w.comma();
+        if (i < count) {
+            w.uint(ids[i], 2);
+        }
+    }
+    w.comma();
+    if (position.DOP_valid) {
+        w.fixed(position.DOP.PDOP, 1);
+        w.comma();
+        w.fixed(position.DOP.HDOP, 1);
+        w.comma();
+        w.fixed(position.DOP.VDOP, 1);
+    } else {
+        w.str(",,");
+    }
+    w.comma();
+    // NMEA 4.10 system id
+    w.uint(constellation + 1, 1);
+    push(w.end(), LOC_NMEA_TYPE_GSA);
+}
+
+/* $--GSV,t,n,cc,{ii,ee,aaa,ss}x4 */
+void LocNmeaGenerator::addGsv(int constellation)
+{
+    uint32_t inView = 0;
+    for (uint32_t i = 0; i < mSvCount; i++) {
+        if (mSvs[i].constellation == constellation) {
+            inView++;
+        }
+    }
+    if (0 == inView) {
+        return;
+    }
+
+    uint32_t messages = (inView + NMEA_GSV_PER_MSG - 1) / NMEA_GSV_PER_MSG;
+    uint32_t next = 0;
+    for (uint32_t message = 1; message <= messages; message++) {
+        NmeaWriter w(mBuffer + mLength, LOC_NMEA_GENERATOR_BUFFER_SIZE - mLength);
+        w.begin(sTalkers[constellation], "GSV");
+        w.comma();
+        w.uint(messages, 1);
+        w.comma();
+        w.uint(message, 1);
+        w.comma();
+        w.uint(inView, 2);
+        for (uint32_t n = 0; n < NMEA_GSV_PER_MSG && next < mSvCount; next++) {
+            const Sv& sv = mSvs[next];
+            if (sv.constellation != constellation) {
+                continue;
+            }
+            w.comma();
+            w.uint(sv.nmeaId, 2);
+            w.comma();
+            if (sv.elevation >= 0) {
+                w.uint(sv.elevation, 2);
+            }
+            w.comma();
+            if (sv.azimuth >= 0) {
+                w.uint(sv.azimuth, 3);
+            }
+            w.comma();
+            if (sv.snr >= 0) {
+                w.uint(sv.snr, 2);
+            }
+            n++;
+        }
+        push(w.end(), LOC_NMEA_TYPE_GSV);
+    }
+}
+
+uint32_t LocNmeaGenerator::generate(const qmiLocEventPositionReportIndMsgT_v02& position,
+                                    const LocNmeaSentence*& sentences)
+{
+    uint8_t usedIds[CONSTELLATION_COUNT][NMEA_GSA_MAX_SVS];
+    uint32_t usedCount[CONSTELLATION_COUNT] = {};
+    uint32_t numUsed = 0;
+    int lastConstellation = GPS;
+    int constellations = 0;
+    bool fix = (eQMI_LOC_SESS_STATUS_SUCCESS_V02 == position.sessionStatus ||
+                eQMI_LOC_SESS_STATUS_IN_PROGRESS_V02 == position.sessionStatus) &&
+               position.latitude_valid && position.longitude_valid;
+
+    mLength = 0;
+    mCount = 0;
+
+    if (fix && position.gnssSvUsedList_valid) {
+        uint32_t len = position.gnssSvUsedList_len;
+        if (len > QMI_LOC_MAX_SV_USED_LIST_LENGTH_V02) {
+            len = QMI_LOC_MAX_SV_USED_LIST_LENGTH_V02;
+        }
+        for (uint32_t i = 0; i < len; i++) {
+            Sv sv;
+            if (!usedSvToNmea(position.gnssSvUsedList[i], sv)) {
+                continue;
+            }
+            numUsed++;
+            if (0 == usedCount[sv.constellation]) {
+                constellations++;
+                lastConstellation = sv.constellation;
+            }
+            if (usedCount[sv.constellation] < NMEA_GSA_MAX_SVS) {
+                usedIds[sv.constellation][usedCount[sv.constellation]++] = sv.nmeaId;
+            }
+        }
+    }
+    // a single constellation fix is reported under its own talker
+    const char* talker = (constellations > 1) ? "GN" : sTalkers[lastConstellation];
+
+    LocNmeaTypeMask types = mTypes;
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GGA)) {
+        addGga(position, talker, fix, numUsed);
+    }
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_RMC)) {
+        addRmc(position, talker, fix);
+    }
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSA)) {
+        for (int c = 0; c < CONSTELLATION_COUNT; c++) {
+            if (usedCount[c] > 0 || (0 == constellations && GPS == c)) {
+                addGsa(position, fix, c, usedIds[c], usedCount[c]);
+            }
+        }
+    }
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSV)) {
+        for (int c = 0; c < CONSTELLATION_COUNT; c++) {
+            addGsv(c);
+        }
+    }
+    if (types & LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_VTG)) {
+        addVtg(position, talker, fix);
+    }
+
+    sentences = mSentences;
+    return mCount;
+}
+
+/*--------------------------------------------------------------------
+ * LocNmeaComparator
+ *-------------------------------------------------------------------*/
+/* sentence types LocNmeaGenerator can produce */
+#define NMEA_GENERATED_TYPES (LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GGA) | \
+                              LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_RMC) | \
+                              LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSA) | \
+                              LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_GSV) | \
+                              LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_VTG))
+/* compared epochs between two summaries */
+#define NMEA_COMPARE_STATS_INTERVAL (100)
+
+LocNmeaComparator::LocNmeaComparator() :
+    mEpochs(0), mEqual(0), mDifferent(0), mGeneratedOnly(0), mModemOnly(0)
+{
+}
+
+bool LocNmeaComparator::Epoch::add(const LocNmeaSentence& sentence)
+{
+    if (count >= LOC_NMEA_GENERATOR_MAX_SENTENCES ||
+        sentence.length > sizeof(buffer) - length) {
+        return false;
+    }
+    memcpy(buffer + length, sentence.start, sentence.length);
+    sentences[count].start = buffer + length;
+    sentences[count].length = sentence.length;
+    sentences[count].type = sentence.type;
+    count++;
+    length += sentence.length;
+    if (time < 0) {
+        time = timeOf(sentence);
+    }
+    return true;
+}
+
+/* hhmmss.ss of a GGA or RMC, whatever the number of decimals */
+int32_t LocNmeaComparator::timeOf(const LocNmeaSentence& sentence)
+{
+    if (LOC_NMEA_TYPE_GGA != sentence.type && LOC_NMEA_TYPE_RMC != sentence.type) {
+        return -1;
+    }
+    const char* p = (const char*)memchr(sentence.start, ',', sentence.length);
+    const char* end = sentence.start + sentence.length;
+    int32_t digits[6];
+
+    if (NULL == p || end - p < 7) {
+        return -1;
+    }
+    p++;
+    for (int i = 0; i < 6; i++) {
+        if (p[i] < '0' || p[i] > '9') {
+            return -1;
+        }
+        digits[i] = p[i] - '0';
+    }
+    int32_t time = ((digits[0] * 10 + digits[1]) * 3600 +
+                    (digits[2] * 10 + digits[3]) * 60 +
+                    digits[4] * 10 + digits[5]) * 100;
+    p += 6;
+    if (p < end && '.' == *p) {
+        p++;
+        for (int32_t scale = 10; scale > 0 && p < end && *p >= '0' && *p <= '9';
+             scale /= 10, p++) {
+            time += (*p - '0') * scale;
+        }
+    }
+    return time;
+}
+
+uint32_t LocNmeaComparator::bodyLength(const LocNmeaSentence& sentence)
+{
+    const char* star = (const char*)memchr(sentence.start, '*', sentence.length);
+    return (NULL != star) ? (uint32_t)(star - sentence.start) : sentence.length;
+}
+
+uint32_t LocNmeaComparator::ordinalOf(const Epoch& epoch, uint32_t index)
+{
+    const LocNmeaSentence& sentence = epoch.sentences[index];
+    const char* comma = (const char*)memchr(sentence.start, ',', sentence.length);
+    uint32_t address = (NULL != comma) ? (uint32_t)(comma - sentence.start) : sentence.length;
+    uint32_t ordinal = 0;
+
+    for (uint32_t i = 0; i < index; i++) {
+        if (epoch.sentences[i].length > address &&
+            ',' == epoch.sentences[i].start[address] &&
+            0 == memcmp(epoch.sentences[i].start, sentence.start, address)) {
+            ordinal++;
+        }
+    }
+    return ordinal;
+}
+
+int LocNmeaComparator::find(const Epoch& epoch, const LocNmeaSentence& sentence,
+                            uint32_t ordinal)
+{
+    const char* comma = (const char*)memchr(sentence.start, ',', sentence.length);
+    uint32_t address = (NULL != comma) ? (uint32_t)(comma - sentence.start) : sentence.length;
+
+    for (uint32_t i = 0; i < epoch.count; i++) {
+        if (epoch.sentences[i].length > address &&
+            ',' == epoch.sentences[i].start[address] &&
+            0 == memcmp(epoch.sentences[i].start, sentence.start, address)) {
+            if (0 == ordinal) {
+                return (int)i;
+            }
+            ordinal--;
+        }
+    }
+    return -1;
+}
+
+void LocNmeaComparator::compare()
+{
+    bool matched[LOC_NMEA_GENERATOR_MAX_SENTENCES] = {};
+    LocNmeaTypeMask generatedTypes = 0;
+
+    for (uint32_t i = 0; i < mGenerated.count; i++) {
+        const LocNmeaSentence& generated = mGenerated.sentences[i];
+        int m = find(mModem, generated, ordinalOf(mGenerated, i));
+        uint32_t length = bodyLength(generated);
+
+        generatedTypes |= LOC_NMEA_TYPE_MASK(generated.type);
+        if (m < 0) {
+            mGeneratedOnly++;
+            LOC_LOGI("%s:%d]: AP only: %.*s", __func__, __LINE__, (int)length, generated.start);
+            continue;
+        }
+        matched[m] = true;
+        const LocNmeaSentence& modem = mModem.sentences[m];
+        if (bodyLength(modem) == length && 0 == memcmp(modem.start, generated.start, length)) {
+            mEqual++;
+        } else {
+            mDifferent++;
+            LOC_LOGI("%s:%d]: differs, modem: %.*s AP: %.*s", __func__, __LINE__,
+                     (int)bodyLength(modem), modem.start, (int)length, generated.start);
+        }
+    }
+    // only the types the generator was asked for can be missing
+    for (uint32_t i = 0; i < mModem.count; i++) {
+        const LocNmeaSentence& modem = mModem.sentences[i];
+        if (!matched[i] && (generatedTypes & LOC_NMEA_TYPE_MASK(modem.type))) {
+            mModemOnly++;
+            LOC_LOGI("%s:%d]: modem only: %.*s", __func__, __LINE__,
+                     (int)bodyLength(modem), modem.start);
+        }
+    }
+
+    if (++mEpochs >= NMEA_COMPARE_STATS_INTERVAL) {
+        LOC_LOGI("%s:%d]: %u epochs: %u sentences equal, %u differ, %u AP only, "
+                 "%u modem only", __func__, __LINE__, mEpochs, mEqual, mDifferent,
+                 mGeneratedOnly, mModemOnly);
+        mEpochs = 0;
+        mEqual = 0;
+        mDifferent = 0;
+        mGeneratedOnly = 0;
+        mModemOnly = 0;
+    }
+}
+
+void LocNmeaComparator::compareIfDue()
+{
+    if (mGenerated.count > 0 && mGenerated.time >= 0 && mGenerated.time == mModem.time) {
+        compare();
+        mGenerated.clear();
+    }
+}
+
+void LocNmeaComparator::addModem(const LocNmeaSentence& sentence)
+{
+    if (NMEA_GENERATED_TYPES & LOC_NMEA_TYPE_MASK(sentence.type)) {
+        mReport.add(sentence);
+    }
+}
+
+void LocNmeaComparator::endModemReport()
+{
+    if (mReport.time >= 0 && mReport.time != mModem.time) {
+        // a new epoch, the one before is complete
+        compareIfDue();
+        mModem.clear();
+    } else if (mModem.time < 0) {
+        // the rest of an epoch that was not seen from its start
+        mReport.clear();
+        return;
+    }
+    for (uint32_t i = 0; i < mReport.count; i++) {
+        mModem.add(mReport.sentences[i]);
+    }
+    mReport.clear();
+}
+
+void LocNmeaComparator::addGenerated(const LocNmeaSentence* sentences, uint32_t count)
+{
+    compareIfDue();
+    mGenerated.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        mGenerated.add(sentences[i]);
+    }
+}
@@ -0,0 +1,186 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_NMEA_GENERATOR_H
+#define LOC_NMEA_GENERATOR_H
+
+#include <stdint.h>
+#include <atomic>
+#include <location_service_v02.h>
+#include <LocNmeaSplitter.h>
+
+/* room for GGA, RMC, VTG, a GSA per constellation and the GSVs of a
+   full SV list, each at most 82 characters */
+#define LOC_NMEA_GENERATOR_MAX_SENTENCES (40)
+#define LOC_NMEA_GENERATOR_BUFFER_SIZE   (LOC_NMEA_GENERATOR_MAX_SENTENCES * 84)
+
+/*--------------------------------------------------------------------
+ * CLASS LocNmeaGenerator
+ *
+ * Functionality:
+ * Formats GGA, RMC, GSA, GSV and VTG on the AP from the decoded
+ * position and SV reports, so the modem does not have to generate and
+ * send NMEA. Sentences are written into a fixed buffer by a small
+ * hand rolled formatter; nothing is allocated and no stdio is used.
+ * Only setTypes() may be called from another thread than the one
+ * delivering the position and SV reports.
+ *-------------------------------------------------------------------*/
+class LocNmeaGenerator {
+
+public:
+    LocNmeaGenerator();
+
+    /* sentence types to generate, GGA, RMC, GSA, GSV and VTG by default */
+    inline void setTypes(LocNmeaTypeMask types) { mTypes = types; }
+    inline LocNmeaTypeMask getTypes() const { return mTypes; }
+
+    /* keeps the SVs in view for the GSV of the next epoch */
+    void updateSvs(const qmiLocEventGnssSvInfoIndMsgT_v02& svInfo);
+
+    /* formats the sentences for one epoch. Returns how many there are;
+       sentences points into the generator and stays valid until the
+       next call */
+    uint32_t generate(const qmiLocEventPositionReportIndMsgT_v02& position,
+                      const LocNmeaSentence*& sentences);
+
+    /* sentence types covered by a QMI_LOC_NMEA_MASK_* set */
+    static LocNmeaTypeMask fromQmiNmeaMask(uint32_t qmiMask);
+    /* QMI_LOC_NMEA_MASK_* bits the given types replace, the rest stay
+       with the modem */
+    static uint32_t toQmiNmeaMask(LocNmeaTypeMask types);
+
+private:
+    /* NMEA talkers, in NMEA 4.10 system id order */
+    enum Constellation {
+        GPS = 0,
+        GLONASS,
+        GALILEO,
+        BDS,
+        QZSS,
+        CONSTELLATION_COUNT
+    };
+
+    struct Sv {
+        uint8_t constellation;
+        /* satellite id as NMEA numbers it for the talker */
+        uint8_t nmeaId;
+        int16_t elevation;
+        int16_t azimuth;
+        /* -1 if not known */
+        int16_t snr;
+    };
+
+    std::atomic<LocNmeaTypeMask> mTypes;
+    Sv mSvs[QMI_LOC_SV_INFO_LIST_MAX_SIZE_V02];
+    uint32_t mSvCount;
+    /* one spare byte, so the last sentence can be NUL terminated in
+       place like the others */
+    char mBuffer[LOC_NMEA_GENERATOR_BUFFER_SIZE + 1];
+    uint32_t mLength;
+    LocNmeaSentence mSentences[LOC_NMEA_GENERATOR_MAX_SENTENCES];
+    uint32_t mCount;
+
+    /* records the sentence just formatted at mBuffer + mLength */
+    void push(uint32_t length, LocNmeaType type);
+    static bool toNmeaSv(uint32_t qmiSystem, uint16_t gnssSvId, Sv& sv);
+    static bool usedSvToNmea(uint16_t gnssSvId, Sv& sv);
+
+    void addGga(const qmiLocEventPositionReportIndMsgT_v02& position,
+                const char* talker, bool fix, uint32_t numUsed);
+    void addRmc(const qmiLocEventPositionReportIndMsgT_v02& position,
+                const char* talker, bool fix);
+    void addVtg(const qmiLocEventPositionReportIndMsgT_v02& position,
+                const char* talker, bool fix);
+    void addGsa(const qmiLocEventPositionReportIndMsgT_v02& position, bool fix,
+                int constellation, const uint8_t* ids, uint32_t count);
+    void addGsv(int constellation);
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocNmeaComparator
+ *
+ * Functionality:
+ * Checks generated NMEA against the modem's for the same epoch and
+ * logs every sentence that differs or is only on one side. Epochs are
+ * matched by the UTC time of their GGA or RMC; an epoch is compared
+ * once the next one starts on either side, so the modem may send it
+ * over several reports. Sentences are matched by their address field
+ * and position among sentences with that address. All calls must come
+ * from the thread delivering the NMEA and position reports.
+ *-------------------------------------------------------------------*/
+class LocNmeaComparator {
+
+public:
+    LocNmeaComparator();
+
+    /* a sentence of the modem report being split */
+    void addModem(const LocNmeaSentence& sentence);
+    /* ends the modem report */
+    void endModemReport();
+    /* the generated sentences of one epoch */
+    void addGenerated(const LocNmeaSentence* sentences, uint32_t count);
+
+private:
+    struct Epoch {
+        char buffer[LOC_NMEA_GENERATOR_BUFFER_SIZE];
+        uint32_t length;
+        LocNmeaSentence sentences[LOC_NMEA_GENERATOR_MAX_SENTENCES];
+        uint32_t count;
+        /* UTC time of day of the GGA or RMC in centiseconds, -1 if
+           there is none */
+        int32_t time;
+
+        inline Epoch() : length(0), count(0), time(-1) {}
+        inline void clear() { length = 0; count = 0; time = -1; }
+        /* copies the sentence in, false if there is no room */
+        bool add(const LocNmeaSentence& sentence);
+    };
+
+    Epoch mModem;
+    /* the modem report being split, merged into mModem at its end */
+    Epoch mReport;
+    Epoch mGenerated;
+    uint32_t mEpochs;
+    uint32_t mEqual;
+    uint32_t mDifferent;
+    uint32_t mGeneratedOnly;
+    uint32_t mModemOnly;
+
+    /* compares and drops the generated epoch if the modem one is for
+       the same time */
+    void compareIfDue();
+    void compare();
+    static int32_t timeOf(const LocNmeaSentence& sentence);
+    /* length up to the checksum */
+    static uint32_t bodyLength(const LocNmeaSentence& sentence);
+    /* index of the sentence with the same address and ordinal in
+       epoch, -1 if there is none */
+    static int find(const Epoch& epoch, const LocNmeaSentence& sentence, uint32_t ordinal);
+    static uint32_t ordinalOf(const Epoch& epoch, uint32_t index);
+};
+
+#endif /* LOC_NMEA_GENERATOR_H */
@@ -0,0 +1,186 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_NmeaSplitter"
+
+#include <string.h>
+#include <LocNmeaSplitter.h>
+#include <log_util.h>
+
+#define LOC_NMEA_TYPE_KEYS (26 * 26 * 26)
+
+/* maps the three letter sentence formatter to its type, indexed by the
+   letters as base 26 digits; built once when the library loads */
+class LocNmeaTypeTable {
+    uint8_t mTypes[LOC_NMEA_TYPE_KEYS];
+
+    static inline int key(const char* id)
+    {
+        return ((id[0] - 'A') * 26 + (id[1] - 'A')) * 26 + (id[2] - 'A');
+    }
+
+public:
+    LocNmeaTypeTable()
+    {
+        static const struct {
+            const char* id;
+            LocNmeaType type;
+        } sTypes[] = {
+            { "GGA", LOC_NMEA_TYPE_GGA }, { "RMC", LOC_NMEA_TYPE_RMC },
+            { "GSA", LOC_NMEA_TYPE_GSA }, { "GSV", LOC_NMEA_TYPE_GSV },
+            { "VTG", LOC_NMEA_TYPE_VTG }, { "GLL", LOC_NMEA_TYPE_GLL },
+            { "GNS", LOC_NMEA_TYPE_GNS }, { "ZDA", LOC_NMEA_TYPE_ZDA },
+            { "GST", LOC_NMEA_TYPE_GST }, { "DTM", LOC_NMEA_TYPE_DTM },
+        };
+
+        memset(mTypes, LOC_NMEA_TYPE_OTHER, sizeof(mTypes));
+        for (size_t i = 0; i < sizeof(sTypes) / sizeof(sTypes[0]); i++) {
+            mTypes[key(sTypes[i].id)] = sTypes[i].type;
+        }
+    }
+
+    inline LocNmeaType lookup(const char* id) const
+    {
+        if (id[0] < 'A' || id[0] > 'Z' || id[1] < 'A' || id[1] > 'Z' ||
+            id[2] < 'A' || id[2] > 'Z') {
+            return LOC_NMEA_TYPE_OTHER;
+        }
+        return (LocNmeaType)mTypes[key(id)];
+    }
+};
+
+static const LocNmeaTypeTable sTypeTable;
+
+static inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+LocNmeaSplitter::LocNmeaSplitter(const char* buf, uint32_t length) :
+    mPos(buf), mEnd(buf + length), mInvalid(0)
+{
+}
+
+LocNmeaType LocNmeaSplitter::classify(const char* sentence)
+{
+    // $TTFFF: two letter talker then the formatter, proprietary
+    // sentences have P in place of the talker
+    if ('P' == sentence[1]) {
+        return LOC_NMEA_TYPE_PROPRIETARY;
+    }
+    return sTypeTable.lookup(sentence + 3);
+}
+
+bool LocNmeaSplitter::next(LocNmeaSentence& sentence)
+{
+    while (mPos < mEnd) {
+        const char* start = (const char*)memchr(mPos, '$', mEnd - mPos);
+        if (NULL == start) {
+            mPos = mEnd;
+            return false;
+        }
+
+        // checksum covers everything between '$' and '*'
+        const char* p = start + 1;
+        uint8_t checksum = 0;
+        while (p < mEnd && '*' != *p && '$' != *p && '\r' != *p && '\n' != *p &&
+               '\0' != *p) {
+            checksum ^= (uint8_t)*p++;
+        }
+
+        // "*hh" has to follow, and at least the talker and formatter
+        int high = -1;
+        int low = -1;
+        if (p + 3 <= mEnd && '*' == *p && p - start >= 6) {
+            high = hexValue(p[1]);
+            low = hexValue(p[2]);
+        }
+        if (high < 0 || low < 0 || ((high << 4) | low) != checksum) {
+            LOC_LOGV("%s:%d]: dropping invalid sentence %.6s",
+                     __func__, __LINE__, start);
+            mInvalid++;
+            // resume at the next '$', which may be right where we stopped
+            mPos = (p < mEnd && '$' != *p) ? p + 1 : p;
+            continue;
+        }
+
+        p += 3;
+        while (p < mEnd && ('\r' == *p || '\n' == *p)) {
+            p++;
+        }
+        sentence.start = start;
+        sentence.length = (uint32_t)(p - start);
+        sentence.type = classify(start);
+        mPos = p;
+        return true;
+    }
+    return false;
+}
+
+LocNmeaTypeMask LocNmeaSplitter::parseTypeMask(const char* list)
+{
+    LocNmeaTypeMask mask = 0;
+    const char* p = list;
+
+    if (NULL == list || '\0' == list[0] || 0 == strcmp(list, "ALL")) {
+        return LOC_NMEA_TYPE_MASK_ALL;
+    }
+    while ('\0' != *p) {
+        size_t len = strcspn(p, ", ");
+        LocNmeaType type = LOC_NMEA_TYPE_OTHER;
+        if (3 == len) {
+            type = sTypeTable.lookup(p);
+        } else if (1 == len && 'P' == p[0]) {
+            type = LOC_NMEA_TYPE_PROPRIETARY;
+        }
+        // OTHER is what the table gives for anything it does not know
+        if (LOC_NMEA_TYPE_OTHER != type) {
+            mask |= LOC_NMEA_TYPE_MASK(type);
+        } else if (len > 0) {
+            LOC_LOGE("%s:%d]: ignoring unknown NMEA sentence type %.*s",
+                     __func__, __LINE__, (int)len, p);
+        }
+        p += len;
+        p += strspn(p, ", ");
+    }
+    if (0 == mask) {
+        LOC_LOGE("%s:%d]: no known NMEA sentence type in %s, reporting all",
+                 __func__, __LINE__, list);
+        return LOC_NMEA_TYPE_MASK_ALL;
+    }
+    return mask;
+}
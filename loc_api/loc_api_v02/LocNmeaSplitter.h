@@ -0,0 +1,100 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_NMEA_SPLITTER_H
+#define LOC_NMEA_SPLITTER_H
+
+#include <stdint.h>
+
+/* Sentence types NMEA consumers can ask for. Talker ids are ignored,
+   $GPGSV and $GLGSV are both LOC_NMEA_TYPE_GSV. */
+typedef enum {
+    LOC_NMEA_TYPE_GGA = 0,
+    LOC_NMEA_TYPE_RMC,
+    LOC_NMEA_TYPE_GSA,
+    LOC_NMEA_TYPE_GSV,
+    LOC_NMEA_TYPE_VTG,
+    LOC_NMEA_TYPE_GLL,
+    LOC_NMEA_TYPE_GNS,
+    LOC_NMEA_TYPE_ZDA,
+    LOC_NMEA_TYPE_GST,
+    LOC_NMEA_TYPE_DTM,
+    /* $P... vendor sentences */
+    LOC_NMEA_TYPE_PROPRIETARY,
+    LOC_NMEA_TYPE_OTHER,
+    LOC_NMEA_TYPE_COUNT
+} LocNmeaType;
+
+typedef uint32_t LocNmeaTypeMask;
+#define LOC_NMEA_TYPE_MASK(type)  ((LocNmeaTypeMask)1 << (type))
+#define LOC_NMEA_TYPE_MASK_ALL    (LOC_NMEA_TYPE_MASK(LOC_NMEA_TYPE_COUNT) - 1)
+
+struct LocNmeaSentence {
+    /* points into the split buffer, from '$' up to and including the
+       line terminator if there is one */
+    const char* start;
+    uint32_t length;
+    LocNmeaType type;
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocNmeaSplitter
+ *
+ * Functionality:
+ * Walks a buffer holding one or more NMEA sentences, as carried by an
+ * expanded NMEA indication, and returns them one at a time. Checksums
+ * are verified and the type classified in the same pass over the bytes;
+ * sentences that fail are skipped and counted. Nothing is copied.
+ *-------------------------------------------------------------------*/
+class LocNmeaSplitter {
+
+public:
+    LocNmeaSplitter(const char* buf, uint32_t length);
+
+    /* next valid sentence, false once the buffer is used up */
+    bool next(LocNmeaSentence& sentence);
+
+    /* sentences skipped for a bad or missing checksum */
+    inline uint32_t getInvalid() const { return mInvalid; }
+
+    /* type of the sentence starting at '$', which must have at least
+       6 characters */
+    static LocNmeaType classify(const char* sentence);
+
+    /* mask from a list of sentence types like "GGA,RMC,GSV", with P for
+       proprietary sentences. Unknown types are logged and ignored; an
+       empty list, "ALL" or a list without a known type selects every
+       type */
+    static LocNmeaTypeMask parseTypeMask(const char* list);
+
+private:
+    const char* mPos;
+    const char* mEnd;
+    uint32_t mInvalid;
+};
+
+#endif /* LOC_NMEA_SPLITTER_H */
@@ -0,0 +1,177 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_PpsTime"
+
+#include <inttypes.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <LocPpsTime.h>
+#include <loc_pla.h>
+#include <log_util.h>
+
+#define GNSSPPS_LIB_NAME "libgnsspps.so"
+
+#define NSEC_PER_MSEC   (1000000LL)
+#define NSEC_PER_SEC    (1000000000LL)
+
+/* a fit is not extrapolated further than this from its last pulse */
+#define LOC_PPS_MAX_ESTIMATE_AGE_NS (3 * NSEC_PER_SEC)
+
+static inline int64_t timespecToNs(const struct timespec& ts)
+{
+    return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+LocPpsTime::LocPpsTime() :
+    mLibHandle(NULL), mSource(NULL), mOpenFn(NULL), mCloseFn(NULL), mGetEstimateFn(NULL)
+{
+}
+
+LocPpsTime::~LocPpsTime()
+{
+    close();
+}
+
+bool LocPpsTime::open(const char* device)
+{
+    if (NULL != mSource) {
+        return true;
+    }
+
+    if (NULL == mLibHandle) {
+        mLibHandle = dlopen(GNSSPPS_LIB_NAME, RTLD_NOW);
+        if (NULL == mLibHandle) {
+            const char* err = dlerror();
+            LOC_LOGE("%s:%d]: failed to load library %s; error=%s", __func__, __LINE__,
+                     GNSSPPS_LIB_NAME, (NULL == err) ? "Unknown" : err);
+            return false;
+        }
+        mOpenFn = (OpenFn)dlsym(mLibHandle, "openPPSSource");
+        mCloseFn = (CloseFn)dlsym(mLibHandle, "closePPSSource");
+        mGetEstimateFn = (GetEstimateFn)dlsym(mLibHandle, "getPPSSourceEstimate");
+        if (NULL == mOpenFn || NULL == mCloseFn || NULL == mGetEstimateFn) {
+            LOC_LOGE("%s:%d]: %s lacks the PPS source API", __func__, __LINE__,
+                     GNSSPPS_LIB_NAME);
+            dlclose(mLibHandle);
+            mLibHandle = NULL;
+            return false;
+        }
+    }
+
+    mSource = mOpenFn(device);
+    if (NULL == mSource) {
+        LOC_LOGE("%s:%d]: failed to open PPS device %s", __func__, __LINE__, device);
+        return false;
+    }
+    LOC_LOGD("%s:%d]: capturing PPS from %s", __func__, __LINE__, device);
+    return true;
+}
+
+void LocPpsTime::close()
+{
+    if (NULL != mSource) {
+        mCloseFn(mSource);
+        mSource = NULL;
+    }
+    if (NULL != mLibHandle) {
+        dlclose(mLibHandle);
+        mLibHandle = NULL;
+    }
+}
+
+bool LocPpsTime::getEstimate(pps_estimate& estimate)
+{
+    struct timespec now;
+
+    if (NULL == mSource || !mGetEstimateFn(mSource, &estimate) ||
+        clock_gettime(CLOCK_BOOTTIME, &now) != 0) {
+        return false;
+    }
+    return (timespecToNs(now) - timespecToNs(estimate.pulseBoottime) <=
+            LOC_PPS_MAX_ESTIMATE_AGE_NS);
+}
+
+bool LocPpsTime::gnssPhaseToBootTime(double msOfSecond, const struct timespec& refBootTime,
+                                     struct timespec& bootTime, float& uncMs)
+{
+    pps_estimate estimate;
+
+    if (!getEstimate(estimate) || msOfSecond < 0 || msOfSecond >= 1000) {
+        return false;
+    }
+
+    // the same phase in the second that began with the last pulse
+    double pulseNs = (double)timespecToNs(estimate.pulseBoottime);
+    double phaseNs = pulseNs + msOfSecond / 1000.0 * estimate.periodNs;
+    // then whole seconds back or forward to just before the reference
+    double seconds = floor(((double)timespecToNs(refBootTime) - phaseNs) / estimate.periodNs);
+    double resultNs = phaseNs + seconds * estimate.periodNs;
+    double periodsFromPulse = fabs(seconds + msOfSecond / 1000.0);
+
+    if (fabs(resultNs - pulseNs) > LOC_PPS_MAX_ESTIMATE_AGE_NS) {
+        return false;
+    }
+
+    int64_t ns = (int64_t)llround(resultNs);
+    bootTime.tv_sec = ns / NSEC_PER_SEC;
+    bootTime.tv_nsec = ns % NSEC_PER_SEC;
+    uncMs = (float)(sqrt(estimate.offsetUncNs * estimate.offsetUncNs +
+                         periodsFromPulse * periodsFromPulse *
+                         estimate.driftUncPpb * estimate.driftUncPpb) / NSEC_PER_MSEC);
+    return true;
+}
+
+bool LocPpsTime::getUtcTime(int64_t coarseUtcMs, const struct timespec& coarseBootTime,
+                            int64_t coarseUncMs, int64_t& utcMs, float& uncMs)
+{
+    pps_estimate estimate;
+    struct timespec now;
+
+    if (!getEstimate(estimate) || clock_gettime(CLOCK_BOOTTIME, &now) != 0) {
+        return false;
+    }
+
+    // coarse UTC at the last pulse, which marks a whole second
+    int64_t pulseNs = timespecToNs(estimate.pulseBoottime);
+    double coarseAtPulseMs = (double)coarseUtcMs +
+            (double)(pulseNs - timespecToNs(coarseBootTime)) / NSEC_PER_MSEC;
+    int64_t pulseUtcMs = (int64_t)llround(coarseAtPulseMs / 1000.0) * 1000;
+    if (fabs(coarseAtPulseMs - (double)pulseUtcMs) + coarseUncMs >= 500.0) {
+        LOC_LOGD("%s:%d]: coarse time %" PRId64 " +/- %" PRId64 " ms can't label the pulse",
+                 __func__, __LINE__, coarseUtcMs, coarseUncMs);
+        return false;
+    }
+
+    double secondsSincePulse = (double)(timespecToNs(now) - pulseNs) / estimate.periodNs;
+    utcMs = pulseUtcMs + (int64_t)llround(secondsSincePulse * 1000.0);
+    uncMs = (float)(sqrt(estimate.offsetUncNs * estimate.offsetUncNs +
+                         secondsSincePulse * secondsSincePulse *
+                         estimate.driftUncPpb * estimate.driftUncPpb) / NSEC_PER_MSEC);
+    return true;
+}
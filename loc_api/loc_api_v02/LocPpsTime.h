@@ -0,0 +1,85 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_PPS_TIME_H
+#define LOC_PPS_TIME_H
+
+#include <stdint.h>
+#include <time.h>
+#include <gnsspps.h>
+
+/*--------------------------------------------------------------------
+ * CLASS LocPpsTime
+ *
+ * Functionality:
+ * Maps GNSS time onto CLOCK_BOOTTIME with the pulse per second fit of
+ * libgnsspps. The library is loaded at run time, so the adapter works
+ * on targets without it. The pulse is taken to mark the whole GNSS
+ * second.
+ *-------------------------------------------------------------------*/
+class LocPpsTime {
+
+public:
+    LocPpsTime();
+    ~LocPpsTime();
+
+    /* loads libgnsspps and starts capturing from device */
+    bool open(const char* device);
+    void close();
+    inline bool isOpen() const { return NULL != mSource; }
+
+    /* latest usable fit, false if there is none or it is too old */
+    bool getEstimate(pps_estimate& estimate);
+
+    /* Boot time at which GNSS time was msOfSecond into a second, taking
+       the latest such instant at or before refBootTime (e.g. the time
+       the report carrying the GNSS time arrived, less than a second
+       after the measurement). uncMs is the 1-sigma uncertainty of the
+       result, not counting the uncertainty of msOfSecond itself. */
+    bool gnssPhaseToBootTime(double msOfSecond, const struct timespec& refBootTime,
+                             struct timespec& bootTime, float& uncMs);
+
+    /* Current UTC time in ms from the PPS fit. coarseUtcMs, known at
+       coarseBootTime to within coarseUncMs, only labels the UTC second of
+       the last pulse; false if it is not good enough to do that.
+       uncMs is the 1-sigma uncertainty of utcMs. */
+    bool getUtcTime(int64_t coarseUtcMs, const struct timespec& coarseBootTime,
+                    int64_t coarseUncMs, int64_t& utcMs, float& uncMs);
+
+private:
+    typedef pps_source* (*OpenFn)(const char* devname);
+    typedef void (*CloseFn)(pps_source* source);
+    typedef int (*GetEstimateFn)(pps_source* source, pps_estimate* estimate);
+
+    void* mLibHandle;
+    pps_source* mSource;
+    OpenFn mOpenFn;
+    CloseFn mCloseFn;
+    GetEstimateFn mGetEstimateFn;
+};
+
+#endif /* LOC_PPS_TIME_H */
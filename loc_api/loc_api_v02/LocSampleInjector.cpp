@@ -0,0 +1,202 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_SampleInjector"
+
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <LocSampleInjector.h>
+#include <loc_pla.h>
+#include <log_util.h>
+
+#define NSEC_PER_MSEC   (1000000ULL)
+#define NSEC_PER_SEC    (1000000000ULL)
+
+uint64_t LocSampleInjectorBase::getBootTimeNs()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_BOOTTIME, &ts) != 0) {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/*--------------------------------------------------------------------
+ * LocSampleReplay
+ *-------------------------------------------------------------------*/
+LocSampleReplay::LocSampleReplay(const char* path, bool realtime) :
+    mRealtime(realtime), mFile(NULL), mFirstRecordedNs(0), mFirstReplayNs(0)
+{
+    strlcpy(mPath, path, sizeof(mPath));
+}
+
+LocSampleReplay::~LocSampleReplay()
+{
+    close();
+}
+
+bool LocSampleReplay::open()
+{
+    mFile = fopen(mPath, "r");
+    if (NULL == mFile) {
+        LOC_LOGE("%s:%d]: failed to open %s, errno %d", __func__, __LINE__, mPath, errno);
+        return false;
+    }
+    mFirstRecordedNs = 0;
+    return true;
+}
+
+void LocSampleReplay::close()
+{
+    if (NULL != mFile) {
+        fclose(mFile);
+        mFile = NULL;
+    }
+}
+
+bool LocSampleReplay::nextLine(char* line, size_t len)
+{
+    while (NULL != mFile && NULL != fgets(line, len, mFile)) {
+        if ('#' != line[0] && '\n' != line[0]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t LocSampleReplay::getReplayTimeNs(uint64_t recordedNs)
+{
+    if (0 == mFirstRecordedNs) {
+        mFirstRecordedNs = recordedNs;
+        mFirstReplayNs = LocSampleInjectorBase::getBootTimeNs();
+    }
+    return mFirstReplayNs + (recordedNs - mFirstRecordedNs);
+}
+
+bool LocSampleReplay::waitUntil(uint64_t replayNs, int timeoutMs)
+{
+    uint64_t nowNs = LocSampleInjectorBase::getBootTimeNs();
+    if (replayNs <= nowNs) {
+        return true;
+    }
+    if (timeoutMs <= 0) {
+        return false;
+    }
+    uint64_t waitNs = std::min<uint64_t>(replayNs - nowNs, (uint64_t)timeoutMs * NSEC_PER_MSEC);
+    struct timespec ts = { (time_t)(waitNs / NSEC_PER_SEC), (long)(waitNs % NSEC_PER_SEC) };
+    nanosleep(&ts, NULL);
+    return replayNs <= LocSampleInjectorBase::getBootTimeNs();
+}
+
+/*--------------------------------------------------------------------
+ * LocSampleInjectorBase
+ *-------------------------------------------------------------------*/
+LocSampleInjectorBase::LocSampleInjectorBase(const char* name, uint32_t latencyBudgetMs,
+                                             uint32_t batchSize) :
+    mLatencyBudgetMs(latencyBudgetMs), mMessagesSent(0), mSamplesSent(0),
+    mBatchSize(batchSize), mRunning(false)
+{
+    snprintf(mReaderName, sizeof(mReaderName), "Loc%sRead", name);
+    snprintf(mSenderName, sizeof(mSenderName), "Loc%sSend", name);
+}
+
+bool LocSampleInjectorBase::start()
+{
+    if (mRunning) {
+        return true;
+    }
+    if (!openSource()) {
+        LOC_LOGE("%s:%d]: %s failed to open source", __func__, __LINE__, mReaderName);
+        return false;
+    }
+
+    onStart();
+    mRunning = true;
+    if (!mSenderThread.start(mSenderName, new Sender(this)) ||
+        !mReaderThread.start(mReaderName, new Reader(this))) {
+        LOC_LOGE("%s:%d]: failed to start threads", __func__, __LINE__);
+        stop();
+        return false;
+    }
+    LOC_LOGD("%s:%d]: %s latency budget %u ms", __func__, __LINE__,
+             mSenderName, mLatencyBudgetMs);
+    return true;
+}
+
+void LocSampleInjectorBase::stop()
+{
+    if (!mRunning.exchange(false)) {
+        return;
+    }
+    mWakeCond.notify_one();
+    mReaderThread.stop();
+    mSenderThread.stop();
+    closeSource();
+
+    // hand the tail of the stream to the engine
+    drainRing();
+    sendBatch();
+
+    LOC_LOGD("%s:%d]: %s messages %" PRIu64 " samples %" PRIu64 " dropped %" PRIu64,
+             __func__, __LINE__, mSenderName, mMessagesSent, mSamplesSent,
+             getSamplesDropped());
+}
+
+bool LocSampleInjectorBase::Reader::run()
+{
+    if (mInjector->readSource() < 0) {
+        LOC_LOGD("%s:%d]: %s source finished", __func__, __LINE__, mInjector->mReaderName);
+        return false;
+    }
+    // wake the sender early once a full batch is waiting
+    if (mInjector->getSamplesQueued() >= mInjector->mBatchSize) {
+        mInjector->mWakeCond.notify_one();
+    }
+    return mInjector->mRunning;
+}
+
+bool LocSampleInjectorBase::Sender::run()
+{
+    {
+        std::unique_lock<std::mutex> lock(mInjector->mWakeMutex);
+        mInjector->mWakeCond.wait_for(lock,
+                std::chrono::milliseconds(mInjector->mLatencyBudgetMs / 2 + 1));
+    }
+    if (!mInjector->mRunning) {
+        return false;
+    }
+
+    mInjector->drainRing();
+    if (mInjector->isBatchDue(getBootTimeNs())) {
+        mInjector->sendBatch();
+    }
+    return true;
+}
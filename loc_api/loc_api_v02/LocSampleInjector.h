@@ -0,0 +1,342 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_SAMPLE_INJECTOR_H
+#define LOC_SAMPLE_INJECTOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <LocThread.h>
+#include <LocSampleRing.h>
+
+/* samples moved per source read / ring pop */
+#define LOC_SAMPLE_CHUNK_SIZE      (32)
+/* max time a source read blocks, bounds the stop latency */
+#define LOC_SAMPLE_READ_TIMEOUT_MS (100)
+
+/*--------------------------------------------------------------------
+ * CLASS LocSampleSource
+ *
+ * Functionality:
+ * Pluggable source of samples of type S.
+ *-------------------------------------------------------------------*/
+template <typename S>
+class LocSampleSource {
+
+public:
+    virtual ~LocSampleSource() {}
+
+    /* Prepare the source, returns false on failure */
+    virtual bool open() = 0;
+
+    /* Read up to max samples, waiting at most timeoutMs for the first.
+       Returns the number of samples read, 0 on timeout, -1 if the
+       source is exhausted or failed. */
+    virtual int read(S* samples, int max, int timeoutMs) = 0;
+
+    virtual void close() = 0;
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocSampleReplay
+ *
+ * Functionality:
+ * Recorded sample file and its mapping onto the current boot time.
+ * The first recorded timestamp is replayed now, later ones keep
+ * their spacing to it.
+ *-------------------------------------------------------------------*/
+class LocSampleReplay {
+
+public:
+    LocSampleReplay(const char* path, bool realtime);
+    ~LocSampleReplay();
+
+    bool open();
+    void close();
+    inline bool isOpen() const { return NULL != mFile; }
+    inline bool isRealtime() const { return mRealtime; }
+
+    /* next line that is not empty or a # comment, false at end of file */
+    bool nextLine(char* line, size_t len);
+
+    /* boot time a sample recorded at recordedNs is replayed at */
+    uint64_t getReplayTimeNs(uint64_t recordedNs);
+
+    /* sleep until replayNs but at most timeoutMs, false if not due yet */
+    bool waitUntil(uint64_t replayNs, int timeoutMs);
+
+private:
+    char mPath[256];
+    bool mRealtime;
+    FILE* mFile;
+    /* first recorded timestamp, and the boot time it is replayed at */
+    uint64_t mFirstRecordedNs;
+    uint64_t mFirstReplayNs;
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocFileSampleSource
+ *
+ * Functionality:
+ * Replays samples recorded in a text file, one sample per line. The
+ * line format and the field stamped with the replay time are up to
+ * the derived class. In realtime mode the original sample spacing is
+ * kept, otherwise samples are delivered as fast as they are read.
+ *-------------------------------------------------------------------*/
+template <typename S>
+class LocFileSampleSource : public LocSampleSource<S> {
+
+public:
+    virtual ~LocFileSampleSource() { close(); }
+
+    virtual bool open() {
+        mHasPending = false;
+        return mReplay.open();
+    }
+
+    virtual int read(S* samples, int max, int timeoutMs) {
+        int count = 0;
+
+        if (!mReplay.isOpen()) {
+            return -1;
+        }
+
+        while (count < max) {
+            if (!mHasPending) {
+                if (!readSample()) {
+                    // end of file, hand out what we have first
+                    return (count > 0) ? count : -1;
+                }
+                mHasPending = true;
+            }
+
+            if (mReplay.isRealtime() && !mReplay.waitUntil(mPendingReplayNs,
+                                                           (count > 0) ? 0 : timeoutMs)) {
+                break;
+            }
+
+            setReplayTime(mPending, mPendingReplayNs);
+            samples[count++] = mPending;
+            mHasPending = false;
+        }
+        return count;
+    }
+
+    virtual void close() { mReplay.close(); }
+
+protected:
+    LocFileSampleSource(const char* path, bool realtime) :
+        mReplay(path, realtime), mHasPending(false), mPending(), mPendingReplayNs(0) {}
+
+    inline bool isRealtime() const { return mReplay.isRealtime(); }
+
+    /* Parse one line into sample and the timestamp it was recorded at.
+       Returns false to skip the line. */
+    virtual bool parseLine(const char* line, S& sample, uint64_t& recordedNs) = 0;
+
+    /* Stamp sample with the boot time it is replayed at */
+    virtual void setReplayTime(S& sample, uint64_t replayNs) = 0;
+
+private:
+    LocSampleReplay mReplay;
+    bool mHasPending;
+    S mPending;
+    uint64_t mPendingReplayNs;
+
+    bool readSample() {
+        char line[256];
+        uint64_t recordedNs;
+
+        while (mReplay.nextLine(line, sizeof(line))) {
+            if (parseLine(line, mPending, recordedNs)) {
+                mPendingReplayNs = mReplay.getReplayTimeNs(recordedNs);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocSampleInjectorBase
+ *
+ * Functionality:
+ * Thread scaffolding shared by the sample injectors.
+ * - A reader thread pulls samples from the source into a lock-free
+ *   ring, so source jitter never stalls the sender and vice versa.
+ * - A sender thread wakes at least twice per latency budget, or as
+ *   soon as a full batch is waiting, moves the ring into the staging
+ *   of the derived class and sends once a batch is due.
+ * - stop() joins both threads and sends whatever is still staged.
+ * The derived class must call stop() from its own destructor, the
+ * final batch is sent through its sendBatch().
+ *-------------------------------------------------------------------*/
+class LocSampleInjectorBase {
+
+public:
+    virtual ~LocSampleInjectorBase() {}
+
+    bool start();
+    void stop();
+
+    /* statistics */
+    inline uint64_t getMessagesSent() const { return mMessagesSent; }
+    inline uint64_t getSamplesSent() const { return mSamplesSent; }
+    virtual uint64_t getSamplesDropped() const = 0;
+
+    /* current CLOCK_BOOTTIME in nanoseconds, 0 on failure. This is
+       the time base of every injected sample */
+    static uint64_t getBootTimeNs();
+
+protected:
+    /* name is used for the thread names, e.g. "Sensor" gives
+       LocSensorRead and LocSensorSend. batchSize is the ring fill at
+       which the sender is woken early */
+    LocSampleInjectorBase(const char* name, uint32_t latencyBudgetMs, uint32_t batchSize);
+
+    uint32_t mLatencyBudgetMs;
+    /* sender thread only */
+    uint64_t mMessagesSent;
+    uint64_t mSamplesSent;
+
+    /* called by start() before the threads run */
+    virtual void onStart() {}
+
+    virtual bool openSource() = 0;
+    virtual void closeSource() = 0;
+
+    /* reader thread: move one chunk from the source into the ring.
+       Returns the number of samples moved, -1 once the source is done */
+    virtual int readSource() = 0;
+    virtual uint32_t getSamplesQueued() const = 0;
+
+    /* sender thread: move the ring into the staging, sending
+       whatever does not fit */
+    virtual void drainRing() = 0;
+    virtual bool isBatchDue(uint64_t nowNs) const = 0;
+    /* pack everything staged into one request and send it */
+    virtual void sendBatch() = 0;
+
+private:
+    /* new'ed by start(), owned and deleted by their LocThread */
+    class Reader : public LocRunnable {
+        LocSampleInjectorBase* mInjector;
+    public:
+        inline Reader(LocSampleInjectorBase* injector) : mInjector(injector) {}
+        virtual bool run();
+    };
+    class Sender : public LocRunnable {
+        LocSampleInjectorBase* mInjector;
+    public:
+        inline Sender(LocSampleInjectorBase* injector) : mInjector(injector) {}
+        virtual bool run();
+    };
+
+    char mReaderName[16];
+    char mSenderName[16];
+    uint32_t mBatchSize;
+    std::atomic<bool> mRunning;
+    std::mutex mWakeMutex;
+    std::condition_variable mWakeCond;
+    LocThread mReaderThread;
+    LocThread mSenderThread;
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocSampleInjector
+ *
+ * Functionality:
+ * Connects a LocSampleSource<S> to the sender through a ring of R.
+ * The derived class turns each S into an R on the reader thread and
+ * stages the R on the sender thread.
+ *-------------------------------------------------------------------*/
+template <typename S, typename R>
+class LocSampleInjector : public LocSampleInjectorBase {
+
+public:
+    virtual ~LocSampleInjector() { delete mSource; }
+
+    virtual uint64_t getSamplesDropped() const { return mRing.dropped(); }
+
+protected:
+    /* source is owned by the injector from here on */
+    LocSampleInjector(const char* name, LocSampleSource<S>* source, uint32_t latencyBudgetMs,
+                      uint32_t ringCapacity, uint32_t batchSize) :
+        LocSampleInjectorBase(name, latencyBudgetMs, batchSize),
+        mSource(source), mRing(ringCapacity) {}
+
+    /* reader thread: sample as read at nowNs, to be queued as out */
+    virtual void receive(const S& sample, uint64_t nowNs, R& out) = 0;
+    /* sender thread: add one sample to the staging */
+    virtual void stage(const R& sample) = 0;
+
+private:
+    LocSampleSource<S>* mSource;
+    LocSampleRing<R> mRing;
+
+    virtual bool openSource() {
+        return NULL != mSource && mSource->open();
+    }
+
+    virtual void closeSource() {
+        mSource->close();
+    }
+
+    virtual int readSource() {
+        S samples[LOC_SAMPLE_CHUNK_SIZE];
+
+        int count = mSource->read(samples, LOC_SAMPLE_CHUNK_SIZE, LOC_SAMPLE_READ_TIMEOUT_MS);
+        uint64_t nowNs = getBootTimeNs();
+        for (int i = 0; i < count; i++) {
+            R out;
+            receive(samples[i], nowNs, out);
+            mRing.push(out);
+        }
+        return count;
+    }
+
+    virtual uint32_t getSamplesQueued() const {
+        return mRing.size();
+    }
+
+    virtual void drainRing() {
+        R samples[LOC_SAMPLE_CHUNK_SIZE];
+        uint32_t count;
+
+        while ((count = mRing.pop(samples, LOC_SAMPLE_CHUNK_SIZE)) > 0) {
+            for (uint32_t i = 0; i < count; i++) {
+                stage(samples[i]);
+            }
+        }
+    }
+};
+
+#endif /* LOC_SAMPLE_INJECTOR_H */
@@ -0,0 +1,113 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_SAMPLE_RING_H
+#define LOC_SAMPLE_RING_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/*--------------------------------------------------------------------
+ * CLASS LocSampleRing
+ *
+ * Functionality:
+ * Bounded lock-free ring buffer with a single producer and a single
+ * consumer. Used to decouple a sample source thread from the thread
+ * that sends the samples to the engine, so that neither side ever
+ * blocks on the other. If the consumer falls behind, new samples are
+ * dropped and counted.
+ *-------------------------------------------------------------------*/
+template <typename T>
+class LocSampleRing {
+
+public:
+    /* capacity is rounded up to a power of 2 */
+    explicit LocSampleRing(uint32_t capacity) :
+        mMask(roundUpPow2(capacity) - 1), mBuffer(mMask + 1),
+        mHead(0), mTail(0), mDropped(0) {}
+
+    /* Producer side.
+       Returns false, and drops the sample, if the ring is full. */
+    inline bool push(const T& sample) {
+        uint32_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) > mMask) {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        mBuffer[head & mMask] = sample;
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side.
+       Moves up to max samples, oldest first, into out.
+       Returns the number of samples moved. */
+    inline uint32_t pop(T* out, uint32_t max) {
+        uint32_t tail = mTail.load(std::memory_order_relaxed);
+        uint32_t count = mHead.load(std::memory_order_acquire) - tail;
+        if (count > max) {
+            count = max;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            out[i] = mBuffer[(tail + i) & mMask];
+        }
+        mTail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /* Number of samples pending, may be called from either side */
+    inline uint32_t size() const {
+        return mHead.load(std::memory_order_acquire) -
+               mTail.load(std::memory_order_acquire);
+    }
+
+    inline uint32_t capacity() const { return mMask + 1; }
+
+    inline uint64_t dropped() const {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    static inline uint32_t roundUpPow2(uint32_t v) {
+        uint32_t p = 1;
+        while (p < v) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    const uint32_t mMask;
+    std::vector<T> mBuffer;
+    /* free running indexes, head is written by the producer only and
+       tail by the consumer only */
+    std::atomic<uint32_t> mHead;
+    std::atomic<uint32_t> mTail;
+    std::atomic<uint64_t> mDropped;
+};
+
+#endif /* LOC_SAMPLE_RING_H */
@@ -0,0 +1,509 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_SensorInjector"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
+#include <vector>
+#include <LocSensorInjector.h>
+#include <loc_pla.h>
+#include <log_util.h>
+
+#define NSEC_PER_MSEC   (1000000ULL)
+
+/* ring size in samples, a few seconds of accel + gyro at 200 Hz */
+#define SENSOR_RING_CAPACITY      (2048)
+/* time offsets are uint16 milliseconds */
+#define SENSOR_MAX_TIME_OFFSET_MS (0xFFFF)
+
+#define IIO_SYSFS_DEVICE_PATH     "/sys/bus/iio/devices/iio:device%d/%s"
+#define IIO_DEV_PATH              "/dev/iio:device%d"
+#define IIO_BUFFER_LENGTH         "128"
+
+/*--------------------------------------------------------------------
+ * LocFileSensorSource
+ *-------------------------------------------------------------------*/
+bool LocFileSensorSource::parseLine(const char* line, LocSensorSample& sample,
+                                    uint64_t& recordedNs)
+{
+    char type[16];
+
+    memset(&sample, 0, sizeof(sample));
+    int fields = sscanf(line, "%15s %" SCNu64 " %f %f %f", type, &recordedNs,
+                        &sample.x, &sample.y, &sample.z);
+    if (fields < 3) {
+        LOC_LOGW("%s:%d]: skipping malformed line: %s", __func__, __LINE__, line);
+        return false;
+    }
+    if (0 == strcmp(type, "accel")) {
+        sample.type = LOC_SENSOR_TYPE_ACCEL;
+    } else if (0 == strcmp(type, "gyro")) {
+        sample.type = LOC_SENSOR_TYPE_GYRO;
+    } else if (0 == strcmp(type, "accel_temp")) {
+        sample.type = LOC_SENSOR_TYPE_ACCEL_TEMPERATURE;
+    } else if (0 == strcmp(type, "gyro_temp")) {
+        sample.type = LOC_SENSOR_TYPE_GYRO_TEMPERATURE;
+    } else {
+        LOC_LOGW("%s:%d]: unknown sensor type %s", __func__, __LINE__, type);
+        return false;
+    }
+    return true;
+}
+
+/* rebase to the current boot time */
+void LocFileSensorSource::setReplayTime(LocSensorSample& sample, uint64_t replayNs)
+{
+    sample.timestampNs = replayNs;
+}
+
+/*--------------------------------------------------------------------
+ * LocIioSensorSource
+ *-------------------------------------------------------------------*/
+LocIioSensorSource::LocIioSensorSource(int deviceIndex, LocSensorType type) :
+    mDeviceIndex(deviceIndex), mType(type), mFd(-1), mScanBytes(0), mScale(1.0f)
+{
+    memset(mChannels, 0, sizeof(mChannels));
+}
+
+LocIioSensorSource::~LocIioSensorSource()
+{
+    close();
+}
+
+bool LocIioSensorSource::writeSysfs(const char* relPath, const char* value)
+{
+    char path[128];
+    snprintf(path, sizeof(path), IIO_SYSFS_DEVICE_PATH, mDeviceIndex, relPath);
+
+    int fd = ::open(path, O_WRONLY);
+    if (fd < 0) {
+        LOC_LOGW("%s:%d]: failed to open %s, errno %d", __func__, __LINE__, path, errno);
+        return false;
+    }
+    ssize_t len = strlen(value);
+    bool ret = (write(fd, value, len) == len);
+    ::close(fd);
+    return ret;
+}
+
+bool LocIioSensorSource::readSysfs(const char* relPath, char* value, size_t len)
+{
+    char path[128];
+    snprintf(path, sizeof(path), IIO_SYSFS_DEVICE_PATH, mDeviceIndex, relPath);
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t n = ::read(fd, value, len - 1);
+    ::close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    value[n] = '\0';
+    return true;
+}
+
+/* read index and type ("le:s16/16>>0") of a scan element */
+bool LocIioSensorSource::readChannel(const char* name, Channel& channel)
+{
+    char relPath[96];
+    char value[32];
+    char endian = 'l';
+    char sign = 's';
+    unsigned int bits = 0, storageBits = 0, shift = 0, repeat = 0;
+
+    snprintf(relPath, sizeof(relPath), "scan_elements/%s_index", name);
+    if (!readSysfs(relPath, value, sizeof(value))) {
+        return false;
+    }
+    channel.index = atoi(value);
+
+    snprintf(relPath, sizeof(relPath), "scan_elements/%s_type", name);
+    if (!readSysfs(relPath, value, sizeof(value))) {
+        return false;
+    }
+    if (5 != sscanf(value, "%ce:%c%u/%u>>%u", &endian, &sign, &bits, &storageBits, &shift) &&
+        6 != sscanf(value, "%ce:%c%u/%uX%u>>%u", &endian, &sign, &bits, &storageBits,
+                    &repeat, &shift)) {
+        LOC_LOGE("%s:%d]: unknown scan type %s for %s", __func__, __LINE__, value, name);
+        return false;
+    }
+    if (storageBits == 0 || storageBits > 64 || (storageBits % 8) != 0 || bits > storageBits) {
+        LOC_LOGE("%s:%d]: unsupported scan type %s for %s", __func__, __LINE__, value, name);
+        return false;
+    }
+    channel.storageBytes = storageBits / 8;
+    channel.bits = bits;
+    channel.shift = shift;
+    channel.isSigned = ('s' == sign);
+    channel.isBigEndian = ('b' == endian);
+    return true;
+}
+
+/* work out the byte offset of our channels from all enabled scan
+   elements, each element is aligned to its own storage size */
+bool LocIioSensorSource::setupScanLayout()
+{
+    const char* prefix = (LOC_SENSOR_TYPE_GYRO == mType) ? "in_anglvel" : "in_accel";
+    char names[CHAN_MAX][32];
+    snprintf(names[CHAN_X], sizeof(names[CHAN_X]), "%s_x", prefix);
+    snprintf(names[CHAN_Y], sizeof(names[CHAN_Y]), "%s_y", prefix);
+    snprintf(names[CHAN_Z], sizeof(names[CHAN_Z]), "%s_z", prefix);
+    strlcpy(names[CHAN_TIMESTAMP], "in_timestamp", sizeof(names[CHAN_TIMESTAMP]));
+
+    std::vector<Channel> enabled;
+    char dirPath[128];
+    snprintf(dirPath, sizeof(dirPath), IIO_SYSFS_DEVICE_PATH, mDeviceIndex, "scan_elements");
+    DIR* dir = opendir(dirPath);
+    if (NULL == dir) {
+        LOC_LOGE("%s:%d]: failed to open %s", __func__, __LINE__, dirPath);
+        return false;
+    }
+    struct dirent* entry;
+    while (NULL != (entry = readdir(dir))) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 3 || 0 != strcmp(entry->d_name + len - 3, "_en") || len >= 64) {
+            continue;
+        }
+        char relPath[96];
+        char value[8];
+        snprintf(relPath, sizeof(relPath), "scan_elements/%s", entry->d_name);
+        if (!readSysfs(relPath, value, sizeof(value)) || '1' != value[0]) {
+            continue;
+        }
+        char name[64];
+        strlcpy(name, entry->d_name, len - 2);
+        Channel channel;
+        if (readChannel(name, channel)) {
+            enabled.push_back(channel);
+        }
+    }
+    closedir(dir);
+
+    std::sort(enabled.begin(), enabled.end(),
+              [](const Channel& a, const Channel& b) { return a.index < b.index; });
+
+    uint32_t offset = 0;
+    uint32_t maxStorage = 1;
+    for (size_t i = 0; i < enabled.size(); i++) {
+        uint32_t size = enabled[i].storageBytes;
+        offset = (offset + size - 1) / size * size;
+        enabled[i].offset = offset;
+        offset += size;
+        maxStorage = std::max(maxStorage, size);
+    }
+    mScanBytes = (offset + maxStorage - 1) / maxStorage * maxStorage;
+
+    for (int c = 0; c < CHAN_MAX; c++) {
+        Channel wanted;
+        if (!readChannel(names[c], wanted)) {
+            LOC_LOGE("%s:%d]: channel %s not available", __func__, __LINE__, names[c]);
+            return false;
+        }
+        bool found = false;
+        for (size_t i = 0; i < enabled.size() && !found; i++) {
+            if (enabled[i].index == wanted.index) {
+                mChannels[c] = enabled[i];
+                found = true;
+            }
+        }
+        if (!found) {
+            LOC_LOGE("%s:%d]: channel %s not enabled", __func__, __LINE__, names[c]);
+            return false;
+        }
+    }
+
+    LOC_LOGD("%s:%d]: iio:device%d %s scan size %u", __func__, __LINE__,
+             mDeviceIndex, prefix, mScanBytes);
+    return mScanBytes > 0;
+}
+
+bool LocIioSensorSource::open()
+{
+    const char* prefix = (LOC_SENSOR_TYPE_GYRO == mType) ? "in_anglvel" : "in_accel";
+    char relPath[96];
+    char value[32];
+
+    if (LOC_SENSOR_TYPE_ACCEL != mType && LOC_SENSOR_TYPE_GYRO != mType) {
+        LOC_LOGE("%s:%d]: unsupported sensor type %d", __func__, __LINE__, mType);
+        return false;
+    }
+
+    // the buffer has to be disabled while the scan elements change
+    writeSysfs("buffer/enable", "0");
+    writeSysfs("current_timestamp_clock", "boottime");
+
+    static const char* const axes[] = { "x", "y", "z" };
+    for (int i = 0; i < 3; i++) {
+        snprintf(relPath, sizeof(relPath), "scan_elements/%s_%s_en", prefix, axes[i]);
+        writeSysfs(relPath, "1");
+    }
+    writeSysfs("scan_elements/in_timestamp_en", "1");
+
+    snprintf(relPath, sizeof(relPath), "%s_scale", prefix);
+    if (!readSysfs(relPath, value, sizeof(value))) {
+        snprintf(relPath, sizeof(relPath), "%s_x_scale", prefix);
+        if (!readSysfs(relPath, value, sizeof(value))) {
+            strlcpy(value, "1.0", sizeof(value));
+        }
+    }
+    mScale = strtof(value, NULL);
+
+    if (!setupScanLayout()) {
+        return false;
+    }
+
+    writeSysfs("buffer/length", IIO_BUFFER_LENGTH);
+    if (!writeSysfs("buffer/enable", "1")) {
+        LOC_LOGE("%s:%d]: failed to enable iio:device%d buffer",
+                 __func__, __LINE__, mDeviceIndex);
+        return false;
+    }
+
+    char devPath[32];
+    snprintf(devPath, sizeof(devPath), IIO_DEV_PATH, mDeviceIndex);
+    mFd = ::open(devPath, O_RDONLY | O_NONBLOCK);
+    if (mFd < 0) {
+        LOC_LOGE("%s:%d]: failed to open %s, errno %d", __func__, __LINE__, devPath, errno);
+        writeSysfs("buffer/enable", "0");
+        return false;
+    }
+    return true;
+}
+
+void LocIioSensorSource::close()
+{
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+        writeSysfs("buffer/enable", "0");
+    }
+}
+
+int64_t LocIioSensorSource::extract(const uint8_t* scan, const Channel& channel)
+{
+    const uint8_t* p = scan + channel.offset;
+    uint64_t raw = 0;
+
+    for (uint32_t i = 0; i < channel.storageBytes; i++) {
+        if (channel.isBigEndian) {
+            raw = (raw << 8) | p[i];
+        } else {
+            raw |= (uint64_t)p[i] << (8 * i);
+        }
+    }
+    raw >>= channel.shift;
+    if (channel.bits < 64) {
+        uint64_t mask = (1ULL << channel.bits) - 1;
+        raw &= mask;
+        if (channel.isSigned && (raw & (1ULL << (channel.bits - 1)))) {
+            raw |= ~mask;
+        }
+    }
+    return (int64_t)raw;
+}
+
+int LocIioSensorSource::read(LocSensorSample* samples, int max, int timeoutMs)
+{
+    uint8_t buf[2048];
+
+    if (mFd < 0 || 0 == mScanBytes) {
+        return -1;
+    }
+
+    struct pollfd pfd = { mFd, POLLIN, 0 };
+    int ret = poll(&pfd, 1, timeoutMs);
+    if (ret <= 0) {
+        return (ret < 0 && EINTR != errno) ? -1 : 0;
+    }
+
+    size_t scans = std::min<size_t>(max, sizeof(buf) / mScanBytes);
+    ssize_t len = ::read(mFd, buf, scans * mScanBytes);
+    if (len < 0) {
+        return (EAGAIN == errno || EINTR == errno) ? 0 : -1;
+    }
+
+    int count = 0;
+    for (ssize_t off = 0; off + (ssize_t)mScanBytes <= len; off += mScanBytes) {
+        const uint8_t* scan = buf + off;
+        LocSensorSample& sample = samples[count++];
+        sample.type = mType;
+        sample.timestampNs = (uint64_t)extract(scan, mChannels[CHAN_TIMESTAMP]);
+        sample.x = extract(scan, mChannels[CHAN_X]) * mScale;
+        sample.y = extract(scan, mChannels[CHAN_Y]) * mScale;
+        sample.z = extract(scan, mChannels[CHAN_Z]) * mScale;
+    }
+    return count;
+}
+
+/*--------------------------------------------------------------------
+ * LocSensorInjector
+ *-------------------------------------------------------------------*/
+LocSensorInjector::LocSensorInjector(LocSensorSource* source,
+                                     const LocSensorDataSender& sender,
+                                     uint32_t latencyBudgetMs) :
+    LocSampleInjector<LocSensorSample, LocSensorSample>("Sensor", source, latencyBudgetMs,
+            SENSOR_RING_CAPACITY, QMI_LOC_SENSOR_DATA_MAX_SAMPLES_V02),
+    mSendFn(sender), mOpaqueId(0)
+{
+    memset(mStaging, 0, sizeof(mStaging));
+    memset(&mReq, 0, sizeof(mReq));
+}
+
+LocSensorInjector::~LocSensorInjector()
+{
+    stop();
+}
+
+void LocSensorInjector::receive(const LocSensorSample& sample, uint64_t /*nowNs*/,
+                                LocSensorSample& out)
+{
+    out = sample;
+}
+
+/* stage one sample, sending first if its time offset would overflow
+   and right after if its type is full */
+void LocSensorInjector::stage(const LocSensorSample& sample)
+{
+    if (sample.type >= LOC_SENSOR_TYPE_MAX) {
+        return;
+    }
+    Staging& staging = mStaging[sample.type];
+    if (staging.count > 0) {
+        uint64_t firstNs = staging.samples[0].timestampNs;
+        if (sample.timestampNs < firstNs ||
+            (sample.timestampNs - firstNs) / NSEC_PER_MSEC > SENSOR_MAX_TIME_OFFSET_MS) {
+            sendBatch();
+        }
+    }
+    staging.samples[staging.count++] = sample;
+    if (QMI_LOC_SENSOR_DATA_MAX_SAMPLES_V02 == staging.count) {
+        sendBatch();
+    }
+}
+
+bool LocSensorInjector::isBatchDue(uint64_t nowNs) const
+{
+    for (int t = 0; t < LOC_SENSOR_TYPE_MAX; t++) {
+        const Staging& staging = mStaging[t];
+        if (staging.count > 0 &&
+            nowNs >= staging.samples[0].timestampNs +
+                     (uint64_t)mLatencyBudgetMs * NSEC_PER_MSEC) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void fill3AxisList(qmiLoc3AxisSensorSampleListStructT_v02& list,
+                          const LocSensorSample* samples, uint32_t count)
+{
+    uint64_t firstNs = samples[0].timestampNs;
+
+    list.timeOfFirstSample = (uint32_t)(firstNs / NSEC_PER_MSEC);
+    list.flags = 0;
+    list.sensorData_len = count;
+    for (uint32_t i = 0; i < count; i++) {
+        list.sensorData[i].timeOffset =
+                (uint16_t)((samples[i].timestampNs - firstNs) / NSEC_PER_MSEC);
+        list.sensorData[i].xAxis = samples[i].x;
+        list.sensorData[i].yAxis = samples[i].y;
+        list.sensorData[i].zAxis = samples[i].z;
+    }
+}
+
+static void fillTemperatureList(qmiLocSensorTemperatureSampleListStructT_v02& list,
+                                const LocSensorSample* samples, uint32_t count)
+{
+    uint64_t firstNs = samples[0].timestampNs;
+
+    list.timeSource = eQMI_LOC_SENSOR_TIME_SOURCE_UNSPECIFIED_V02;
+    list.timeOfFirstSample = (uint32_t)(firstNs / NSEC_PER_MSEC);
+    list.temperatureData_len = count;
+    for (uint32_t i = 0; i < count; i++) {
+        list.temperatureData[i].timeOffset =
+                (uint16_t)((samples[i].timestampNs - firstNs) / NSEC_PER_MSEC);
+        list.temperatureData[i].temperature = samples[i].x;
+    }
+}
+
+/* pack everything staged into one request and send it */
+void LocSensorInjector::sendBatch()
+{
+    uint32_t total = 0;
+
+    memset(&mReq, 0, sizeof(mReq));
+    mReq.opaqueIdentifier_valid = 1;
+    mReq.opaqueIdentifier = ++mOpaqueId;
+
+    Staging& accel = mStaging[LOC_SENSOR_TYPE_ACCEL];
+    if (accel.count > 0) {
+        mReq.threeAxisAccelData_valid = 1;
+        fill3AxisList(mReq.threeAxisAccelData, accel.samples, accel.count);
+    }
+    Staging& gyro = mStaging[LOC_SENSOR_TYPE_GYRO];
+    if (gyro.count > 0) {
+        mReq.threeAxisGyroData_valid = 1;
+        fill3AxisList(mReq.threeAxisGyroData, gyro.samples, gyro.count);
+    }
+    Staging& accelTemp = mStaging[LOC_SENSOR_TYPE_ACCEL_TEMPERATURE];
+    if (accelTemp.count > 0) {
+        mReq.accelTemperatureData_valid = 1;
+        fillTemperatureList(mReq.accelTemperatureData, accelTemp.samples, accelTemp.count);
+    }
+    Staging& gyroTemp = mStaging[LOC_SENSOR_TYPE_GYRO_TEMPERATURE];
+    if (gyroTemp.count > 0) {
+        mReq.gyroTemperatureData_valid = 1;
+        fillTemperatureList(mReq.gyroTemperatureData, gyroTemp.samples, gyroTemp.count);
+    }
+
+    for (int t = 0; t < LOC_SENSOR_TYPE_MAX; t++) {
+        total += mStaging[t].count;
+        mStaging[t].count = 0;
+    }
+    if (0 == total) {
+        return;
+    }
+
+    if (mSendFn(mReq)) {
+        mMessagesSent++;
+        mSamplesSent += total;
+    } else {
+        LOC_LOGE("%s:%d]: failed to send %u samples, id %u",
+                 __func__, __LINE__, total, mOpaqueId);
+    }
+}
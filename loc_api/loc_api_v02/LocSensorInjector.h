@@ -0,0 +1,172 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_SENSOR_INJECTOR_H
+#define LOC_SENSOR_INJECTOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <LocSampleInjector.h>
+#include <location_service_v02.h>
+
+/* Sensor sample types that can be injected */
+typedef enum {
+    LOC_SENSOR_TYPE_ACCEL = 0,
+    LOC_SENSOR_TYPE_GYRO,
+    LOC_SENSOR_TYPE_ACCEL_TEMPERATURE,
+    LOC_SENSOR_TYPE_GYRO_TEMPERATURE,
+    LOC_SENSOR_TYPE_MAX
+} LocSensorType;
+
+/* One sensor sample
+ * accel in m/s^2, gyro in rad/s, temperature in degrees Celsius (x only) */
+struct LocSensorSample {
+    LocSensorType type;
+    /* CLOCK_BOOTTIME of the sample */
+    uint64_t timestampNs;
+    float x;
+    float y;
+    float z;
+};
+
+/* Pluggable source of AP side sensor samples */
+typedef LocSampleSource<LocSensorSample> LocSensorSource;
+
+/*--------------------------------------------------------------------
+ * CLASS LocFileSensorSource
+ *
+ * Functionality:
+ * Replays samples recorded in a text file, one sample per line:
+ *   <accel|gyro|accel_temp|gyro_temp> <timestamp ns> <x> [<y> <z>]
+ * Timestamps are rebased to the current CLOCK_BOOTTIME.
+ *-------------------------------------------------------------------*/
+class LocFileSensorSource : public LocFileSampleSource<LocSensorSample> {
+
+public:
+    inline LocFileSensorSource(const char* path, bool realtime) :
+        LocFileSampleSource<LocSensorSample>(path, realtime) {}
+
+protected:
+    virtual bool parseLine(const char* line, LocSensorSample& sample, uint64_t& recordedNs);
+    virtual void setReplayTime(LocSensorSample& sample, uint64_t replayNs);
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocIioSensorSource
+ *
+ * Functionality:
+ * Reads 3-axis samples from a Linux IIO buffer, e.g.
+ *   /sys/bus/iio/devices/iio:device0 with channels in_accel_{x,y,z}
+ *   or in_anglvel_{x,y,z} and in_timestamp.
+ * The scan element layout, index, type and scale are taken from sysfs.
+ * The timestamp channel is switched to CLOCK_BOOTTIME.
+ *-------------------------------------------------------------------*/
+class LocIioSensorSource : public LocSensorSource {
+
+public:
+    /* deviceIndex: N of iio:deviceN
+       type: LOC_SENSOR_TYPE_ACCEL (in_accel_*) or
+             LOC_SENSOR_TYPE_GYRO (in_anglvel_*) */
+    LocIioSensorSource(int deviceIndex, LocSensorType type);
+    virtual ~LocIioSensorSource();
+
+    virtual bool open();
+    virtual int read(LocSensorSample* samples, int max, int timeoutMs);
+    virtual void close();
+
+private:
+    /* scan element of one channel */
+    struct Channel {
+        int index;
+        uint32_t offset;      /* byte offset in the scan */
+        uint32_t storageBytes;
+        uint32_t bits;
+        uint32_t shift;
+        bool isSigned;
+        bool isBigEndian;
+    };
+    enum { CHAN_X = 0, CHAN_Y, CHAN_Z, CHAN_TIMESTAMP, CHAN_MAX };
+
+    int mDeviceIndex;
+    LocSensorType mType;
+    int mFd;
+    Channel mChannels[CHAN_MAX];
+    uint32_t mScanBytes;
+    float mScale;
+
+    bool setupScanLayout();
+    bool readChannel(const char* name, Channel& channel);
+    bool writeSysfs(const char* relPath, const char* value);
+    bool readSysfs(const char* relPath, char* value, size_t len);
+    static int64_t extract(const uint8_t* scan, const Channel& channel);
+};
+
+/* Sends one QMI_LOC_INJECT_SENSOR_DATA request without waiting
+   for the indication, returns false on failure */
+typedef std::function<bool(const qmiLocInjectSensorDataReqMsgT_v02& req)>
+        LocSensorDataSender;
+
+/*--------------------------------------------------------------------
+ * CLASS LocSensorInjector
+ *
+ * Functionality:
+ * Streams samples from a LocSensorSource to the engine. The sender
+ * packs the samples per type into batches of up to
+ * QMI_LOC_SENSOR_DATA_MAX_SAMPLES_V02 with time offset encoding, and
+ * sends a batch when it is full or when its oldest sample has waited
+ * for the latency budget.
+ *-------------------------------------------------------------------*/
+class LocSensorInjector : public LocSampleInjector<LocSensorSample, LocSensorSample> {
+
+public:
+    /* source is owned by the injector from here on */
+    LocSensorInjector(LocSensorSource* source, const LocSensorDataSender& sender,
+                      uint32_t latencyBudgetMs);
+    virtual ~LocSensorInjector();
+
+protected:
+    virtual void receive(const LocSensorSample& sample, uint64_t nowNs, LocSensorSample& out);
+    virtual void stage(const LocSensorSample& sample);
+    virtual bool isBatchDue(uint64_t nowNs) const;
+    virtual void sendBatch();
+
+private:
+    /* samples of one type waiting to be sent */
+    struct Staging {
+        LocSensorSample samples[QMI_LOC_SENSOR_DATA_MAX_SAMPLES_V02];
+        uint32_t count;
+    };
+
+    LocSensorDataSender mSendFn;
+    /* sender thread only */
+    Staging mStaging[LOC_SENSOR_TYPE_MAX];
+    qmiLocInjectSensorDataReqMsgT_v02 mReq;
+    uint32_t mOpaqueId;
+};
+
+#endif /* LOC_SENSOR_INJECTOR_H */
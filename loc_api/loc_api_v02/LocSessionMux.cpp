@@ -0,0 +1,256 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_SessionMux"
+
+#include <inttypes.h>
+#include <vector>
+#include <LocSessionMux.h>
+#include <loc_pla.h>
+#include <log_util.h>
+
+uint32_t LocSessionMux::addSession(const LocPosMode& criteria,
+                                   const LocSessionFixCb& fixCb)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    uint32_t sessionId = mNextSessionId++;
+    // skip the default id on wrap around, and any id still in use
+    while (LOC_SESSION_MUX_DEFAULT_ID == sessionId ||
+           mSessions.end() != mSessions.find(sessionId)) {
+        sessionId = mNextSessionId++;
+    }
+
+    Session& session = mSessions[sessionId];
+    session.criteria = criteria;
+    session.fixCb = fixCb;
+    session.lastFixTimeMs = 0;
+    session.done = false;
+
+    LOC_LOGD("%s:%d]: session %u, interval %u ms, accuracy %u m, recurrence %d, "
+             "%zu sessions", __func__, __LINE__, sessionId, criteria.min_interval,
+             criteria.preferred_accuracy, criteria.recurrence, mSessions.size());
+    return sessionId;
+}
+
+void LocSessionMux::setDefaultSession(const LocPosMode& criteria)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::map<uint32_t, Session>::iterator it =
+            mSessions.find(LOC_SESSION_MUX_DEFAULT_ID);
+    if (mSessions.end() == it) {
+        Session& session = mSessions[LOC_SESSION_MUX_DEFAULT_ID];
+        session.criteria = criteria;
+        session.lastFixTimeMs = 0;
+        session.done = false;
+    } else {
+        it->second.criteria = criteria;
+        if (LOC_GPS_POSITION_RECURRENCE_SINGLE == criteria.recurrence) {
+            it->second.lastFixTimeMs = 0;
+            it->second.done = false;
+        }
+    }
+}
+
+bool LocSessionMux::updateSession(uint32_t sessionId, const LocPosMode& criteria)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::map<uint32_t, Session>::iterator it = mSessions.find(sessionId);
+    if (mSessions.end() == it) {
+        LOC_LOGE("%s:%d]: no session %u", __func__, __LINE__, sessionId);
+        return false;
+    }
+    it->second.criteria = criteria;
+    return true;
+}
+
+bool LocSessionMux::removeSession(uint32_t sessionId)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (0 == mSessions.erase(sessionId)) {
+        LOC_LOGD("%s:%d]: no session %u", __func__, __LINE__, sessionId);
+        return false;
+    }
+    LOC_LOGD("%s:%d]: session %u, %zu sessions left",
+             __func__, __LINE__, sessionId, mSessions.size());
+    return true;
+}
+
+bool LocSessionMux::hasSession(uint32_t sessionId)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSessions.end() != mSessions.find(sessionId);
+}
+
+bool LocSessionMux::isEmpty()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSessions.empty();
+}
+
+void LocSessionMux::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    LOC_LOGD("%s:%d]: dropping %zu sessions", __func__, __LINE__, mSessions.size());
+    mSessions.clear();
+}
+
+bool LocSessionMux::getAggregateCriteria(LocPosMode& criteria)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return getAggregateCriteriaLocked(criteria);
+}
+
+bool LocSessionMux::getAggregateCriteriaLocked(LocPosMode& criteria)
+{
+    if (mSessions.empty()) {
+        return false;
+    }
+
+    // default session or the oldest one
+    std::map<uint32_t, Session>::const_iterator it = mSessions.begin();
+    criteria = it->second.criteria;
+
+    // a single shot session wants the next fix, not a rate, so only the
+    // periodic ones set the interval. A served single shot default
+    // session asks for nothing until it is set again.
+    bool hasPeriodic = false;
+    bool hasPending = false;
+    for (; it != mSessions.end(); ++it) {
+        const Session& session = it->second;
+        const LocPosMode& c = session.criteria;
+        if (session.done) {
+            continue;
+        }
+        if (LOC_GPS_POSITION_RECURRENCE_SINGLE != c.recurrence) {
+            if (!hasPeriodic || c.min_interval < criteria.min_interval) {
+                criteria.min_interval = c.min_interval;
+            }
+            hasPeriodic = true;
+        }
+        if (!hasPending || c.preferred_accuracy < criteria.preferred_accuracy) {
+            criteria.preferred_accuracy = c.preferred_accuracy;
+        }
+        hasPending = true;
+    }
+    criteria.recurrence = hasPeriodic ? LOC_GPS_POSITION_RECURRENCE_PERIODIC :
+                                        LOC_GPS_POSITION_RECURRENCE_SINGLE;
+    return true;
+}
+
+uint32_t LocSessionMux::getEngineInterval(const LocPosMode& criteria)
+{
+    if (criteria.preferred_accuracy > LOC_LOW_ACCURACY_THRESHOLD_M &&
+        criteria.min_interval < LOC_LOW_ACCURACY_MIN_INTERVAL_MS) {
+        return LOC_LOW_ACCURACY_MIN_INTERVAL_MS;
+    }
+    return criteria.min_interval;
+}
+
+bool LocSessionMux::dispatch(const UlpLocation& location,
+                             const GpsLocationExtended& locationExtended,
+                             enum loc_sess_status status, LocPosTechMask techMask,
+                             int64_t nowMs, bool& criteriaChanged)
+{
+    std::vector<LocSessionFixCb> dueCbs;
+    bool reportToEngine = false;
+
+    criteriaChanged = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        std::map<uint32_t, Session>::iterator def =
+                mSessions.find(LOC_SESSION_MUX_DEFAULT_ID);
+        bool hasDefault = mSessions.end() != def;
+        if (mSessions.empty() ||
+            (hasDefault && 1 == mSessions.size())) {
+            // nothing to multiplex
+            return true;
+        }
+        if (LOC_SESS_SUCCESS != status) {
+            return hasDefault && !def->second.done;
+        }
+
+        LocPosMode aggregate;
+        getAggregateCriteriaLocked(aggregate);
+        // fixes arrive at the engine rate with some jitter, deliver a fix
+        // if it is closer to the session's next due time than the one after.
+        // The rate is the one the engine really runs at, e.g. with LOW
+        // accuracy it may be well above the tightest requested interval.
+        int64_t tolerance = getEngineInterval(aggregate) / 2;
+
+        std::map<uint32_t, Session>::iterator it = mSessions.begin();
+        while (it != mSessions.end()) {
+            Session& session = it->second;
+            bool singleShot =
+                    LOC_GPS_POSITION_RECURRENCE_SINGLE == session.criteria.recurrence;
+            bool due = !session.done &&
+                       ((0 == session.lastFixTimeMs) ||
+                        (nowMs - session.lastFixTimeMs >=
+                         (int64_t)session.criteria.min_interval - tolerance));
+            if (!due) {
+                ++it;
+                continue;
+            }
+
+            session.lastFixTimeMs = nowMs;
+            if (LOC_SESSION_MUX_DEFAULT_ID == it->first) {
+                reportToEngine = true;
+            } else if (session.fixCb) {
+                dueCbs.push_back(session.fixCb);
+            }
+
+            if (!singleShot) {
+                ++it;
+            } else if (LOC_SESSION_MUX_DEFAULT_ID == it->first) {
+                // loc eng stops it, until then it must not get the fixes
+                // the engine keeps producing for the periodic sessions
+                LOC_LOGD("%s:%d]: single shot default session done",
+                         __func__, __LINE__);
+                session.done = true;
+                criteriaChanged = true;
+                ++it;
+            } else {
+                LOC_LOGD("%s:%d]: single shot session %u done",
+                         __func__, __LINE__, it->first);
+                mSessions.erase(it++);
+                criteriaChanged = true;
+            }
+        }
+    }
+
+    // outside of the lock, so that callbacks may add / remove sessions
+    for (size_t i = 0; i < dueCbs.size(); i++) {
+        dueCbs[i](location, locationExtended, techMask);
+    }
+
+    return reportToEngine;
+}
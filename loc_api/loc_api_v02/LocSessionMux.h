@@ -0,0 +1,133 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_SESSION_MUX_H
+#define LOC_SESSION_MUX_H
+
+#include <stdint.h>
+#include <gps_extended.h>
+#include <functional>
+#include <map>
+#include <mutex>
+
+/* Id of the session owned by the loc eng adapter (startFix / stopFix).
+   Its fixes are reported through LocApiBase, not through a callback. */
+#define LOC_SESSION_MUX_DEFAULT_ID (0)
+
+/* Accuracy in meters above which the engine runs at LOW accuracy, and
+   the interval in ms it then runs at, at the least */
+#define LOC_LOW_ACCURACY_THRESHOLD_M      (1000)
+#define LOC_LOW_ACCURACY_MIN_INTERVAL_MS  (600000)
+
+/* Fix callback of a logical tracking session */
+typedef std::function<void(const UlpLocation& location,
+                           const GpsLocationExtended& locationExtended,
+                           LocPosTechMask techMask)> LocSessionFixCb;
+
+/*--------------------------------------------------------------------
+ * CLASS LocSessionMux
+ *
+ * Functionality:
+ * Multiplexes several logical tracking sessions onto the single
+ * QMI_LOC tracking session of a client.
+ * - The engine runs at the tightest interval / accuracy of all
+ *   sessions (getAggregateCriteria).
+ * - Each fix is decimated to the interval of each session and
+ *   fanned out to the sessions it is due for (dispatch).
+ * - Single shot sessions get the first final fix; logical ones are
+ *   then dropped, the default one gets no further fixes until it is
+ *   set again. They do not bound the interval of periodic sessions.
+ * The mux only keeps the bookkeeping, starting / updating / stopping
+ * the engine session is left to LocApiV02.
+ *-------------------------------------------------------------------*/
+class LocSessionMux {
+
+public:
+    LocSessionMux() : mNextSessionId(LOC_SESSION_MUX_DEFAULT_ID + 1) {}
+
+    /* Add a logical session, returns its id */
+    uint32_t addSession(const LocPosMode& criteria, const LocSessionFixCb& fixCb);
+
+    /* Add or update the session of the loc eng adapter. A single shot
+       session waits for a new fix */
+    void setDefaultSession(const LocPosMode& criteria);
+
+    /* Update the criteria of a session.
+       Returns false if there is no such session. */
+    bool updateSession(uint32_t sessionId, const LocPosMode& criteria);
+
+    /* Remove a session.
+       Returns false if there is no such session. */
+    bool removeSession(uint32_t sessionId);
+
+    bool hasSession(uint32_t sessionId);
+    bool isEmpty();
+
+    /* Drop all sessions, e.g. when the engine went away */
+    void clear();
+
+    /* Criteria the engine has to run with to serve all sessions.
+       Mode, credentials etc are taken from the default session if
+       present, or else from the oldest session.
+       Returns false if there are no sessions. */
+    bool getAggregateCriteria(LocPosMode& criteria);
+
+    /* Interval the engine actually runs at for the criteria, i.e. with
+       the LOW accuracy minimum applied */
+    static uint32_t getEngineInterval(const LocPosMode& criteria);
+
+    /* Fan out a final fix to the sessions it is due for.
+       Intermediate fixes only go to the default session.
+       nowMs: CLOCK_BOOTTIME of the fix in milliseconds
+       criteriaChanged: set to true if a single shot session completed,
+                        i.e. the aggregate criteria have to be re-applied
+       Returns true if the fix must be reported to loc eng, i.e. the
+       default session is due, or no logical sessions are running. */
+    bool dispatch(const UlpLocation& location,
+                  const GpsLocationExtended& locationExtended,
+                  enum loc_sess_status status, LocPosTechMask techMask,
+                  int64_t nowMs, bool& criteriaChanged);
+
+private:
+    struct Session {
+        LocPosMode criteria;
+        LocSessionFixCb fixCb;
+        /* time the last fix was delivered to this session, 0 if none */
+        int64_t lastFixTimeMs;
+        /* single shot default session that got its fix */
+        bool done;
+    };
+
+    /* ordered by id, the default session, if any, is always first */
+    std::map<uint32_t, Session> mSessions;
+    uint32_t mNextSessionId;
+    std::mutex mMutex;
+
+    bool getAggregateCriteriaLocked(LocPosMode& criteria);
+};
+
+#endif /* LOC_SESSION_MUX_H */
@@ -0,0 +1,230 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_SvPolyCache"
+
+#include <string.h>
+#include <math.h>
+#include <LocSvPolyCache.h>
+#include <log_util.h>
+
+#define SECONDS_PER_WEEK        (604800.0)
+#define SECONDS_PER_DAY         (86400.0)
+/* BDT started at GPS week 1356 and is 14 s behind GPS time */
+#define BDS_GPS_WEEK_OFFSET     (1356)
+#define BDS_GPS_SECONDS_OFFSET  (14)
+/* GST weeks are counted from GPS week 1024 */
+#define GAL_GPS_WEEK_OFFSET     (1024)
+/* days from the GPS epoch to Jan 1 1996, the GLONASS T0 epoch */
+#define GLO_GPS_DAYS_OFFSET     (5839)
+
+static const int sSlotBase[] = { 0, 32, 64, 103, 108, 113, 150 };
+
+LocSvPolyCache::LocSvPolyCache() :
+    mMaxAgeMs(0), mMaxDtSec(0)
+{
+    memset(mEntries, 0, sizeof(mEntries));
+}
+
+void LocSvPolyCache::configure(uint32_t maxAgeMs, uint32_t maxDtSec)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMaxAgeMs = maxAgeMs;
+    mMaxDtSec = maxDtSec;
+}
+
+void LocSvPolyCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    memset(mEntries, 0, sizeof(mEntries));
+}
+
+int LocSvPolyCache::slotOf(uint16_t gnssSvId, TimeScale& scale)
+{
+    if (gnssSvId >= 1 && gnssSvId <= 32) {
+        scale = TIME_SCALE_GPS;
+        return sSlotBase[0] + gnssSvId - 1;
+    } else if (gnssSvId >= 65 && gnssSvId <= 96) {
+        scale = TIME_SCALE_GLONASS;
+        return sSlotBase[1] + gnssSvId - 65;
+    } else if (gnssSvId >= 120 && gnssSvId <= 158) {
+        scale = TIME_SCALE_GPS;
+        return sSlotBase[2] + gnssSvId - 120;
+    } else if (gnssSvId >= 183 && gnssSvId <= 187) {
+        scale = TIME_SCALE_GPS;
+        return sSlotBase[3] + gnssSvId - 183;
+    } else if (gnssSvId >= 193 && gnssSvId <= 197) {
+        scale = TIME_SCALE_GPS;
+        return sSlotBase[4] + gnssSvId - 193;
+    } else if (gnssSvId >= 201 && gnssSvId <= 237) {
+        scale = TIME_SCALE_BDS;
+        return sSlotBase[5] + gnssSvId - 201;
+    } else if (gnssSvId >= 301 && gnssSvId <= 336) {
+        scale = TIME_SCALE_GALILEO;
+        return sSlotBase[6] + gnssSvId - 301;
+    }
+    return -1;
+}
+
+void LocSvPolyCache::update(const qmiLocEventGnssSvPolyIndMsgT_v02& poly, int64_t nowMs)
+{
+    TimeScale scale;
+    int slot = slotOf(poly.gnssSvId, scale);
+    if (slot < 0 || !poly.polyCoeffXYZ0_valid || !poly.polyCoefXYZN_valid) {
+        return;
+    }
+    uint16_t iode = poly.IODE_valid ? poly.IODE : 0;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    Entry* entries = mEntries[slot];
+
+    // same key replaces, otherwise the oldest goes
+    Entry* entry = &entries[0];
+    for (int i = 0; i < LOC_SV_POLY_ENTRIES_PER_SV; i++) {
+        if (entries[i].valid && entries[i].iode == iode && entries[i].t0 == poly.T0) {
+            entry = &entries[i];
+            break;
+        }
+        if (!entries[i].valid ||
+            (entry->valid && entries[i].receivedMs < entry->receivedMs)) {
+            entry = &entries[i];
+        }
+    }
+
+    entry->valid = true;
+    entry->gnssSvId = poly.gnssSvId;
+    entry->iode = iode;
+    entry->t0 = poly.T0;
+    entry->receivedMs = nowMs;
+    for (int axis = 0; axis < 3; axis++) {
+        entry->pos[axis][0] = poly.polyCoeffXYZ0[axis];
+        for (int n = 1; n < 4; n++) {
+            entry->pos[axis][n] = poly.polyCoefXYZN[axis * 3 + n - 1];
+        }
+        if (poly.velCoef_valid) {
+            for (int n = 0; n < 4; n++) {
+                entry->vel[axis][n] = poly.velCoef[axis * 4 + n];
+            }
+        } else {
+            entry->vel[axis][0] = entry->pos[axis][1];
+            entry->vel[axis][1] = 2 * entry->pos[axis][2];
+            entry->vel[axis][2] = 3 * entry->pos[axis][3];
+            entry->vel[axis][3] = 0;
+        }
+    }
+    entry->clockValid = poly.polyCoefClockBias_valid;
+    for (int n = 0; n < 4; n++) {
+        entry->clock[n] = poly.polyCoefClockBias_valid ? poly.polyCoefClockBias[n] : 0;
+    }
+    entry->posUnc = poly.svPosUnc_valid ? poly.svPosUnc : 0;
+}
+
+/* c0 + c1 t + c2 t^2 + c3 t^3 */
+static inline double horner(const double* c, double t)
+{
+    return ((c[3] * t + c[2]) * t + c[1]) * t + c[0];
+}
+
+/* t0 may be a time of week (or of day) instead of full seconds; dt is
+   then taken modulo that period */
+static inline double deltaTime(double now, double t0, double period)
+{
+    if (t0 < period) {
+        double dt = fmod(now, period) - t0;
+        if (dt > period / 2) {
+            dt -= period;
+        } else if (dt < -period / 2) {
+            dt += period;
+        }
+        return dt;
+    }
+    return now - t0;
+}
+
+uint32_t LocSvPolyCache::evaluate(uint16_t gpsWeek, double gpsTowSec, int32_t leapSeconds,
+                                  int64_t nowMs, LocSvPolyState* states, uint32_t maxStates)
+{
+    // the evaluation time in every time scale, once
+    double gpsSeconds = gpsWeek * SECONDS_PER_WEEK + gpsTowSec;
+    double now[TIME_SCALE_COUNT];
+    double period[TIME_SCALE_COUNT];
+    now[TIME_SCALE_GPS] = gpsTowSec;
+    period[TIME_SCALE_GPS] = SECONDS_PER_WEEK;
+    now[TIME_SCALE_GLONASS] = gpsSeconds - leapSeconds - GLO_GPS_DAYS_OFFSET * SECONDS_PER_DAY;
+    period[TIME_SCALE_GLONASS] = SECONDS_PER_DAY;
+    now[TIME_SCALE_BDS] = (gpsWeek - BDS_GPS_WEEK_OFFSET) * SECONDS_PER_WEEK + gpsTowSec -
+            BDS_GPS_SECONDS_OFFSET;
+    period[TIME_SCALE_BDS] = SECONDS_PER_WEEK;
+    now[TIME_SCALE_GALILEO] = (gpsWeek - GAL_GPS_WEEK_OFFSET) * SECONDS_PER_WEEK + gpsTowSec;
+    period[TIME_SCALE_GALILEO] = SECONDS_PER_WEEK;
+
+    uint32_t count = 0;
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (int slot = 0; slot < LOC_SV_POLY_SLOTS && count < maxStates; slot++) {
+        TimeScale scale = TIME_SCALE_GPS;
+        const Entry* best = NULL;
+        double bestDt = 0;
+
+        for (int i = 0; i < LOC_SV_POLY_ENTRIES_PER_SV; i++) {
+            Entry& entry = mEntries[slot][i];
+            if (!entry.valid) {
+                continue;
+            }
+            if (mMaxAgeMs > 0 && nowMs - entry.receivedMs > (int64_t)mMaxAgeMs) {
+                entry.valid = false;
+                continue;
+            }
+            slotOf(entry.gnssSvId, scale);
+            double dt = deltaTime(now[scale], entry.t0, period[scale]);
+            if ((mMaxDtSec > 0 && fabs(dt) > mMaxDtSec) ||
+                (NULL != best && fabs(dt) >= fabs(bestDt))) {
+                continue;
+            }
+            best = &entry;
+            bestDt = dt;
+        }
+        if (NULL == best) {
+            continue;
+        }
+
+        LocSvPolyState& state = states[count++];
+        state.gnssSvId = best->gnssSvId;
+        state.iode = best->iode;
+        state.dtSec = bestDt;
+        for (int axis = 0; axis < 3; axis++) {
+            state.position[axis] = horner(best->pos[axis], bestDt);
+            state.velocity[axis] = horner(best->vel[axis], bestDt);
+        }
+        state.clockValid = best->clockValid;
+        state.clockBias = horner(best->clock, bestDt);
+        state.clockDrift = (3 * best->clock[3] * bestDt + 2 * best->clock[2]) * bestDt +
+                best->clock[1];
+        state.posUnc = best->posUnc;
+    }
+    return count;
+}
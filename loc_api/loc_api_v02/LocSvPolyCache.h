@@ -0,0 +1,122 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_SV_POLY_CACHE_H
+#define LOC_SV_POLY_CACHE_H
+
+#include <stdint.h>
+#include <mutex>
+#include <location_service_v02.h>
+
+/* polynomials kept per SV, so a new IODE does not immediately push out
+   the set the previous fit interval is still best served by */
+#define LOC_SV_POLY_ENTRIES_PER_SV (2)
+/* GPS 1-32, GLONASS 65-96, SBAS 120-158 and 183-187, QZSS 193-197,
+   BDS 201-237, Galileo 301-336 */
+#define LOC_SV_POLY_SLOTS          (32 + 32 + 39 + 5 + 5 + 37 + 36)
+
+/* SV state evaluated from a cached polynomial */
+struct LocSvPolyState {
+    /* QMI SV id, as in the polynomial report */
+    uint16_t gnssSvId;
+    /* IODE of the polynomial used, 0 if the report had none */
+    uint16_t iode;
+    /* evaluation time minus T0 of the polynomial, seconds */
+    double dtSec;
+    /* ECEF, meters and meters/second */
+    double position[3];
+    double velocity[3];
+    /* satellite clock bias correction and its rate, in the units of the
+       report: milliseconds and milliseconds/second */
+    double clockBias;
+    double clockDrift;
+    bool clockValid;
+    /* meters, 0 if the report had none */
+    float posUnc;
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocSvPolyCache
+ *
+ * Functionality:
+ * Keeps the SV polynomials the engine reports, keyed by SV, T0 and IODE,
+ * and evaluates position, velocity and clock correction of all cached
+ * SVs at a given GPS time in one call. T0 is in the time scale of the
+ * constellation; the GPS time is converted once per constellation.
+ * Entries expire maxAgeMs after they were reported and are not used
+ * further than maxDtSec from their T0. Thread safe.
+ *-------------------------------------------------------------------*/
+class LocSvPolyCache {
+
+public:
+    LocSvPolyCache();
+
+    void configure(uint32_t maxAgeMs, uint32_t maxDtSec);
+
+    void update(const qmiLocEventGnssSvPolyIndMsgT_v02& poly, int64_t nowMs);
+
+    void clear();
+
+    /* Fills states with every SV that has a usable polynomial at GPS
+       week gpsWeek and gpsTowSec into it; leapSeconds (GPS - UTC) is
+       needed for GLONASS. Returns the number of states filled. */
+    uint32_t evaluate(uint16_t gpsWeek, double gpsTowSec, int32_t leapSeconds,
+                      int64_t nowMs, LocSvPolyState* states, uint32_t maxStates);
+
+private:
+    enum TimeScale {
+        TIME_SCALE_GPS = 0,
+        TIME_SCALE_GLONASS,
+        TIME_SCALE_BDS,
+        TIME_SCALE_GALILEO,
+        TIME_SCALE_COUNT
+    };
+
+    struct Entry {
+        bool valid;
+        uint16_t gnssSvId;
+        uint16_t iode;
+        double t0;
+        int64_t receivedMs;
+        /* c0..c3 per axis */
+        double pos[3][4];
+        /* c0..c3 per axis, derived from pos when not reported */
+        double vel[3][4];
+        double clock[4];
+        bool clockValid;
+        float posUnc;
+    };
+
+    std::mutex mMutex;
+    uint32_t mMaxAgeMs;
+    uint32_t mMaxDtSec;
+    Entry mEntries[LOC_SV_POLY_SLOTS][LOC_SV_POLY_ENTRIES_PER_SV];
+
+    static int slotOf(uint16_t gnssSvId, TimeScale& scale);
+};
+
+#endif /* LOC_SV_POLY_CACHE_H */
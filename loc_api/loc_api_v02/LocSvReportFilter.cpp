@@ -0,0 +1,112 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_SvReportFilter"
+
+#include <string.h>
+#include <math.h>
+#include <LocSvReportFilter.h>
+#include <log_util.h>
+
+LocSvReportFilter::LocSvReportFilter() :
+    mCn0Threshold(0), mElevationThreshold(0), mMaxAgeMs(0), mLastReportMs(-1),
+    mResetPending(false), mLastCount(0), mPassed(0), mSuppressed(0)
+{
+}
+
+void LocSvReportFilter::configure(float cn0ThresholdDbHz, float elevationThresholdDeg,
+                                  uint32_t maxAgeMs)
+{
+    mCn0Threshold = cn0ThresholdDbHz;
+    mElevationThreshold = elevationThresholdDeg;
+    mMaxAgeMs = maxAgeMs;
+    reset();
+}
+
+bool LocSvReportFilter::changed(const SvState* current, uint32_t count) const
+{
+    if (count != mLastCount) {
+        return true;
+    }
+    // both lists are sorted by key
+    for (uint32_t i = 0; i < count; i++) {
+        const SvState& now = current[i];
+        const SvState& last = mLast[i];
+        if (now.key != last.key || now.options != last.options ||
+            fabsf(now.cn0Dbhz - last.cn0Dbhz) >= mCn0Threshold ||
+            fabsf(now.elevation - last.elevation) >= mElevationThreshold) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LocSvReportFilter::check(const GnssSvNotification& svNotify, int64_t nowMs)
+{
+    SvState current[GNSS_SV_MAX];
+    uint32_t count = svNotify.count;
+    if (count > GNSS_SV_MAX) {
+        count = GNSS_SV_MAX;
+    }
+
+    // insertion sort, the engine mostly lists SVs in the same order
+    for (uint32_t i = 0; i < count; i++) {
+        const GnssSv& sv = svNotify.gnssSvs[i];
+        SvState state;
+        state.key = ((uint32_t)sv.type << 16) | sv.svId;
+        state.cn0Dbhz = sv.cN0Dbhz;
+        state.elevation = sv.elevation;
+        state.options = sv.gnssSvOptionsMask;
+        uint32_t j = i;
+        while (j > 0 && current[j - 1].key > state.key) {
+            current[j] = current[j - 1];
+            j--;
+        }
+        current[j] = state;
+    }
+
+    if (mResetPending.exchange(false)) {
+        mLastReportMs = -1;
+    }
+    bool report = (0 == mMaxAgeMs) || (mLastReportMs < 0) ||
+            (nowMs - mLastReportMs >= (int64_t)mMaxAgeMs) || changed(current, count);
+    if (!report) {
+        mSuppressed++;
+        return false;
+    }
+
+    memcpy(mLast, current, count * sizeof(SvState));
+    mLastCount = count;
+    mLastReportMs = nowMs;
+    mPassed++;
+    if (0 == mPassed % 100) {
+        LOC_LOGD("%s:%d]: %u SV reports passed, %u suppressed",
+                 __func__, __LINE__, mPassed, mSuppressed);
+    }
+    return true;
+}
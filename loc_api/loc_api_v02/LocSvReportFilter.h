@@ -0,0 +1,91 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_SV_REPORT_FILTER_H
+#define LOC_SV_REPORT_FILTER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <gps_extended.h>
+
+/*--------------------------------------------------------------------
+ * CLASS LocSvReportFilter
+ *
+ * Functionality:
+ * Decides whether an SV report differs enough from the last one that
+ * was passed on to be worth reporting. SVs are matched by constellation
+ * and id, so the order the engine lists them in does not matter. A
+ * report goes through when an SV appears or disappears, its option
+ * flags (ephemeris, almanac, used in fix) change, or its C/N0 or
+ * elevation moved by at least the threshold; otherwise it is dropped
+ * unless the last report passed is older than maxAgeMs. Only reset()
+ * may be called from another thread than the one calling check().
+ *-------------------------------------------------------------------*/
+class LocSvReportFilter {
+
+public:
+    LocSvReportFilter();
+
+    /* maxAgeMs of 0 lets every report through; it is the default here
+       and for SV_REPORT_MAX_AGE_MS in gps.conf */
+    void configure(float cn0ThresholdDbHz, float elevationThresholdDeg,
+                   uint32_t maxAgeMs);
+
+    /* true if svNotify should be reported, it is then remembered as the
+       last report passed */
+    bool check(const GnssSvNotification& svNotify, int64_t nowMs);
+
+    /* lets the next report through, e.g. when a session starts; taken
+       up by the next check() */
+    inline void reset() { mResetPending = true; }
+
+    inline uint32_t getPassed() const { return mPassed; }
+    inline uint32_t getSuppressed() const { return mSuppressed; }
+
+private:
+    struct SvState {
+        /* constellation << 16 | svId, the sort order */
+        uint32_t key;
+        float cn0Dbhz;
+        float elevation;
+        GnssSvOptionsMask options;
+    };
+
+    float mCn0Threshold;
+    float mElevationThreshold;
+    uint32_t mMaxAgeMs;
+    int64_t mLastReportMs;
+    std::atomic<bool> mResetPending;
+    SvState mLast[GNSS_SV_MAX];
+    uint32_t mLastCount;
+    uint32_t mPassed;
+    uint32_t mSuppressed;
+
+    bool changed(const SvState* current, uint32_t count) const;
+};
+
+#endif /* LOC_SV_REPORT_FILTER_H */
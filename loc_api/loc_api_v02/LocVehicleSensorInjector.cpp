@@ -0,0 +1,332 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_NDEBUG 0
+#define LOG_TAG "LocSvc_VehicleSensorInjector"
+
+#include <inttypes.h>
+#include <string.h>
+#include <algorithm>
+#include <LocVehicleSensorInjector.h>
+#include <loc_pla.h>
+#include <log_util.h>
+
+#define NSEC_PER_USEC   (1000ULL)
+#define NSEC_PER_MSEC   (1000000ULL)
+
+/* ring size in samples, a few seconds of 100 Hz CAN data */
+#define VEHICLE_RING_CAPACITY      (1024)
+/* time offsets are uint32 microseconds */
+#define VEHICLE_MAX_TIME_OFFSET_US (0xFFFFFFFFULL)
+/* window over which the smallest reception delay is taken */
+#define LOC_VEHICLE_TIME_SYNC_WINDOW_MS (10000)
+
+/*--------------------------------------------------------------------
+ * LocFileVehicleSensorSource
+ *-------------------------------------------------------------------*/
+bool LocFileVehicleSensorSource::parseLine(const char* line, LocVehicleSensorSample& sample,
+                                           uint64_t& recordedNs)
+{
+    char type[16];
+    unsigned int mask, flags;
+    int fields;
+
+    memset(&sample, 0, sizeof(sample));
+    if (2 != sscanf(line, "%15s %" SCNu64, type, &recordedNs)) {
+        LOC_LOGW("%s:%d]: skipping malformed line: %s", __func__, __LINE__, line);
+        return false;
+    }
+    if (0 == strcmp(type, "accel") || 0 == strcmp(type, "gyro")) {
+        sample.type = ('a' == type[0]) ? LOC_VEHICLE_SENSOR_TYPE_ACCEL :
+                                         LOC_VEHICLE_SENSOR_TYPE_ANG_ROTATION;
+        fields = sscanf(line, "%*s %*s %x %f %f %f", &mask, &sample.motion.axes[0],
+                        &sample.motion.axes[1], &sample.motion.axes[2]);
+        if (fields < 2) {
+            LOC_LOGW("%s:%d]: skipping malformed line: %s", __func__, __LINE__, line);
+            return false;
+        }
+        sample.motion.axesMask = mask;
+    } else if (0 == strcmp(type, "odo")) {
+        sample.type = LOC_VEHICLE_SENSOR_TYPE_ODOMETRY;
+        fields = sscanf(line, "%*s %*s %x %x %" SCNu64 " %" SCNu64 " %" SCNu64,
+                        &mask, &flags, &sample.odometry.distanceMm[0],
+                        &sample.odometry.distanceMm[1], &sample.odometry.distanceMm[2]);
+        if (fields < 3) {
+            LOC_LOGW("%s:%d]: skipping malformed line: %s", __func__, __LINE__, line);
+            return false;
+        }
+        sample.odometry.wheelMask = mask;
+        sample.odometry.flags = flags;
+    } else {
+        LOC_LOGW("%s:%d]: unknown sample type %s", __func__, __LINE__, type);
+        return false;
+    }
+    sample.vehicleTimeNs = recordedNs;
+    return true;
+}
+
+/* in realtime mode the sample is received when it is handed out,
+   otherwise the recorded reception delay is kept at 0 */
+void LocFileVehicleSensorSource::setReplayTime(LocVehicleSensorSample& sample,
+                                               uint64_t replayNs)
+{
+    if (!isRealtime()) {
+        sample.rxTimeNs = replayNs;
+    }
+}
+
+/*--------------------------------------------------------------------
+ * LocVehicleSensorInjector
+ *-------------------------------------------------------------------*/
+LocVehicleSensorInjector::LocVehicleSensorInjector(LocVehicleSensorSource* source,
+                                                   const LocVehicleSensorDataSender& sender,
+                                                   uint32_t latencyBudgetMs) :
+    LocSampleInjector<LocVehicleSensorSample, LocVehicleAlignedSample>("Vehicle", source,
+            latencyBudgetMs, VEHICLE_RING_CAPACITY, QMI_LOC_VEHICLE_SENSOR_DATA_MAX_SAMPLES_V02),
+    mSendFn(sender), mTimeOffsetValid(false), mTimeOffsetNs(0), mWindowMinOffsetNs(0),
+    mWindowStartNs(0), mStagedTimeOffsetNs(0), mSentTimeOffsetValid(false),
+    mSentTimeOffsetNs(0)
+{
+    memset(mStaging, 0, sizeof(mStaging));
+    memset(&mReq, 0, sizeof(mReq));
+}
+
+LocVehicleSensorInjector::~LocVehicleSensorInjector()
+{
+    stop();
+}
+
+void LocVehicleSensorInjector::onStart()
+{
+    mTimeOffsetValid = false;
+    mSentTimeOffsetValid = false;
+}
+
+/* map the vehicle timestamp onto boot time. The offset is the smallest
+   delay between vehicle time and reception seen so far; a smaller one
+   is taken at once, a larger one (clock drift) only at the end of a
+   window */
+void LocVehicleSensorInjector::receive(const LocVehicleSensorSample& received,
+                                       uint64_t nowNs, LocVehicleAlignedSample& aligned)
+{
+    LocVehicleSensorSample sample = received;
+    if (0 == sample.rxTimeNs) {
+        sample.rxTimeNs = nowNs;
+    }
+    int64_t offsetNs = (int64_t)(sample.rxTimeNs - sample.vehicleTimeNs);
+
+    if (!mTimeOffsetValid) {
+        mTimeOffsetValid = true;
+        mTimeOffsetNs = offsetNs;
+        mWindowMinOffsetNs = offsetNs;
+        mWindowStartNs = sample.rxTimeNs;
+    } else {
+        mWindowMinOffsetNs = std::min(mWindowMinOffsetNs, offsetNs);
+        if (offsetNs < mTimeOffsetNs) {
+            mTimeOffsetNs = offsetNs;
+        }
+        if (sample.rxTimeNs - mWindowStartNs >=
+                (uint64_t)LOC_VEHICLE_TIME_SYNC_WINDOW_MS * NSEC_PER_MSEC) {
+            mTimeOffsetNs = mWindowMinOffsetNs;
+            mWindowMinOffsetNs = offsetNs;
+            mWindowStartNs = sample.rxTimeNs;
+        }
+    }
+
+    aligned.sample = sample;
+    aligned.timeOffsetNs = mTimeOffsetNs;
+    aligned.timestampNs = sample.vehicleTimeNs + mTimeOffsetNs;
+}
+
+/* a request carries one time offset and per list one axes / wheel
+   mask, and its sample offsets must fit the uint32 microseconds */
+bool LocVehicleSensorInjector::fitsStaging(const LocVehicleAlignedSample& aligned) const
+{
+    bool anyStaged = false;
+    for (int t = 0; t < LOC_VEHICLE_SENSOR_TYPE_MAX; t++) {
+        anyStaged = anyStaged || (mStaging[t].count > 0);
+    }
+    if (anyStaged && aligned.timeOffsetNs != mStagedTimeOffsetNs) {
+        return false;
+    }
+
+    const Staging& staging = mStaging[aligned.sample.type];
+    if (0 == staging.count) {
+        return true;
+    }
+    const LocVehicleAlignedSample& first = staging.samples[0];
+    if (aligned.timestampNs < first.timestampNs ||
+        (aligned.timestampNs - first.timestampNs) / NSEC_PER_USEC > VEHICLE_MAX_TIME_OFFSET_US) {
+        return false;
+    }
+    if (LOC_VEHICLE_SENSOR_TYPE_ODOMETRY == aligned.sample.type) {
+        return aligned.sample.odometry.wheelMask == first.sample.odometry.wheelMask;
+    }
+    return aligned.sample.motion.axesMask == first.sample.motion.axesMask;
+}
+
+/* stage one sample, sending first whenever it does not fit the
+   request being filled and right after if its type is full */
+void LocVehicleSensorInjector::stage(const LocVehicleAlignedSample& aligned)
+{
+    if (aligned.sample.type >= LOC_VEHICLE_SENSOR_TYPE_MAX) {
+        return;
+    }
+    if (!fitsStaging(aligned)) {
+        sendBatch();
+    }
+    Staging& staging = mStaging[aligned.sample.type];
+    staging.samples[staging.count++] = aligned;
+    mStagedTimeOffsetNs = aligned.timeOffsetNs;
+    if (QMI_LOC_VEHICLE_SENSOR_DATA_MAX_SAMPLES_V02 == staging.count) {
+        sendBatch();
+    }
+}
+
+bool LocVehicleSensorInjector::isBatchDue(uint64_t nowNs) const
+{
+    for (int t = 0; t < LOC_VEHICLE_SENSOR_TYPE_MAX; t++) {
+        const Staging& staging = mStaging[t];
+        if (staging.count > 0 &&
+            nowNs >= staging.samples[0].timestampNs +
+                     (uint64_t)mLatencyBudgetMs * NSEC_PER_MSEC) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* time base of a list, whole ms at or before the first sample, and
+   the offset of a sample from it in us */
+static inline uint32_t sampleTimeBaseMs(uint64_t firstNs)
+{
+    return (uint32_t)(firstNs / NSEC_PER_MSEC);
+}
+
+static inline uint32_t sampleTimeOffsetUs(uint64_t firstNs, uint64_t sampleNs)
+{
+    return (uint32_t)((sampleNs - (firstNs / NSEC_PER_MSEC) * NSEC_PER_MSEC) / NSEC_PER_USEC);
+}
+
+/* pack everything staged into one request and send it */
+void LocVehicleSensorInjector::sendBatch()
+{
+    uint32_t total = 0;
+
+    memset(&mReq, 0, sizeof(mReq));
+
+    for (int t = LOC_VEHICLE_SENSOR_TYPE_ACCEL; t <= LOC_VEHICLE_SENSOR_TYPE_ANG_ROTATION; t++) {
+        const Staging& staging = mStaging[t];
+        if (0 == staging.count) {
+            continue;
+        }
+        qmiLocVehicleSensorSampleListStructType_v02& list =
+            (LOC_VEHICLE_SENSOR_TYPE_ACCEL == t) ? mReq.accelData : mReq.angRotationData;
+        if (LOC_VEHICLE_SENSOR_TYPE_ACCEL == t) {
+            mReq.accelData_valid = 1;
+        } else {
+            mReq.angRotationData_valid = 1;
+        }
+
+        uint64_t firstNs = staging.samples[0].timestampNs;
+        list.sampleTimeBase = sampleTimeBaseMs(firstNs);
+        list.axesValidity = staging.samples[0].sample.motion.axesMask;
+        list.sensorData_len = staging.count;
+        for (uint32_t i = 0; i < staging.count; i++) {
+            const LocVehicleAlignedSample& aligned = staging.samples[i];
+            list.sensorData[i].timeOffset = sampleTimeOffsetUs(firstNs, aligned.timestampNs);
+            list.sensorData[i].axisSample_len = QMI_LOC_VEHICLE_SENSOR_DATA_MAX_AXES_V02;
+            memcpy(list.sensorData[i].axisSample, aligned.sample.motion.axes,
+                   sizeof(list.sensorData[i].axisSample));
+        }
+    }
+
+    const Staging& odometry = mStaging[LOC_VEHICLE_SENSOR_TYPE_ODOMETRY];
+    if (odometry.count > 0) {
+        qmiLocVehicleOdometrySampleListStructT_v02& list = mReq.odometryData;
+        const LocVehicleAlignedSample& first = odometry.samples[0];
+        uint32_t wheels = 0;
+        for (uint32_t w = 0; w < QMI_LOC_VEHICLE_ODOMETRY_MAX_MEASUREMENTS_V02; w++) {
+            if (first.sample.odometry.wheelMask & (1 << w)) {
+                wheels++;
+            }
+        }
+
+        // the base is in meters, each sample adds its mm on top of it
+        uint64_t baseMm = UINT64_MAX;
+        for (uint32_t i = 0; i < odometry.count; i++) {
+            for (uint32_t w = 0; w < wheels; w++) {
+                baseMm = std::min(baseMm, odometry.samples[i].sample.odometry.distanceMm[w]);
+            }
+        }
+        if (UINT64_MAX == baseMm) {
+            baseMm = 0;
+        }
+
+        mReq.odometryData_valid = 1;
+        list.sampleTimeBase = sampleTimeBaseMs(first.timestampNs);
+        list.wheelFlags = first.sample.odometry.wheelMask;
+        list.distanceTravelledBase = (uint32_t)(baseMm / 1000);
+        list.odometryData_len = odometry.count;
+        for (uint32_t i = 0; i < odometry.count; i++) {
+            const LocVehicleAlignedSample& aligned = odometry.samples[i];
+            list.flags |= aligned.sample.odometry.flags;
+            list.odometryData[i].timeOffset =
+                    sampleTimeOffsetUs(first.timestampNs, aligned.timestampNs);
+            list.odometryData[i].distanceTravelled_len = wheels;
+            for (uint32_t w = 0; w < wheels; w++) {
+                list.odometryData[i].distanceTravelled[w] = (uint32_t)
+                        (aligned.sample.odometry.distanceMm[w] - (baseMm / 1000) * 1000);
+            }
+        }
+    }
+
+    for (int t = 0; t < LOC_VEHICLE_SENSOR_TYPE_MAX; t++) {
+        total += mStaging[t].count;
+        mStaging[t].count = 0;
+    }
+    if (0 == total) {
+        return;
+    }
+
+    // tell the engine how far the boot to vehicle time offset moved
+    if (mSentTimeOffsetValid && mStagedTimeOffsetNs != mSentTimeOffsetNs) {
+        int64_t changeUs = (mStagedTimeOffsetNs - mSentTimeOffsetNs) / (int64_t)NSEC_PER_USEC;
+        mReq.changeInTimeScales_valid = 1;
+        mReq.changeInTimeScales =
+                (int32_t)std::max<int64_t>(INT32_MIN, std::min<int64_t>(INT32_MAX, changeUs));
+    }
+    mSentTimeOffsetValid = true;
+    mSentTimeOffsetNs = mStagedTimeOffsetNs;
+
+    if (mSendFn(mReq)) {
+        mMessagesSent++;
+        mSamplesSent += total;
+    } else {
+        LOC_LOGE("%s:%d]: failed to send %u vehicle samples", __func__, __LINE__, total);
+    }
+}
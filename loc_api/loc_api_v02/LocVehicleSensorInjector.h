@@ -0,0 +1,168 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_VEHICLE_SENSOR_INJECTOR_H
+#define LOC_VEHICLE_SENSOR_INJECTOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <LocSampleInjector.h>
+#include <location_service_v02.h>
+
+/* Vehicle sample types that can be injected */
+typedef enum {
+    LOC_VEHICLE_SENSOR_TYPE_ACCEL = 0,
+    LOC_VEHICLE_SENSOR_TYPE_ANG_ROTATION,
+    LOC_VEHICLE_SENSOR_TYPE_ODOMETRY,
+    LOC_VEHICLE_SENSOR_TYPE_MAX
+} LocVehicleSensorType;
+
+/* One vehicle sample
+ * accel in m/s^2, angular rotation in rad/s, each with the valid axes
+ * in axesMask (QMI_LOC_MASK_X/Y/Z_AXIS_V02)
+ * odometry as accumulated distance in mm for the wheels in wheelMask
+ * (QMI_LOC_MASK_VEHICLE_ODOMETRY_*_V02), in that bit order */
+struct LocVehicleSensorSample {
+    LocVehicleSensorType type;
+    /* timestamp in the vehicle time base */
+    uint64_t vehicleTimeNs;
+    /* CLOCK_BOOTTIME when the sample was received on the AP, filled in
+       on reception if left 0 */
+    uint64_t rxTimeNs;
+    union {
+        struct {
+            qmiLocAxesMaskT_v02 axesMask;
+            float axes[QMI_LOC_VEHICLE_SENSOR_DATA_MAX_AXES_V02];
+        } motion;
+        struct {
+            qmiLocVehicleOdometryWheelFlagsMaskT_v02 wheelMask;
+            qmiLocVehicleOdometryMeasDeviationMaskType_v02 flags;
+            uint64_t distanceMm[QMI_LOC_VEHICLE_ODOMETRY_MAX_MEASUREMENTS_V02];
+        } odometry;
+    };
+};
+
+/* Pluggable source of vehicle (CAN) sensor samples */
+typedef LocSampleSource<LocVehicleSensorSample> LocVehicleSensorSource;
+
+/*--------------------------------------------------------------------
+ * CLASS LocFileVehicleSensorSource
+ *
+ * Functionality:
+ * Replays vehicle samples recorded in a text file, one per line:
+ *   <accel|gyro> <vehicle time ns> <axes mask> <x> <y> <z>
+ *   odo <vehicle time ns> <wheel mask> <flags> <mm> [<mm> <mm>]
+ * In realtime mode the original sample spacing is kept and samples
+ * are stamped with the time they are handed out.
+ *-------------------------------------------------------------------*/
+class LocFileVehicleSensorSource : public LocFileSampleSource<LocVehicleSensorSample> {
+
+public:
+    inline LocFileVehicleSensorSource(const char* path, bool realtime) :
+        LocFileSampleSource<LocVehicleSensorSample>(path, realtime) {}
+
+protected:
+    virtual bool parseLine(const char* line, LocVehicleSensorSample& sample,
+                           uint64_t& recordedNs);
+    virtual void setReplayTime(LocVehicleSensorSample& sample, uint64_t replayNs);
+};
+
+/* Sends one filled request, returns false if it could not be sent */
+typedef std::function<bool(const qmiLocInjectVehicleSensorDataReqMsgT_v02&)>
+        LocVehicleSensorDataSender;
+
+/* sample on the sender side, with the time base already applied */
+struct LocVehicleAlignedSample {
+    LocVehicleSensorSample sample;
+    /* CLOCK_BOOTTIME of the sample */
+    uint64_t timestampNs;
+    /* boot time minus vehicle time used for timestampNs */
+    int64_t timeOffsetNs;
+};
+
+/*--------------------------------------------------------------------
+ * CLASS LocVehicleSensorInjector
+ *
+ * Functionality:
+ * Streams vehicle samples to the engine with
+ * QMI_LOC_INJECT_VEHICLE_SENSOR_DATA. A reader thread maps the vehicle
+ * time base onto CLOCK_BOOTTIME and hands the samples to a sender
+ * thread through a lock free ring. The sender fills each request up
+ * to QMI_LOC_VEHICLE_SENSOR_DATA_MAX_SAMPLES_V02 samples per type and
+ * sends once a type is full or its oldest sample has waited for the
+ * latency budget.
+ *
+ * The vehicle to boot time offset is the smallest reception delay
+ * seen, re-estimated every LOC_VEHICLE_TIME_SYNC_WINDOW_MS so that
+ * clock drift is followed. Each offset change is reported to the
+ * engine in changeInTimeScales of the next request.
+ *-------------------------------------------------------------------*/
+class LocVehicleSensorInjector :
+        public LocSampleInjector<LocVehicleSensorSample, LocVehicleAlignedSample> {
+
+public:
+    /* source is owned by the injector from here on */
+    LocVehicleSensorInjector(LocVehicleSensorSource* source,
+                             const LocVehicleSensorDataSender& sender,
+                             uint32_t latencyBudgetMs);
+    virtual ~LocVehicleSensorInjector();
+
+protected:
+    virtual void onStart();
+    virtual void receive(const LocVehicleSensorSample& sample, uint64_t nowNs,
+                         LocVehicleAlignedSample& aligned);
+    virtual void stage(const LocVehicleAlignedSample& aligned);
+    virtual bool isBatchDue(uint64_t nowNs) const;
+    virtual void sendBatch();
+
+private:
+    /* samples of one type waiting to be sent */
+    struct Staging {
+        LocVehicleAlignedSample samples[QMI_LOC_VEHICLE_SENSOR_DATA_MAX_SAMPLES_V02];
+        uint32_t count;
+    };
+
+    LocVehicleSensorDataSender mSendFn;
+
+    /* time base estimation, reader thread only */
+    bool mTimeOffsetValid;
+    int64_t mTimeOffsetNs;
+    int64_t mWindowMinOffsetNs;
+    uint64_t mWindowStartNs;
+
+    /* sender thread only */
+    Staging mStaging[LOC_VEHICLE_SENSOR_TYPE_MAX];
+    int64_t mStagedTimeOffsetNs;
+    bool mSentTimeOffsetValid;
+    int64_t mSentTimeOffsetNs;
+    qmiLocInjectVehicleSensorDataReqMsgT_v02 mReq;
+
+    bool fitsStaging(const LocVehicleAlignedSample& aligned) const;
+};
+
+#endif /* LOC_VEHICLE_SENSOR_INJECTOR_H */
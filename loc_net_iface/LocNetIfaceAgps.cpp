@@ -29,18 +29,71 @@
 #define LOG_TAG "LocSvc_LocNetIfaceHolder"
 
 #include <LocNetIfaceAgps.h>
+#include <LocNetTrace.h>
 #include <loc_pla.h>
 #include <log_util.h>
+#include <inttypes.h>
+#include <string>
 
 /* LocNetIfaceAgps members */
-LocNetIface* LocNetIfaceAgps::sLocNetIfaceAgpsInternet = NULL;
-LocNetIface* LocNetIfaceAgps::sLocNetIfaceAgpsSupl = NULL;
-LocNetAgpsState LocNetIfaceAgps::sAgpsStateInternet = LOC_NET_AGPS_STATE_CLOSED;
-LocNetAgpsState LocNetIfaceAgps::sAgpsStateSupl = LOC_NET_AGPS_STATE_CLOSED;
+LocNetAgpsConn LocNetIfaceAgps::sConns[LOC_NET_AGPS_CONN_MAX] = {
+    { LOC_AGPS_TYPE_SUPL, LOC_NET_CONN_TYPE_WWAN_SUPL,
+      NULL, LOC_NET_AGPS_STATE_CLOSED },
+    { LOC_AGPS_TYPE_WWAN_ANY, LOC_NET_CONN_TYPE_WWAN_INTERNET,
+      NULL, LOC_NET_AGPS_STATE_CLOSED },
+    { LOC_AGPS_TYPE_SUPL_ES, LOC_NET_CONN_TYPE_WWAN_EMERGENCY,
+      NULL, LOC_NET_AGPS_STATE_CLOSED }
+};
 LocAgpsOpenResultCb LocNetIfaceAgps::sAgpsOpenResultCb = NULL;
 LocAgpsCloseResultCb LocNetIfaceAgps::sAgpsCloseResultCb = NULL;
 void* LocNetIfaceAgps::sUserDataPtr = NULL;
 AgpsCbInfo LocNetIfaceAgps::sAgpsCbInfo = {};
+MsgTask* LocNetIfaceAgps::sMsgTask = NULL;
+
+/* AGPS request / release from HAL */
+struct LocNetAgpsStatusMsg : public LocMsg {
+    AGnssExtStatusIpV4 mStatus;
+    uint32_t mTraceCorrId;
+    inline LocNetAgpsStatusMsg(const AGnssExtStatusIpV4& status,
+            uint32_t traceCorrId) :
+            LocMsg(), mStatus(status), mTraceCorrId(traceCorrId) {}
+    inline virtual void proc() const {
+        LocNetAgpsConn* conn = LocNetIfaceAgps::getConn(mStatus.type);
+        if (conn == NULL) {
+            LOC_LOGE("Unsupported AGPS type %d", mStatus.type);
+        } else if (mStatus.status == LOC_GPS_REQUEST_AGPS_DATA_CONN) {
+            LocNetIfaceAgps::handleRequest(*conn, mTraceCorrId);
+        } else if (mStatus.status == LOC_GPS_RELEASE_AGPS_DATA_CONN) {
+            LocNetIfaceAgps::handleRelease(*conn);
+        } else {
+            LOC_LOGE("Unsupported AGPS action %d", mStatus.status);
+        }
+    }
+};
+
+/* Call event from a LocNetIface instance */
+struct LocNetAgpsCallEventMsg : public LocMsg {
+    void* mUserDataPtr;
+    LocNetWwanCallEvent mEvent;
+    bool mHasApn;
+    std::string mApn;
+    LocNetConnIpType mApnIpType;
+    inline LocNetAgpsCallEventMsg(void* userDataPtr,
+            LocNetWwanCallEvent event, const char* apn,
+            LocNetConnIpType apnIpType) :
+            LocMsg(), mUserDataPtr(userDataPtr), mEvent(event),
+            mHasApn(apn != NULL), mApn(apn != NULL ? apn : ""),
+            mApnIpType(apnIpType) {}
+    inline virtual void proc() const {
+        LocNetAgpsConn* conn = LocNetIfaceAgps::getConn(mUserDataPtr);
+        if (conn == NULL) {
+            LOC_LOGE("Invalid user data ptr %p", mUserDataPtr);
+            return;
+        }
+        LocNetIfaceAgps::handleCallEvent(*conn, mEvent,
+                mHasApn ? mApn.c_str() : NULL, mApnIpType);
+    }
+};
 
 /* Method accessed from HAL */
 AgpsCbInfo& LocNetIfaceAgps_getAgpsCbInfo(
@@ -54,27 +107,20 @@ AgpsCbInfo& LocNetIfaceAgps_getAgpsCbInfo(
     LocNetIfaceAgps::sAgpsCloseResultCb = closeResultCb;
     LocNetIfaceAgps::sUserDataPtr = userDataPtr;
 
+    if (LocNetIfaceAgps::sMsgTask == NULL) {
+        LocNetIfaceAgps::sMsgTask = new MsgTask("LocNetIfaceAgps", false);
+    }
+
     /* Create LocNetIface instances */
-    if (LocNetIfaceAgps::sLocNetIfaceAgpsInternet == NULL) {
-        LocNetIfaceAgps::sLocNetIfaceAgpsInternet =
-                new LocNetIface(LOC_NET_CONN_TYPE_WWAN_INTERNET);
-        LocNetIfaceAgps::sLocNetIfaceAgpsInternet->
-        registerWwanCallStatusCallback(
-                LocNetIfaceAgps::wwanStatusCallback,
-                LocNetIfaceAgps::sLocNetIfaceAgpsInternet);
-    } else {
-        LOC_LOGE("sLocNetIfaceAgpsInternet not NULL");
-    }
-
-    if (LocNetIfaceAgps::sLocNetIfaceAgpsSupl == NULL) {
-        LocNetIfaceAgps::sLocNetIfaceAgpsSupl =
-                new LocNetIface(LOC_NET_CONN_TYPE_WWAN_SUPL);
-        LocNetIfaceAgps::sLocNetIfaceAgpsSupl->
-        registerWwanCallStatusCallback(
-                LocNetIfaceAgps::wwanStatusCallback,
-                LocNetIfaceAgps::sLocNetIfaceAgpsSupl);
-    } else {
-        LOC_LOGE("sLocNetIfaceAgpsSupl not NULL");
+    for (int i = 0; i < LOC_NET_AGPS_CONN_MAX; i++) {
+        LocNetAgpsConn& conn = LocNetIfaceAgps::sConns[i];
+        if (conn.iface == NULL) {
+            conn.iface = new LocNetIface(conn.connType);
+            conn.iface->registerWwanCallStatusCallback(
+                    LocNetIfaceAgps::wwanStatusCallback, conn.iface);
+        } else {
+            LOC_LOGE("LocNetIface for AGPS type %d not NULL", conn.agpsType);
+        }
     }
 
     /* Return our callback */
@@ -87,88 +133,265 @@ void LocNetIfaceAgps::agpsStatusCb(AGnssExtStatusIpV4 status){
     ENTRY_LOG();
 
     /* Validate */
-    if (sLocNetIfaceAgpsInternet == NULL) {
+    if (sMsgTask == NULL) {
         LOC_LOGE("Not init'd");
         return;
     }
 
+    /* Pick up the trace of the ATL request that led here, if any */
+    uint32_t traceCorrId = 0;
     if (status.status == LOC_GPS_REQUEST_AGPS_DATA_CONN) {
+        traceCorrId = LocNetTrace::findPendingAtlRequest(status.type);
+        if (traceCorrId == 0) {
+            traceCorrId = LocNetTrace::newCorrId();
+        }
+        LocNetTrace::record(traceCorrId, LOC_NET_TRACE_AGPS_REQUEST,
+                status.type, 0);
+    }
 
-        if (status.type == LOC_AGPS_TYPE_SUPL) {
-
-            LOC_LOGV("REQUEST LOC_AGPS_TYPE_SUPL");
-            sAgpsStateSupl = LOC_NET_AGPS_STATE_OPEN_PENDING;
-            if (!sLocNetIfaceAgpsSupl->setupWwanCall()) {
-                LOC_LOGE("Setup wwan call failed !");
-                wwanStatusCallback(
-                        sLocNetIfaceAgpsSupl,
-                        LOC_NET_WWAN_CALL_EVT_OPEN_FAILED,
-                        NULL, LOC_NET_CONN_IP_TYPE_INVALID);
-                sAgpsStateSupl = LOC_NET_AGPS_STATE_CLOSED;
-            }
-        } else if (status.type == LOC_AGPS_TYPE_WWAN_ANY) {
-
-            LOC_LOGV("REQUEST LOC_AGPS_TYPE_WWAN_ANY");
-            sAgpsStateInternet = LOC_NET_AGPS_STATE_OPEN_PENDING;
-            if (!sLocNetIfaceAgpsInternet->connectBackhaul()) {
-                LOC_LOGE("Connect Backhaul failed");
-                wwanStatusCallback(
-                        sLocNetIfaceAgpsInternet,
-                        LOC_NET_WWAN_CALL_EVT_OPEN_FAILED,
-                        NULL, LOC_NET_CONN_IP_TYPE_INVALID);
-                sAgpsStateInternet = LOC_NET_AGPS_STATE_CLOSED;
-            }
-        } else {
+    sMsgTask->sendMsg(new LocNetAgpsStatusMsg(status, traceCorrId));
+}
+
+void LocNetIfaceAgps::wwanStatusCallback(
+            void* userDataPtr, LocNetWwanCallEvent event,
+            const char* apn, LocNetConnIpType apnIpType){
+
+    ENTRY_LOG();
+    LOC_LOGV("event: %d, apnIpType: %d", event, apnIpType);
+
+    /* Events may come synchronously from within openConn / closeConn,
+     * or from DSI / QCMAP threads, queue them behind the request */
+    sMsgTask->sendMsg(
+            new LocNetAgpsCallEventMsg(userDataPtr, event, apn, apnIpType));
+}
 
-            LOC_LOGE("Unsupported AGPS type %d", status.type);
+LocNetAgpsConn* LocNetIfaceAgps::getConn(AGpsExtType agpsType) {
+
+    for (int i = 0; i < LOC_NET_AGPS_CONN_MAX; i++) {
+        if (sConns[i].agpsType == agpsType) {
+            return &sConns[i];
         }
     }
-    else if (status.status == LOC_GPS_RELEASE_AGPS_DATA_CONN) {
+    return NULL;
+}
 
-        if (status.type == LOC_AGPS_TYPE_SUPL) {
+LocNetAgpsConn* LocNetIfaceAgps::getConn(void* userDataPtr) {
 
-            LOC_LOGV("RELEASE LOC_AGPS_TYPE_SUPL");
-            sAgpsStateSupl = LOC_NET_AGPS_STATE_CLOSE_PENDING;
-            if (!sLocNetIfaceAgpsSupl->stopWwanCall()) {
-                LOC_LOGE("Stop wwan call failed !");
-                wwanStatusCallback(
-                        sLocNetIfaceAgpsSupl,
-                        LOC_NET_WWAN_CALL_EVT_CLOSE_FAILED,
-                        NULL, LOC_NET_CONN_IP_TYPE_INVALID);
-                sAgpsStateSupl = LOC_NET_AGPS_STATE_CLOSED;
-            }
-        } else if (status.type == LOC_AGPS_TYPE_WWAN_ANY) {
-
-            LOC_LOGV("RELEASE LOC_AGPS_TYPE_WWAN_ANY");
-            sAgpsStateInternet = LOC_NET_AGPS_STATE_CLOSE_PENDING;
-            if (!sLocNetIfaceAgpsInternet->disconnectBackhaul()) {
-                LOC_LOGE("Disconnect backhaul failed !");
-                wwanStatusCallback(
-                        sLocNetIfaceAgpsInternet,
-                        LOC_NET_WWAN_CALL_EVT_CLOSE_FAILED,
-                        NULL, LOC_NET_CONN_IP_TYPE_INVALID);
-                sAgpsStateInternet = LOC_NET_AGPS_STATE_CLOSED;
-            }
-        } else {
+    for (int i = 0; i < LOC_NET_AGPS_CONN_MAX; i++) {
+        if ((void*)sConns[i].iface == userDataPtr) {
+            return &sConns[i];
+        }
+    }
+    return NULL;
+}
+
+void LocNetIfaceAgps::handleRequest(
+        LocNetAgpsConn& conn, uint32_t traceCorrId) {
+
+    ENTRY_LOG();
+
+    LocNetTrace::record(traceCorrId, LOC_NET_TRACE_AGPS_HANDLED,
+            conn.agpsType, conn.state);
+    /* A pending open stays traced under the request that started it */
+    if (conn.state != LOC_NET_AGPS_STATE_OPEN_PENDING) {
+        conn.traceCorrId = traceCorrId;
+    }
+
+    conn.refCount++;
+    LOC_LOGV("REQUEST AGPS type %d, state %d, refCount %u",
+            conn.agpsType, conn.state, conn.refCount);
+
+    /* Answered once the open completes */
+    if (conn.state != LOC_NET_AGPS_STATE_OPENED) {
+        conn.pendingOpenCount++;
+    }
+
+    switch (conn.state) {
+    case LOC_NET_AGPS_STATE_OPENED:
+        /* Already up, hand it out right away */
+        reportOpenResult(conn, true);
+        break;
+    case LOC_NET_AGPS_STATE_OPEN_PENDING:
+        /* Result reported when the pending open completes,
+         * a close queued by the last holder no longer applies */
+        conn.isCloseQueued = false;
+        break;
+    case LOC_NET_AGPS_STATE_CLOSE_PENDING:
+        LOC_LOGD("Close pending, open queued for AGPS type %d",
+                conn.agpsType);
+        conn.isOpenQueued = true;
+        break;
+    default:
+        openConn(conn);
+    }
+}
+
+void LocNetIfaceAgps::handleRelease(LocNetAgpsConn& conn) {
+
+    ENTRY_LOG();
+    LOC_LOGV("RELEASE AGPS type %d, state %d, refCount %u",
+            conn.agpsType, conn.state, conn.refCount);
+
+    if (conn.refCount == 0) {
+        LOC_LOGW("Release with no holder for AGPS type %d", conn.agpsType);
+        reportCloseResult(conn, true);
+        return;
+    }
+
+    /* Others still hold the connection */
+    conn.refCount--;
+    if (conn.refCount > 0) {
+        reportCloseResult(conn, true);
+        return;
+    }
+
+    switch (conn.state) {
+    case LOC_NET_AGPS_STATE_OPENED:
+        closeConn(conn);
+        break;
+    case LOC_NET_AGPS_STATE_OPEN_PENDING:
+        /* Can't stop a call mid setup, close once it's up */
+        conn.isCloseQueued = true;
+        break;
+    case LOC_NET_AGPS_STATE_CLOSE_PENDING:
+        /* Queued open was never served, just drop it */
+        conn.isOpenQueued = false;
+        reportPendingOpenResults(conn, false);
+        reportCloseResult(conn, true);
+        break;
+    default:
+        reportCloseResult(conn, true);
+    }
+}
 
-            LOC_LOGE("Unsupported AGPS type %d", status.type);
+void LocNetIfaceAgps::handleCallEvent(
+        LocNetAgpsConn& conn, LocNetWwanCallEvent event,
+        const char* apn, LocNetConnIpType apnIpType) {
+
+    ENTRY_LOG();
+
+    int64_t elapsedMs = LocNetIface::getBootTimeMs() - conn.opStartTimeMs;
+
+    if (conn.state == LOC_NET_AGPS_STATE_OPEN_PENDING) {
+        LocNetTrace::record(conn.traceCorrId, LOC_NET_TRACE_CALL_EVENT,
+                conn.agpsType, event);
+    }
+
+    /* Complete AGPS call flow */
+    if (event == LOC_NET_WWAN_CALL_EVT_OPEN_SUCCESS &&
+            conn.state == LOC_NET_AGPS_STATE_OPEN_PENDING) {
+        LOC_LOGV("LOC_NET_WWAN_CALL_EVT_OPEN_SUCCESS");
+        conn.setupCount++;
+        conn.setupTotalMs += elapsedMs;
+        LOC_LOGI("AGPS type %d open took %" PRId64 " ms, avg %" PRId64
+                " ms over %u", conn.agpsType, elapsedMs,
+                conn.setupTotalMs / conn.setupCount, conn.setupCount);
+        strlcpy(conn.apn, (apn != NULL) ? apn : "", sizeof(conn.apn));
+        conn.apnIpType = apnIpType;
+        conn.state = LOC_NET_AGPS_STATE_OPENED;
+        reportPendingOpenResults(conn, true);
+        if (conn.isCloseQueued) {
+            conn.isCloseQueued = false;
+            closeConn(conn);
+        }
+    }
+    else if (event == LOC_NET_WWAN_CALL_EVT_OPEN_FAILED &&
+            conn.state == LOC_NET_AGPS_STATE_OPEN_PENDING) {
+        LOC_LOGE("LOC_NET_WWAN_CALL_EVT_OPEN_FAILED");
+        conn.state = LOC_NET_AGPS_STATE_CLOSED;
+        reportPendingOpenResults(conn, false);
+        conn.refCount = 0;
+        if (conn.isCloseQueued) {
+            conn.isCloseQueued = false;
+            reportCloseResult(conn, true);
+        }
+    }
+    else if ((event == LOC_NET_WWAN_CALL_EVT_CLOSE_SUCCESS ||
+            event == LOC_NET_WWAN_CALL_EVT_CLOSE_FAILED) &&
+            conn.state == LOC_NET_AGPS_STATE_CLOSE_PENDING) {
+        bool isSuccess = (event == LOC_NET_WWAN_CALL_EVT_CLOSE_SUCCESS);
+        if (isSuccess) {
+            LOC_LOGV("LOC_NET_WWAN_CALL_EVT_CLOSE_SUCCESS");
+            conn.teardownCount++;
+            conn.teardownTotalMs += elapsedMs;
+            LOC_LOGI("AGPS type %d close took %" PRId64 " ms, avg %" PRId64
+                    " ms over %u", conn.agpsType, elapsedMs,
+                    conn.teardownTotalMs / conn.teardownCount,
+                    conn.teardownCount);
+        } else {
+            LOC_LOGE("LOC_NET_WWAN_CALL_EVT_CLOSE_FAILED");
+        }
+        conn.state = LOC_NET_AGPS_STATE_CLOSED;
+        reportCloseResult(conn, isSuccess);
+        if (conn.isOpenQueued) {
+            conn.isOpenQueued = false;
+            LOC_LOGD("Starting queued open for AGPS type %d", conn.agpsType);
+            openConn(conn);
         }
     }
     else {
-        LOC_LOGE("Unsupported AGPS action %d", status.status);
+        LOC_LOGE("Unsupported event %d, type %d, state %d",
+                event, conn.agpsType, conn.state);
     }
 }
 
-void LocNetIfaceAgps::wwanStatusCallback(
-            void* userDataPtr, LocNetWwanCallEvent event,
-            const char* apn, LocNetConnIpType apnIpType){
+void LocNetIfaceAgps::openConn(LocNetAgpsConn& conn) {
 
     ENTRY_LOG();
-    LOC_LOGV("event: %d, apnIpType: %d", event, apnIpType);
+
+    conn.state = LOC_NET_AGPS_STATE_OPEN_PENDING;
+    conn.isCloseQueued = false;
+    conn.opStartTimeMs = LocNetIface::getBootTimeMs();
+
+    LocNetTrace::record(conn.traceCorrId, LOC_NET_TRACE_CALL_SETUP,
+            conn.agpsType, 0);
+    conn.iface->setTraceCorrId(conn.traceCorrId);
+
+    bool ret = (conn.connType == LOC_NET_CONN_TYPE_WWAN_INTERNET) ?
+            conn.iface->connectBackhaul() : conn.iface->setupWwanCall();
+    if (!ret) {
+        LOC_LOGE("Open failed for AGPS type %d", conn.agpsType);
+        conn.state = LOC_NET_AGPS_STATE_CLOSED;
+        reportPendingOpenResults(conn, false);
+        conn.refCount = 0;
+    }
+}
+
+void LocNetIfaceAgps::closeConn(LocNetAgpsConn& conn) {
+
+    ENTRY_LOG();
+
+    conn.state = LOC_NET_AGPS_STATE_CLOSE_PENDING;
+    conn.opStartTimeMs = LocNetIface::getBootTimeMs();
+
+    bool ret = (conn.connType == LOC_NET_CONN_TYPE_WWAN_INTERNET) ?
+            conn.iface->disconnectBackhaul() : conn.iface->stopWwanCall();
+    if (!ret) {
+        LOC_LOGE("Close failed for AGPS type %d", conn.agpsType);
+        conn.state = LOC_NET_AGPS_STATE_CLOSED;
+        reportCloseResult(conn, false);
+        if (conn.isOpenQueued) {
+            conn.isOpenQueued = false;
+            openConn(conn);
+        }
+    }
+}
+
+void LocNetIfaceAgps::reportPendingOpenResults(
+        LocNetAgpsConn& conn, bool isSuccess) {
+
+    LOC_LOGV("Open result %d to %u waiters, AGPS type %d",
+            isSuccess, conn.pendingOpenCount, conn.agpsType);
+    for (; conn.pendingOpenCount > 0; conn.pendingOpenCount--) {
+        reportOpenResult(conn, isSuccess);
+    }
+}
+
+void LocNetIfaceAgps::reportOpenResult(LocNetAgpsConn& conn, bool isSuccess) {
 
     /* Derive bearer type */
     AGpsBearerType bearerType = AGPS_APN_BEARER_INVALID;
-    switch (apnIpType) {
+    switch (conn.apnIpType) {
         case LOC_NET_CONN_IP_TYPE_V4:
             bearerType = AGPS_APN_BEARER_IPV4;
             break;
@@ -179,54 +402,30 @@ void LocNetIfaceAgps::wwanStatusCallback(
             bearerType = AGPS_APN_BEARER_IPV4V6;
             break;
         default:
-            LOC_LOGE("Invalid APN IP type %d", apnIpType);
+            if (isSuccess) {
+                LOC_LOGE("Invalid APN IP type %d", conn.apnIpType);
+            }
     }
 
-    /* Derive AGPS type */
-    AGpsExtType agpsType = LOC_AGPS_TYPE_INVALID;
-    LocNetAgpsState* agpsStatePtr = NULL;
-    if (userDataPtr == (void*)sLocNetIfaceAgpsInternet) {
-        agpsType = LOC_AGPS_TYPE_WWAN_ANY;
-        agpsStatePtr = &sAgpsStateInternet;
-    }
-    else if (userDataPtr == (void*)sLocNetIfaceAgpsSupl) {
-        agpsType = LOC_AGPS_TYPE_SUPL;
-        agpsStatePtr = &sAgpsStateSupl;
-    }
-    else {
-        LOC_LOGE("Invalid user data ptr %p", userDataPtr);
-        return;
+    LocNetTrace::record(conn.traceCorrId, LOC_NET_TRACE_AGPS_OPEN_RESULT,
+            conn.agpsType, isSuccess);
+    if (sAgpsOpenResultCb != NULL) {
+        sAgpsOpenResultCb(isSuccess, conn.agpsType,
+                isSuccess ? conn.apn : NULL, bearerType, sUserDataPtr);
     }
 
-    /* Complete AGPS call flow */
-    if (event == LOC_NET_WWAN_CALL_EVT_OPEN_SUCCESS &&
-            *agpsStatePtr == LOC_NET_AGPS_STATE_OPEN_PENDING) {
-        LOC_LOGV("LOC_NET_WWAN_CALL_EVT_OPEN_SUCCESS");
-        sAgpsOpenResultCb(
-                true, agpsType, apn, bearerType, sUserDataPtr);
-        *agpsStatePtr = LOC_NET_AGPS_STATE_OPENED;
-    }
-    else if (event == LOC_NET_WWAN_CALL_EVT_OPEN_FAILED &&
-            *agpsStatePtr == LOC_NET_AGPS_STATE_OPEN_PENDING) {
-        LOC_LOGE("LOC_NET_WWAN_CALL_EVT_OPEN_FAILED");
-        sAgpsOpenResultCb(
-                false, agpsType, apn, bearerType, sUserDataPtr);
-        *agpsStatePtr = LOC_NET_AGPS_STATE_CLOSED;
-    }
-    else if (event == LOC_NET_WWAN_CALL_EVT_CLOSE_SUCCESS &&
-            *agpsStatePtr == LOC_NET_AGPS_STATE_CLOSE_PENDING) {
-        LOC_LOGV("LOC_NET_WWAN_CALL_EVT_CLOSE_SUCCESS");
-        sAgpsCloseResultCb(true, agpsType, sUserDataPtr);
-        *agpsStatePtr = LOC_NET_AGPS_STATE_CLOSED;
-    }
-    else if (event == LOC_NET_WWAN_CALL_EVT_CLOSE_FAILED &&
-            *agpsStatePtr == LOC_NET_AGPS_STATE_CLOSE_PENDING) {
-        LOC_LOGE("LOC_NET_WWAN_CALL_EVT_CLOSE_FAILED");
-        sAgpsCloseResultCb(false, agpsType, sUserDataPtr);
-        *agpsStatePtr = LOC_NET_AGPS_STATE_CLOSED;
+    /* Breakdown is logged once LocApiV02 sends the status to the modem,
+     * log it here for requests that didn't come through it */
+    LocNetTraceBreakdown breakdown;
+    if (LocNetTrace::getBreakdown(conn.traceCorrId, breakdown) &&
+            breakdown.stageTimeMs[LOC_NET_TRACE_ATL_REQUEST] == 0) {
+        LocNetTrace::logBreakdown(conn.traceCorrId);
     }
-    else {
-        LOC_LOGE("Unsupported event %d, type %d, state %d",
-                event, agpsType, *agpsStatePtr);
+}
+
+void LocNetIfaceAgps::reportCloseResult(LocNetAgpsConn& conn, bool isSuccess) {
+
+    if (sAgpsCloseResultCb != NULL) {
+        sAgpsCloseResultCb(isSuccess, conn.agpsType, sUserDataPtr);
     }
 }
@@ -30,6 +30,7 @@
 
 #include <LocNetIface.h>
 #include <gps_extended_c.h>
+#include <MsgTask.h>
 
 /* AGPS state Enum */
 typedef enum {
@@ -41,11 +42,44 @@ typedef enum {
     LOC_NET_AGPS_STATE_MAX
 } LocNetAgpsState;
 
+/* AGPS data connection, shared by all requests for one AGPS type */
+typedef struct {
+    AGpsExtType agpsType;
+    LocNetConnType connType;
+    LocNetIface* iface;
+    LocNetAgpsState state;
+    /* Requests currently holding or waiting for the connection */
+    uint32_t refCount;
+    /* Requests still waiting for an open result, each gets one */
+    uint32_t pendingOpenCount;
+    /* Open requested while a close was pending */
+    bool isOpenQueued;
+    /* Last holder released while the open was pending */
+    bool isCloseQueued;
+    /* APN and IP type reported by the last successful open */
+    char apn[APN_NAME_MAX_LEN];
+    LocNetConnIpType apnIpType;
+    /* Setup / teardown latency */
+    int64_t opStartTimeMs;
+    uint32_t setupCount;
+    int64_t setupTotalMs;
+    uint32_t teardownCount;
+    int64_t teardownTotalMs;
+    /* LocNetTrace correlation id of the request being served */
+    uint32_t traceCorrId;
+} LocNetAgpsConn;
+
+#define LOC_NET_AGPS_CONN_MAX 3
+
 /*--------------------------------------------------------------------
  * CLASS LocNetIfaceAgps
  *
  * Functionality:
- * This class holds reference to LocNetIface instances for AGPS
+ * This class holds reference to LocNetIface instances for AGPS.
+ * Requests are reference counted per AGPS type, so overlapping
+ * requests share one data call, and an open arriving while a close is
+ * pending is queued behind it instead of failing. All requests and
+ * call events are handled in order on sMsgTask.
  *-------------------------------------------------------------------*/
 class LocNetIfaceAgps {
 
@@ -53,24 +87,38 @@ public:
     /* status method registered as part of AGPS Extended callbacks */
     static void agpsStatusCb(AGnssExtStatusIpV4 status);
 
-    /* Callbacks registered with Internet and SUPL LocNetIface instances */
+    /* Callbacks registered with LocNetIface instances */
     static void wwanStatusCallback(
             void* userDataPtr, LocNetWwanCallEvent event,
             const char* apn, LocNetConnIpType apnIpType);
 
-    /* LocNetIface instances for different clients */
-    static LocNetIface* sLocNetIfaceAgpsInternet;
-    static LocNetIface* sLocNetIfaceAgpsSupl;
-
-    /* AGPS states */
-    static LocNetAgpsState sAgpsStateInternet;
-    static LocNetAgpsState sAgpsStateSupl;
+    /* Connections for SUPL, Internet and emergency SUPL */
+    static LocNetAgpsConn sConns[LOC_NET_AGPS_CONN_MAX];
 
     /* AGPS interface methods to be invoked on call setup/failure */
     static LocAgpsOpenResultCb sAgpsOpenResultCb;
     static LocAgpsCloseResultCb sAgpsCloseResultCb;
     static void* sUserDataPtr;
     static AgpsCbInfo sAgpsCbInfo;
+
+    /* Thread serializing AGPS requests and call events */
+    static MsgTask* sMsgTask;
+
+    /* Below run on sMsgTask only */
+    static LocNetAgpsConn* getConn(AGpsExtType agpsType);
+    static LocNetAgpsConn* getConn(void* userDataPtr);
+    static void handleRequest(LocNetAgpsConn& conn, uint32_t traceCorrId);
+    static void handleRelease(LocNetAgpsConn& conn);
+    static void handleCallEvent(
+            LocNetAgpsConn& conn, LocNetWwanCallEvent event,
+            const char* apn, LocNetConnIpType apnIpType);
+
+private:
+    static void openConn(LocNetAgpsConn& conn);
+    static void closeConn(LocNetAgpsConn& conn);
+    static void reportOpenResult(LocNetAgpsConn& conn, bool isSuccess);
+    static void reportPendingOpenResults(LocNetAgpsConn& conn, bool isSuccess);
+    static void reportCloseResult(LocNetAgpsConn& conn, bool isSuccess);
 };
 
 /* Global method accessed from HAL to fetch AGPS status cb */
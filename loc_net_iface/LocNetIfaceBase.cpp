@@ -31,12 +31,11 @@
 #include <loc_pla.h>
 #include <log_util.h>
 #include <loc_cfg.h>
+#include <time.h>
 
-/* Data Item notify callback
- * Only one instance of LocNetIfaceBase can register this callback.
- * No support for multiple clients */
-LocNetStatusChangeCb LocNetIfaceBase::sNotifyCb = NULL;
-void* LocNetIfaceBase::sNotifyCbUserDataPtr = NULL;
+/* Data Item notification clients */
+std::vector<LocNetIfaceBase*> LocNetIfaceBase::sNotifyClients;
+std::recursive_mutex LocNetIfaceBase::sNotifyClientsMutex;
 
 void LocNetIfaceBase::registerWwanCallStatusCallback(
         LocWwanCallStatusCb wwanCallStatusCb, void* userDataPtr) {
@@ -52,47 +51,152 @@ void LocNetIfaceBase::registerDataItemNotifyCallback(
 
     ENTRY_LOG();
 
-    if (LocNetIfaceBase::sNotifyCb != NULL) {
+    std::lock_guard<std::recursive_mutex> guard(sNotifyClientsMutex);
+
+    if (mNotifyCb != NULL) {
         LOC_LOGE("Notify cb already registered !");
         return;
     }
 
-    LocNetIfaceBase::sNotifyCb = callback;
-    LocNetIfaceBase::sNotifyCbUserDataPtr = userDataPtr;
+    mNotifyCb = callback;
+    mNotifyCbUserDataPtr = userDataPtr;
+    sNotifyClients.push_back(this);
+    LOC_LOGD("%zu notification clients", sNotifyClients.size());
 }
 
-bool LocNetIfaceBase::updateSubscribedItemList(
-        const std::list<DataItemId>& itemList, bool addOrDelete){
+void LocNetIfaceBase::unregisterDataItemNotifyCallback() {
 
-    ENTRY_LOG();
-    bool anyUpdatesToList = false;
+    std::lock_guard<std::recursive_mutex> guard(sNotifyClientsMutex);
 
-    /* Scroll through specified item list */
-    std::list<DataItemId>::const_iterator it = itemList.begin();
-    for (; it != itemList.end(); it++) {
+    if (mNotifyCb == NULL) {
+        return;
+    }
+    for (auto it = sNotifyClients.begin(); it != sNotifyClients.end(); it++) {
+        if (*it == this) {
+            sNotifyClients.erase(it);
+            break;
+        }
+    }
+    mNotifyCb = NULL;
+    mNotifyCbUserDataPtr = NULL;
+}
 
-        DataItemId itemId = *it;
+void LocNetIfaceBase::notifyClients(std::list<IDataItemCore*>& itemList) {
+
+    std::lock_guard<std::recursive_mutex> guard(sNotifyClientsMutex);
+
+    for (size_t i = 0; i < sNotifyClients.size(); i++) {
+        LocNetIfaceBase* client = sNotifyClients[i];
+
+        /* Only the items this client subscribed to */
+        std::list<IDataItemCore*> clientItemList;
+        for (auto it = itemList.begin(); it != itemList.end(); it++) {
+            if (client->isItemSubscribed((*it)->getId())) {
+                clientItemList.push_back(*it);
+            }
+        }
+        if (!clientItemList.empty()) {
+            client->mNotifyCb(client->mNotifyCbUserDataPtr, clientItemList);
+        }
+    }
+}
 
-        bool itemInSubscribedList = isItemSubscribed(itemId);
+void LocNetIfaceBase::notifyRequester(std::list<IDataItemCore*>& itemList) {
 
-        /* Request to add */
-        if (addOrDelete == true && !itemInSubscribedList) {
+    std::lock_guard<std::recursive_mutex> guard(sNotifyClientsMutex);
+
+    if (mNotifyCb == NULL) {
+        LOC_LOGE("No notify callback registered !");
+        return;
+    }
+    if (!itemList.empty()) {
+        mNotifyCb(mNotifyCbUserDataPtr, itemList);
+    }
+}
 
-            mSubscribedItemList.push_back(itemId);
-            anyUpdatesToList = true;
+bool LocNetIfaceBase::hasNotifyClients() {
 
-        } else if (addOrDelete == false && itemInSubscribedList) {
-            /* Request to delete */
-            mSubscribedItemList.erase(
-                    std::remove(
-                            mSubscribedItemList.begin(),
-                            mSubscribedItemList.end(), itemId),
-                            mSubscribedItemList.end());
-            anyUpdatesToList = true;
+    std::lock_guard<std::recursive_mutex> guard(sNotifyClientsMutex);
+    return !sNotifyClients.empty();
+}
+
+bool LocNetIfaceBase::isItemSubscribedByAnyClient(DataItemId itemId) {
+
+    std::lock_guard<std::recursive_mutex> guard(sNotifyClientsMutex);
+
+    for (size_t i = 0; i < sNotifyClients.size(); i++) {
+        if (sNotifyClients[i]->isItemSubscribed(itemId)) {
+            return true;
         }
     }
+    return false;
+}
 
-    return anyUpdatesToList;
+void LocNetIfaceBase::subscribe(
+        const std::list<DataItemId>& itemListToSubscribe) {
+
+    DataItemId items[MAX_DATA_ITEM_ID];
+    subscribe(items, toItemArray(itemListToSubscribe, items));
+}
+
+void LocNetIfaceBase::unsubscribe(
+        const std::list<DataItemId>& itemListToUnsubscribe) {
+
+    DataItemId items[MAX_DATA_ITEM_ID];
+    unsubscribe(items, toItemArray(itemListToUnsubscribe, items));
+}
+
+void LocNetIfaceBase::requestData(
+        const std::list<DataItemId>& itemListToRequestData) {
+
+    DataItemId items[MAX_DATA_ITEM_ID];
+    requestData(items, toItemArray(itemListToRequestData, items));
+}
+
+size_t LocNetIfaceBase::toItemArray(
+        const std::list<DataItemId>& itemList, DataItemId* items) {
+
+    std::bitset<MAX_DATA_ITEM_ID> seen;
+    size_t count = 0;
+
+    std::list<DataItemId>::const_iterator it = itemList.begin();
+    for (; it != itemList.end(); it++) {
+        DataItemId itemId = *it;
+        if (itemId < 0 || itemId >= MAX_DATA_ITEM_ID) {
+            LOC_LOGE("Invalid data item id %d", itemId);
+        } else if (!seen.test(itemId)) {
+            seen.set(itemId);
+            items[count++] = itemId;
+        }
+    }
+    return count;
+}
+
+bool LocNetIfaceBase::updateSubscribedItems(
+        const DataItemId* items, size_t count, bool addOrDelete){
+
+    ENTRY_LOG();
+    std::lock_guard<std::recursive_mutex> guard(sNotifyClientsMutex);
+
+    /* Set or clear the bit for each valid item */
+    std::bitset<MAX_DATA_ITEM_ID> prev = mSubscribedItems;
+    for (size_t i = 0; i < count; i++) {
+        DataItemId itemId = items[i];
+        if (itemId < 0 || itemId >= MAX_DATA_ITEM_ID) {
+            LOC_LOGE("Invalid data item id %d", itemId);
+            continue;
+        }
+        mSubscribedItems.set(itemId, addOrDelete);
+    }
+
+    return prev != mSubscribedItems;
+}
+
+int64_t LocNetIfaceBase::getBootTimeMs(){
+
+    struct timespec ts = {};
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
 char* LocNetIfaceBase::getApnNameFromConfig(){
@@ -126,8 +230,21 @@ void LocNetIfaceBase::fetchConfigItems(){
 
     } else if (mLocNetConnType == LOC_NET_CONN_TYPE_WWAN_SUPL) {
         loc_param_s_type confItemsToFetchArray[] = {
-                { "SUPL_APN",     &mApnName, NULL, 's' },
-                { "SUPL_IP_TYPE", &mIpType,  NULL, 'n' } };
+                { "SUPL_APN",            &mApnName,      NULL, 's' },
+                { "SUPL_IP_TYPE",        &mIpType,       NULL, 'n' },
+                { "SUPL_CALL_LINGER_MS", &mCallLingerMs, NULL, 'n' } };
+        UTIL_READ_CONF(LOC_PATH_GPS_CONF, confItemsToFetchArray);
+
+    } else if (mLocNetConnType == LOC_NET_CONN_TYPE_WWAN_EMERGENCY) {
+        loc_param_s_type confItemsToFetchArray[] = {
+                { "EMERGENCY_APN",     &mApnName, NULL, 's' },
+                { "EMERGENCY_IP_TYPE", &mIpType,  NULL, 'n' } };
+        UTIL_READ_CONF(LOC_PATH_GPS_CONF, confItemsToFetchArray);
+
+    } else if (mLocNetConnType == LOC_NET_CONN_TYPE_WWAN_IMS) {
+        loc_param_s_type confItemsToFetchArray[] = {
+                { "IMS_APN",     &mApnName, NULL, 's' },
+                { "IMS_IP_TYPE", &mIpType,  NULL, 'n' } };
         UTIL_READ_CONF(LOC_PATH_GPS_CONF, confItemsToFetchArray);
 
     } else {
@@ -30,9 +30,11 @@
 
 #include <IDataItemCore.h>
 #include <loc_gps.h>
-#include <algorithm>
-#include <vector>
+#include <bitset>
 #include <list>
+#include <vector>
+#include <mutex>
+#include <atomic>
 #include <string.h>
 
 using namespace loc_core;
@@ -47,6 +49,7 @@ typedef enum {
     LOC_NET_CONN_TYPE_WWAN_INTERNET = 201,
     LOC_NET_CONN_TYPE_WWAN_SUPL = 205,
     LOC_NET_CONN_TYPE_WWAN_EMERGENCY = 206,
+    LOC_NET_CONN_TYPE_WWAN_IMS = 207,
     LOC_NET_CONN_TYPE_MAX
 } LocNetConnType;
 
@@ -122,36 +125,66 @@ public:
             LocWwanCallStatusCb wwanCallStatusCb, void* userDataPtr);
 
     /* Register for data items */
-    virtual void subscribe(
-            const std::list<DataItemId>& itemListToSubscribe) = 0;
+    virtual void subscribe(const DataItemId* items, size_t count) = 0;
 
     /* Unregister for data items */
-    virtual void unsubscribe(
-            const std::list<DataItemId>& itemListToUnsubscribe) = 0;
+    virtual void unsubscribe(const DataItemId* items, size_t count) = 0;
 
     /* Unregister all data items */
     virtual void unsubscribeAll() = 0;
 
-    /* Request data items current value */
-    virtual void requestData(
-            const std::list<DataItemId>& itemListToRequestData) = 0;
+    /* Request data items current value
+     * Values are sent to this instance's notification callback whether
+     * or not the items are subscribed, and to no other client. */
+    virtual void requestData(const DataItemId* items, size_t count) = 0;
+
+    /* List based variants of above, for existing callers.
+     * Items are copied to the stack, no heap allocation. */
+    void subscribe(const std::list<DataItemId>& itemListToSubscribe);
+    void unsubscribe(const std::list<DataItemId>& itemListToUnsubscribe);
+    void requestData(const std::list<DataItemId>& itemListToRequestData);
 
-    /* Register Notification callback  */
+    /* Register Notification callback
+     * Any number of instances can register one, each is notified only
+     * of the data items subscribed on that same instance. */
     void registerDataItemNotifyCallback(
             LocNetStatusChangeCb callback, void* userDataPtr);
+    void unregisterDataItemNotifyCallback();
 
     /* Virtual destructor since we have other virtual methods */
-    virtual ~LocNetIfaceBase() {};
+    virtual ~LocNetIfaceBase() { unregisterDataItemNotifyCallback(); };
+
+    /* Current CLOCK_BOOTTIME in milliseconds, for call latency stats */
+    static int64_t getBootTimeMs();
+
+    /* LocNetTrace correlation id of the open driving the next call
+     * setup, 0 if not traced */
+    inline void setTraceCorrId(uint32_t corrId) { mTraceCorrId = corrId; }
 
 protected:
-    /* List of data items subscribed at any instant */
-    std::vector<DataItemId> mSubscribedItemList;
+    /* Data items subscribed at any instant, indexed by DataItemId.
+     * Other clients' threads read it, so it is only accessed with
+     * sNotifyClientsMutex held. */
+    std::bitset<MAX_DATA_ITEM_ID> mSubscribedItems;
 
-    /* Data Item notification callback registered.
-     * This information is not instance specific, supports only single
-     * client. */
-    static LocNetStatusChangeCb sNotifyCb;
-    static void* sNotifyCbUserDataPtr;
+    /* Data Item notification callback registered on this instance */
+    LocNetStatusChangeCb mNotifyCb;
+    void* mNotifyCbUserDataPtr;
+
+    /* Instances with a notification callback, i.e. notification clients.
+     * Callbacks are invoked with sNotifyClientsMutex held, which keeps
+     * clients from going away mid dispatch. It is recursive so that a
+     * callback can still subscribe or request data. */
+    static std::vector<LocNetIfaceBase*> sNotifyClients;
+    static std::recursive_mutex sNotifyClientsMutex;
+
+    /* Dispatch items to each client subscribed to them */
+    static void notifyClients(std::list<IDataItemCore*>& itemList);
+    /* Dispatch all items to this instance only, for requestData() */
+    void notifyRequester(std::list<IDataItemCore*>& itemList);
+    static bool hasNotifyClients();
+    /* True if any client is subscribed to itemId */
+    static bool isItemSubscribedByAnyClient(DataItemId itemId);
 
     /* WWAN data call setup callback */
     LocWwanCallStatusCb mWwanCallStatusCb;
@@ -160,14 +193,22 @@ protected:
     /* WWAN Call type supported by this instance */
     LocNetConnType mLocNetConnType;
 
+    /* See setTraceCorrId() */
+    std::atomic<uint32_t> mTraceCorrId;
+
     /* Config items */
     char mApnName[APN_NAME_MAX_LEN];
     int  mIpType;
+    /* How long a released data call is kept up for reuse, 0 tears it
+     * down right away */
+    int  mCallLingerMs;
 
     LocNetIfaceBase(LocNetConnType connType) :
-        mSubscribedItemList(), mWwanCallStatusCb(NULL),
+        mSubscribedItems(), mNotifyCb(NULL), mNotifyCbUserDataPtr(NULL),
+        mWwanCallStatusCb(NULL),
         mWwanCbUserDataPtr(NULL), mLocNetConnType(connType),
-        mIpType(0) {
+        mTraceCorrId(0),
+        mIpType(0), mCallLingerMs(0) {
 
         memset(mApnName, 0, APN_NAME_MAX_LEN);
         fetchConfigItems();
@@ -179,29 +220,44 @@ protected:
     /* Fetch configured APN for specified call type
      * APNs can be configured in gps.conf as:
      * INTERNET_APN = xyz
-     * SUPL_APN = xyz */
+     * SUPL_APN = xyz
+     * EMERGENCY_APN = xyz
+     * IMS_APN = xyz */
     char* getApnNameFromConfig();
 
+    /* Data call linger time for specified call type
+     * Can be configured in gps.conf as:
+     * SUPL_CALL_LINGER_MS = 10000 */
+    inline int getCallLingerMsFromConfig() { return mCallLingerMs; }
+
     /* Fetch configured IP Type for specified call type
      * IP Type can be configured in gps.conf as:
      * INTERNET_IP_TYPE = 4 / 6 / 10
-     * SUPL_IP_TYPE = 4 / 6 / 10 */
+     * SUPL_IP_TYPE = 4 / 6 / 10
+     * EMERGENCY_IP_TYPE = 4 / 6 / 10
+     * IMS_IP_TYPE = 4 / 6 / 10 */
     LocNetConnIpType getIpTypeFromConfig();
 
-    /* Update the subscribed item list
-     * addOrDelete: true = append items to subscribed list
-     *              false = delete items from subscribed list
+    /* Update the subscribed items
+     * addOrDelete: true = add items to subscription
+     *              false = delete items from subscription
      * Just a utility method to be used from platform specific sub-classes
-     * Returns true if any updates are made to the subscription list,
+     * Returns true if any updates are made to the subscription,
      * or else false. */
-    bool updateSubscribedItemList(
-            const std::list<DataItemId>& itemList, bool addOrDelete);
+    bool updateSubscribedItems(
+            const DataItemId* items, size_t count, bool addOrDelete);
 
     /* Utility method */
-    inline bool isItemSubscribed(DataItemId itemId){
-        return ( mSubscribedItemList.end() !=
-                    std::find( mSubscribedItemList.begin(),
-                            mSubscribedItemList.end(), itemId));
+    inline bool isItemSubscribed(DataItemId itemId) const {
+        std::lock_guard<std::recursive_mutex> guard(sNotifyClientsMutex);
+        return (itemId >= 0 && itemId < MAX_DATA_ITEM_ID &&
+                mSubscribedItems.test(itemId));
     }
+
+    /* Copy list to items, dropping duplicates and invalid ids.
+     * items must hold MAX_DATA_ITEM_ID entries.
+     * Returns number of items copied. */
+    static size_t toItemArray(
+            const std::list<DataItemId>& itemList, DataItemId* items);
 };
 #endif /* #ifndef LOC_NET_IFACE_BASE_H */
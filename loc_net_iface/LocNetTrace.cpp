@@ -0,0 +1,293 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define LOG_TAG "LocSvc_LocNetTrace"
+
+#include <LocNetTrace.h>
+#include <LocNetIfaceBase.h>
+#include <gps_extended_c.h>
+#include <loc_pla.h>
+#include <log_util.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* LocNetTrace members */
+LocNetTrace::Slot LocNetTrace::sSlots[LOC_NET_TRACE_SIZE];
+std::atomic<uint32_t> LocNetTrace::sNextIndex(0);
+std::atomic<uint32_t> LocNetTrace::sNextCorrId(1);
+
+uint32_t LocNetTrace::newCorrId() {
+
+    uint32_t corrId = sNextCorrId.fetch_add(1, std::memory_order_relaxed);
+    if (corrId == 0) {
+        corrId = sNextCorrId.fetch_add(1, std::memory_order_relaxed);
+    }
+    return corrId;
+}
+
+void LocNetTrace::record(uint32_t corrId, LocNetTraceStage stage,
+        int agpsType, int32_t arg) {
+
+    if (corrId == 0) {
+        return;
+    }
+
+    uint32_t index = sNextIndex.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = sSlots[index % LOC_NET_TRACE_SIZE];
+
+    /* Odd seq while the fields are inconsistent */
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.corrId.store(corrId, std::memory_order_relaxed);
+    slot.stage.store(stage, std::memory_order_relaxed);
+    slot.agpsType.store(agpsType, std::memory_order_relaxed);
+    slot.arg.store(arg, std::memory_order_relaxed);
+    slot.timeMs.store(LocNetIfaceBase::getBootTimeMs(),
+            std::memory_order_relaxed);
+    slot.seq.store(2 * index + 2, std::memory_order_release);
+}
+
+uint32_t LocNetTrace::snapshot(LocNetTraceRecord* records) {
+
+    uint32_t end = sNextIndex.load(std::memory_order_acquire);
+    uint32_t start = (end > LOC_NET_TRACE_SIZE) ? end - LOC_NET_TRACE_SIZE : 0;
+    uint32_t count = 0;
+
+    for (uint32_t index = start; index != end; index++) {
+        Slot& slot = sSlots[index % LOC_NET_TRACE_SIZE];
+        uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq != 2 * index + 2) {
+            /* Being written, or already overwritten */
+            continue;
+        }
+        LocNetTraceRecord& record = records[count];
+        record.corrId = slot.corrId.load(std::memory_order_relaxed);
+        record.stage = (LocNetTraceStage)slot.stage.load(
+                std::memory_order_relaxed);
+        record.agpsType = slot.agpsType.load(std::memory_order_relaxed);
+        record.arg = slot.arg.load(std::memory_order_relaxed);
+        record.timeMs = slot.timeMs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint32_t LocNetTrace::findPendingAtlRequest(int agpsType) {
+
+    LocNetTraceRecord records[LOC_NET_TRACE_SIZE];
+    uint32_t count = snapshot(records);
+
+    /* Newest first, skipping requests an AGPS request already claimed */
+    uint32_t corrId = 0;
+    bool isNewest = true;
+    uint32_t pendingCount = 0;
+    for (uint32_t i = count; i > 0; i--) {
+        const LocNetTraceRecord& record = records[i - 1];
+        if (record.stage != LOC_NET_TRACE_ATL_REQUEST ||
+                record.agpsType != agpsType) {
+            continue;
+        }
+        bool isClaimed = false;
+        for (uint32_t j = i; j < count && !isClaimed; j++) {
+            isClaimed = (records[j].corrId == record.corrId &&
+                    records[j].stage == LOC_NET_TRACE_AGPS_REQUEST);
+        }
+        if (isNewest && !isClaimed) {
+            corrId = record.corrId;
+        }
+        isNewest = false;
+        if (!isClaimed) {
+            pendingCount++;
+        }
+    }
+
+    /* Requests can't be told apart by type, the pick may be wrong */
+    if (pendingCount > 1) {
+        LOC_LOGW("%u ATL requests of type %d pending, tracing as %u",
+                pendingCount, agpsType, corrId);
+    }
+    return corrId;
+}
+
+uint32_t LocNetTrace::findAtlRequest(int32_t connHandle) {
+
+    LocNetTraceRecord records[LOC_NET_TRACE_SIZE];
+    uint32_t count = snapshot(records);
+
+    for (uint32_t i = count; i > 0; i--) {
+        if (records[i - 1].stage == LOC_NET_TRACE_ATL_REQUEST &&
+                records[i - 1].arg == connHandle) {
+            return records[i - 1].corrId;
+        }
+    }
+    return 0;
+}
+
+bool LocNetTrace::getBreakdown(
+        uint32_t corrId, LocNetTraceBreakdown& breakdown) {
+
+    LocNetTraceRecord records[LOC_NET_TRACE_SIZE];
+    uint32_t count = snapshot(records);
+    bool isFound = false;
+
+    memset(&breakdown, 0, sizeof(breakdown));
+    breakdown.corrId = corrId;
+    for (uint32_t i = 0; i < count; i++) {
+        const LocNetTraceRecord& record = records[i];
+        if (record.corrId != corrId) {
+            continue;
+        }
+        isFound = true;
+        if (record.agpsType != LOC_AGPS_TYPE_INVALID) {
+            breakdown.agpsType = record.agpsType;
+        }
+        /* First occurrence of a stage counts */
+        if (breakdown.stageTimeMs[record.stage] == 0) {
+            breakdown.stageTimeMs[record.stage] = record.timeMs;
+        }
+        if (record.stage == LOC_NET_TRACE_AGPS_OPEN_RESULT ||
+                record.stage == LOC_NET_TRACE_ATL_OPEN_STATUS) {
+            breakdown.isSuccess = (record.arg != 0);
+        }
+    }
+    return isFound;
+}
+
+/* Time between two stages, -1 if either wasn't seen */
+static int64_t stageDiffMs(const LocNetTraceBreakdown& breakdown,
+        LocNetTraceStage from, LocNetTraceStage to) {
+
+    if (breakdown.stageTimeMs[from] == 0 || breakdown.stageTimeMs[to] == 0) {
+        return -1;
+    }
+    return breakdown.stageTimeMs[to] - breakdown.stageTimeMs[from];
+}
+
+void LocNetTrace::logBreakdown(uint32_t corrId) {
+
+    LocNetTraceBreakdown breakdown;
+    if (!getBreakdown(corrId, breakdown)) {
+        LOC_LOGW("No trace for ATL open %u", corrId);
+        return;
+    }
+
+    /* Overall span, from the first to the last stage seen */
+    int64_t firstMs = 0, lastMs = 0;
+    for (int i = 0; i < LOC_NET_TRACE_STAGE_MAX; i++) {
+        int64_t timeMs = breakdown.stageTimeMs[i];
+        if (timeMs == 0) {
+            continue;
+        }
+        if (firstMs == 0 || timeMs < firstMs) {
+            firstMs = timeMs;
+        }
+        if (timeMs > lastMs) {
+            lastMs = timeMs;
+        }
+    }
+
+    /* Data call part, DSI timestamps are missing for QCMAP backhaul
+     * and reused calls */
+    int64_t callMs = stageDiffMs(breakdown,
+            LOC_NET_TRACE_CALL_SETUP, LOC_NET_TRACE_CALL_EVENT);
+
+    LOC_LOGI("ATL open %u type %d %s: total %" PRId64 " ms, call %" PRId64
+            " ms (hal %" PRId64 ", queue %" PRId64 ", dsi prep %" PRId64
+            ", dsi call %" PRId64 ", event %" PRId64 ", report %" PRId64
+            ", modem %" PRId64 ")",
+            corrId, breakdown.agpsType,
+            (breakdown.stageTimeMs[LOC_NET_TRACE_AGPS_OPEN_RESULT] == 0 &&
+             breakdown.stageTimeMs[LOC_NET_TRACE_ATL_OPEN_STATUS] == 0) ?
+                    "pending" : (breakdown.isSuccess ? "ok" : "failed"),
+            lastMs - firstMs, callMs,
+            stageDiffMs(breakdown, LOC_NET_TRACE_ATL_REQUEST,
+                    LOC_NET_TRACE_AGPS_REQUEST),
+            stageDiffMs(breakdown, LOC_NET_TRACE_AGPS_REQUEST,
+                    LOC_NET_TRACE_AGPS_HANDLED),
+            stageDiffMs(breakdown, LOC_NET_TRACE_CALL_SETUP,
+                    LOC_NET_TRACE_DSI_START),
+            stageDiffMs(breakdown, LOC_NET_TRACE_DSI_START,
+                    LOC_NET_TRACE_DSI_CALL_UP),
+            stageDiffMs(breakdown, LOC_NET_TRACE_DSI_CALL_UP,
+                    LOC_NET_TRACE_CALL_EVENT),
+            stageDiffMs(breakdown, LOC_NET_TRACE_CALL_EVENT,
+                    LOC_NET_TRACE_AGPS_OPEN_RESULT),
+            stageDiffMs(breakdown, LOC_NET_TRACE_AGPS_OPEN_RESULT,
+                    LOC_NET_TRACE_ATL_OPEN_STATUS));
+}
+
+void LocNetTrace::dump(uint32_t maxCount) {
+
+    LocNetTraceRecord records[LOC_NET_TRACE_SIZE];
+    uint32_t count = snapshot(records);
+    uint32_t corrIds[LOC_NET_TRACE_SIZE];
+    uint32_t corrIdCount = 0;
+
+    /* Distinct correlation ids, newest first */
+    for (uint32_t i = count; i > 0 && corrIdCount < maxCount; i--) {
+        uint32_t corrId = records[i - 1].corrId;
+        bool isListed = false;
+        for (uint32_t j = 0; j < corrIdCount && !isListed; j++) {
+            isListed = (corrIds[j] == corrId);
+        }
+        if (!isListed) {
+            corrIds[corrIdCount++] = corrId;
+        }
+    }
+
+    LOC_LOGI("Last %u of %u ATL open traces", corrIdCount, maxCount);
+    for (uint32_t i = corrIdCount; i > 0; i--) {
+        logBreakdown(corrIds[i - 1]);
+    }
+}
+
+/* Methods accessed from LocApiV02 */
+uint32_t LocNetTrace_atlRequest(int32_t connHandle, int agpsType) {
+
+    uint32_t corrId = LocNetTrace::newCorrId();
+    LocNetTrace::record(corrId, LOC_NET_TRACE_ATL_REQUEST, agpsType, connHandle);
+    return corrId;
+}
+
+void LocNetTrace_atlOpenStatus(int32_t connHandle, bool isSuccess) {
+
+    uint32_t corrId = LocNetTrace::findAtlRequest(connHandle);
+    if (corrId == 0) {
+        return;
+    }
+    LocNetTrace::record(corrId, LOC_NET_TRACE_ATL_OPEN_STATUS,
+            LOC_AGPS_TYPE_INVALID, isSuccess);
+    LocNetTrace::logBreakdown(corrId);
+}
+
+void LocNetTrace_dump(uint32_t maxCount) {
+
+    LocNetTrace::dump(maxCount);
+}
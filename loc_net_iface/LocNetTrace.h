@@ -0,0 +1,145 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation, nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef LOC_NET_TRACE_H
+#define LOC_NET_TRACE_H
+
+#include <stdint.h>
+#include <atomic>
+
+/* Stages of an ATL open, in the order they normally happen */
+typedef enum {
+    /* LocApiV02 got the ATL open request from the modem */
+    LOC_NET_TRACE_ATL_REQUEST = 0,
+    /* LocNetIfaceAgps got the AGPS request from HAL */
+    LOC_NET_TRACE_AGPS_REQUEST,
+    /* Request picked up on the LocNetIfaceAgps msg task */
+    LOC_NET_TRACE_AGPS_HANDLED,
+    /* Data call / backhaul setup requested from LocNetIface */
+    LOC_NET_TRACE_CALL_SETUP,
+    /* dsi_start_data_call() sent, after DSI prep */
+    LOC_NET_TRACE_DSI_START,
+    /* DSI reported the call up */
+    LOC_NET_TRACE_DSI_CALL_UP,
+    /* Call event handled on the LocNetIfaceAgps msg task */
+    LOC_NET_TRACE_CALL_EVENT,
+    /* Open result handed back to HAL */
+    LOC_NET_TRACE_AGPS_OPEN_RESULT,
+    /* LocApiV02 informed the modem of the ATL open status */
+    LOC_NET_TRACE_ATL_OPEN_STATUS,
+    LOC_NET_TRACE_STAGE_MAX
+} LocNetTraceStage;
+
+/* Number of trace records kept, oldest are overwritten */
+#define LOC_NET_TRACE_SIZE 256
+
+/* One trace record */
+typedef struct {
+    uint32_t corrId;
+    LocNetTraceStage stage;
+    int agpsType;
+    /* ATL handle for ATL stages, success flag for result stages */
+    int32_t arg;
+    int64_t timeMs;
+} LocNetTraceRecord;
+
+/* Per stage timestamps of one ATL open, 0 if the stage wasn't seen */
+typedef struct {
+    uint32_t corrId;
+    int agpsType;
+    bool isSuccess;
+    int64_t stageTimeMs[LOC_NET_TRACE_STAGE_MAX];
+} LocNetTraceBreakdown;
+
+/*--------------------------------------------------------------------
+ * CLASS LocNetTrace
+ *
+ * Functionality:
+ * Traces the latency of ATL opens from the modem request, through
+ * HAL, LocNetIfaceAgps, LocNetIface and DSI, back to the open status
+ * sent to the modem. Each open gets a correlation id that every stage
+ * records against, into a fixed ring shared by all threads. Recording
+ * never blocks and never allocates; readers validate each record
+ * against a sequence number and skip ones being overwritten.
+ *-------------------------------------------------------------------*/
+class LocNetTrace {
+
+public:
+    /* New correlation id, never 0 */
+    static uint32_t newCorrId();
+
+    /* Record stage for corrId at the current boot time */
+    static void record(uint32_t corrId, LocNetTraceStage stage,
+            int agpsType, int32_t arg);
+
+    /* Correlation id of the latest ATL request for agpsType that no
+     * AGPS request picked up yet, 0 if none. Warns if more than one
+     * is pending, since they can't be told apart. */
+    static uint32_t findPendingAtlRequest(int agpsType);
+
+    /* Correlation id of the latest ATL request for connHandle, 0 if
+     * none */
+    static uint32_t findAtlRequest(int32_t connHandle);
+
+    /* Collect the stages recorded for corrId, false if none is left
+     * in the ring */
+    static bool getBreakdown(uint32_t corrId, LocNetTraceBreakdown& breakdown);
+
+    /* Log the breakdown of corrId */
+    static void logBreakdown(uint32_t corrId);
+
+    /* Log the breakdown of the last maxCount ATL opens */
+    static void dump(uint32_t maxCount);
+
+private:
+    typedef struct {
+        /* 2 * record index + 1 while written, + 2 once complete */
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> corrId;
+        std::atomic<int32_t> stage;
+        std::atomic<int32_t> agpsType;
+        std::atomic<int32_t> arg;
+        std::atomic<int64_t> timeMs;
+    } Slot;
+
+    static Slot sSlots[LOC_NET_TRACE_SIZE];
+    static std::atomic<uint32_t> sNextIndex;
+    static std::atomic<uint32_t> sNextCorrId;
+
+    /* Consistent copy of the ring, oldest first.
+     * records must hold LOC_NET_TRACE_SIZE entries.
+     * Returns the number of records copied. */
+    static uint32_t snapshot(LocNetTraceRecord* records);
+};
+
+/* Global methods accessed from LocApiV02, looked up with dlsym.
+ * Return / take the correlation id of the ATL request. */
+extern "C" uint32_t LocNetTrace_atlRequest(int32_t connHandle, int agpsType);
+extern "C" void LocNetTrace_atlOpenStatus(int32_t connHandle, bool isSuccess);
+extern "C" void LocNetTrace_dump(uint32_t maxCount);
+
+#endif /* #ifndef LOC_NET_TRACE_H */
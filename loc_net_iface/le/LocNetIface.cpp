@@ -28,6 +28,8 @@
 #define LOG_TAG "LocSvc_LocNetIfaceLE"
 
 #include "LocNetIface.h"
+#include <LocNetTrace.h>
+#include <gps_extended_c.h>
 #include <QCMAP_Client.h>
 #include "qualcomm_mobile_access_point_msgr_v01.h"
 #include <loc_pla.h>
@@ -35,6 +37,7 @@
 #include <loc_cfg.h>
 #include <log_util.h>
 #include <unistd.h>
+#include <inttypes.h>
 
 using namespace izat_manager;
 
@@ -42,45 +45,107 @@ using namespace izat_manager;
  * Used for QCMAP registration */
 LocNetIface* LocNetIface::sLocNetIfaceInstance = NULL;
 
-void LocNetIface::subscribe(
-        const std::list<DataItemId>& itemListToSubscribe) {
+LocNetIface::~LocNetIface() {
 
     ENTRY_LOG();
 
-    /* Add items to subscribed list */
+    /* Timers call back into this instance */
+    mNotifyTimer.stop();
+    mLingerTimer.stop();
+
+    /* Drops the QCMAP client too if no other client needs it */
+    unsubscribeAll();
+    handOverQcmap();
+}
+
+void LocNetIface::handOverQcmap() {
+
+    QCMAP_Client* orphanedClient = NULL;
+    {
+        lock_guard<recursive_mutex> clientsGuard(sNotifyClientsMutex);
+
+        if (this != LocNetIface::sLocNetIfaceInstance) {
+            return;
+        }
+
+        /* Any other client still subscribed to network items */
+        LocNetIface* successor = NULL;
+        for (size_t i = 0; i < sNotifyClients.size() && successor == NULL; i++) {
+            LocNetIface* client = static_cast<LocNetIface*>(sNotifyClients[i]);
+            if (client != this &&
+                    (client->isItemSubscribed(NETWORKINFO_DATA_ITEM_ID) ||
+                    client->isItemSubscribed(WIFIHARDWARESTATE_DATA_ITEM_ID))) {
+                successor = client;
+            }
+        }
+
+        if (successor != NULL && mQcmapClientPtr != NULL) {
+            LOC_LOGD("Handing QCMAP client over to %p", successor);
+            lock_guard<recursive_mutex> guard(successor->mMutex);
+            successor->mQcmapClientPtr = mQcmapClientPtr;
+            successor->mConnState.store(mConnState.load());
+            successor->mConnectReqRecvCount = mConnectReqRecvCount;
+            successor->mIsConnectReqSent = mIsConnectReqSent;
+            successor->mIsConnectBackhaulPending = mIsConnectBackhaulPending;
+            successor->mIsDisconnectBackhaulPending = mIsDisconnectBackhaulPending;
+            if (successor->mWwanCallStatusCb == NULL) {
+                successor->mWwanCallStatusCb = mWwanCallStatusCb;
+                successor->mWwanCbUserDataPtr = mWwanCbUserDataPtr;
+            }
+            LocNetIface::sLocNetIfaceInstance = successor;
+        } else {
+            orphanedClient = mQcmapClientPtr;
+            LocNetIface::sLocNetIfaceInstance = NULL;
+        }
+        mQcmapClientPtr = NULL;
+    }
+
+    /* Released outside the lock, QCMAP may wait for indications
+     * blocked on it */
+    delete orphanedClient;
+}
+
+void LocNetIface::subscribe(const DataItemId* items, size_t count) {
+
+    ENTRY_LOG();
+
+    /* Add items to subscription */
     bool anyUpdatesToSubscriptionList =
-            updateSubscribedItemList(itemListToSubscribe, true);
+            updateSubscribedItems(items, count, true);
 
     /* If either of network info items is in subscription list,
-     * subscribe with QCMAP */
+     * subscribe with QCMAP. The subscription is shared by all clients
+     * and lives in sLocNetIfaceInstance. */
     if (anyUpdatesToSubscriptionList) {
-        if (isItemSubscribed(NETWORKINFO_DATA_ITEM_ID)) {
+        if (isItemSubscribed(NETWORKINFO_DATA_ITEM_ID) ||
+                isItemSubscribed(WIFIHARDWARESTATE_DATA_ITEM_ID)) {
             subscribeWithQcmap();
-            notifyCurrentNetworkInfo(true);
         }
-        if (isItemSubscribed(WIFIHARDWARESTATE_DATA_ITEM_ID)) {
-            subscribeWithQcmap();
-            notifyCurrentWifiHardwareState(true);
+        LocNetIface* qcmapIface = LocNetIface::sLocNetIfaceInstance;
+        if (qcmapIface != NULL &&
+                isItemSubscribed(NETWORKINFO_DATA_ITEM_ID)) {
+            qcmapIface->notifyCurrentNetworkInfo(true);
+        }
+        if (qcmapIface != NULL &&
+                isItemSubscribed(WIFIHARDWARESTATE_DATA_ITEM_ID)) {
+            qcmapIface->notifyCurrentWifiHardwareState(true);
         }
     }
 
     EXIT_LOG_WITH_ERROR("%d", 0);
 }
 
-void LocNetIface::unsubscribe(
-        const std::list<DataItemId>& itemListToUnsubscribe) {
+void LocNetIface::unsubscribe(const DataItemId* items, size_t count) {
 
     ENTRY_LOG();
 
-    /* Remove items from subscribed list */
+    /* Remove items from subscription */
     bool anyUpdatesToSubscriptionList =
-            updateSubscribedItemList(itemListToUnsubscribe, false);
+            updateSubscribedItems(items, count, false);
 
-    /* If neither of below two items left in subscription, we can unsubscribe
-     * from QCMAP */
-    if (anyUpdatesToSubscriptionList &&
-            !isItemSubscribed(NETWORKINFO_DATA_ITEM_ID) &&
-            !isItemSubscribed(WIFIHARDWARESTATE_DATA_ITEM_ID)) {
+    /* If no client is left subscribed to below two items, we can
+     * unsubscribe from QCMAP */
+    if (anyUpdatesToSubscriptionList && !isQcmapNeeded()) {
 
         unsubscribeWithQcmap();
     }
@@ -90,24 +155,81 @@ void LocNetIface::unsubscribeAll() {
 
     ENTRY_LOG();
 
+    bool wasUsingQcmap = isItemSubscribed(NETWORKINFO_DATA_ITEM_ID) ||
+            isItemSubscribed(WIFIHARDWARESTATE_DATA_ITEM_ID);
+
+    /* Clear subscription */
+    {
+        lock_guard<recursive_mutex> clientsGuard(sNotifyClientsMutex);
+        mSubscribedItems.reset();
+    }
+
     /* Check about network items */
-    if (isItemSubscribed(NETWORKINFO_DATA_ITEM_ID) ||
-            isItemSubscribed(WIFIHARDWARESTATE_DATA_ITEM_ID)) {
+    if (wasUsingQcmap && !isQcmapNeeded()) {
 
         unsubscribeWithQcmap();
     }
+}
+
+bool LocNetIface::isQcmapNeeded() {
 
-    /* Clear subscription list */
-    mSubscribedItemList.clear();
+    return isItemSubscribedByAnyClient(NETWORKINFO_DATA_ITEM_ID) ||
+            isItemSubscribedByAnyClient(WIFIHARDWARESTATE_DATA_ITEM_ID);
 }
 
-void LocNetIface::requestData(
-        const std::list<DataItemId>& itemListToRequestData) {
+void LocNetIface::requestData(const DataItemId* items, size_t count) {
 
     ENTRY_LOG();
 
-    /* NO-OP for LE platform
-     * We don't support any data item to fetch data for */
+    /* Network items are served from the connectivity cache,
+     * QCMAP is only queried if it hasn't synced yet */
+    LocNetIface* qcmapIface = (LocNetIface::sLocNetIfaceInstance != NULL) ?
+            LocNetIface::sLocNetIfaceInstance : this;
+    if (!qcmapIface->isConnStateSynced()) {
+        qcmapIface->syncConnStateWithQcmap();
+    }
+    LocNetConnState wlanState = qcmapIface->getWlanState();
+    LocNetConnState wwanState = qcmapIface->getWwanState();
+    LocNetConnState wlanHwState = qcmapIface->getWlanHwState();
+
+    /* Values go to the requester only, subscribers are
+     * notified of changes through the QCMAP indications */
+    std::list<IDataItemCore *> dataItemList;
+    WifiHardwareStateDataItem wifiState;
+    NetworkInfoDataItem networkInfo[2];
+    for (size_t i = 0; i < count; i++) {
+        if (items[i] == NETWORKINFO_DATA_ITEM_ID) {
+            if (wlanState == LOC_NET_CONN_STATE_INVALID &&
+                    wwanState == LOC_NET_CONN_STATE_INVALID) {
+                LOC_LOGE("Network state unknown");
+                continue;
+            }
+            networkInfo[0].mType = (int32)LOC_NET_CONN_TYPE_WLAN;
+            networkInfo[1].mType = (int32)LOC_NET_CONN_TYPE_WWAN_INTERNET;
+            networkInfo[0].mConnected = networkInfo[0].mAvailable =
+                    (wlanState == LOC_NET_CONN_STATE_CONNECTED);
+            networkInfo[1].mConnected = networkInfo[1].mAvailable =
+                    (wwanState == LOC_NET_CONN_STATE_CONNECTED);
+            // WLAN takes precedence, same as notifyCurrentNetworkInfo()
+            if (networkInfo[0].mConnected) {
+                dataItemList.push_back(&networkInfo[0]);
+            } else if (networkInfo[1].mConnected) {
+                dataItemList.push_back(&networkInfo[1]);
+            } else {
+                dataItemList.push_back(&networkInfo[0]);
+                dataItemList.push_back(&networkInfo[1]);
+            }
+        } else if (items[i] == WIFIHARDWARESTATE_DATA_ITEM_ID) {
+            if (wlanHwState != LOC_NET_CONN_STATE_ENABLED &&
+                    wlanHwState != LOC_NET_CONN_STATE_DISABLED) {
+                LOC_LOGE("Invalid WLAN hardware state: %d", wlanHwState);
+                continue;
+            }
+            wifiState.mEnabled = (wlanHwState == LOC_NET_CONN_STATE_ENABLED);
+            dataItemList.push_back(&wifiState);
+        }
+    }
+    notifyRequester(dataItemList);
 }
 
 void LocNetIface::subscribeWithQcmap() {
@@ -115,19 +237,19 @@ void LocNetIface::subscribeWithQcmap() {
     ENTRY_LOG();
 
     qmi_error_type_v01 qcmapErr = QMI_ERR_NONE_V01;
-
-    /* We handle qcmap subscription from an exclusive instance */
-    if (LocNetIface::sLocNetIfaceInstance != NULL) {
-
-        LOC_LOGI("QCMAP registration already done !");
-        return;
-    }
+    lock_guard<recursive_mutex> clientsGuard(sNotifyClientsMutex);
 
     /* First time registration */
     if (LocNetIface::sLocNetIfaceInstance == NULL) {
         LocNetIface::sLocNetIfaceInstance = this;
     }
 
+    /* We handle qcmap subscription from an exclusive instance */
+    if (this != LocNetIface::sLocNetIfaceInstance) {
+        LocNetIface::sLocNetIfaceInstance->subscribeWithQcmap();
+        return;
+    }
+
     /* Are we already subscribed */
     if (mQcmapClientPtr != NULL) {
         LOC_LOGW("Already subscribed !");
@@ -153,20 +275,86 @@ void LocNetIface::subscribeWithQcmap() {
     if (ret == false || qcmapErr != 0) {
         LOC_LOGE("RegisterForWLANStatusIND failed, qcmapErr %d", qcmapErr);
     }
+
+    /* Indications keep the cache current from here on */
+    syncConnStateWithQcmap();
 }
 
 void LocNetIface::unsubscribeWithQcmap() {
 
     ENTRY_LOG();
 
-    // Simply deleting the qcmap client instance is enough
+    QCMAP_Client* qcmapClientPtr = NULL;
+    {
+        lock_guard<recursive_mutex> clientsGuard(sNotifyClientsMutex);
+
+        /* Access QCMAP instance only from the static instance */
+        if (this != LocNetIface::sLocNetIfaceInstance &&
+                LocNetIface::sLocNetIfaceInstance != NULL) {
+            LocNetIface::sLocNetIfaceInstance->unsubscribeWithQcmap();
+            return;
+        }
+
+        if (mQcmapClientPtr == NULL) {
+            LOC_LOGE("No QCMAP instance to unsubscribe from");
+            return;
+        }
+        qcmapClientPtr = mQcmapClientPtr;
+        mQcmapClientPtr = NULL;
+
+        /* No more indications, cache can't be trusted until next sync */
+        updateConnState(CONN_STATE_SYNCED, 0);
+    }
+
+    // Simply deleting the qcmap client instance is enough.
+    // Done outside the lock, QCMAP may wait for indications blocked on it
+    delete qcmapClientPtr;
+}
+
+void LocNetIface::updateConnState(uint32_t mask, uint32_t value) {
+
+    uint32_t current = mConnState.load();
+    while (!mConnState.compare_exchange_weak(
+            current, (current & ~mask) | value)) {
+    }
+}
+
+void LocNetIface::syncConnStateWithQcmap() {
+
+    ENTRY_LOG();
+    lock_guard<recursive_mutex> guard(mMutex);
+
     if (mQcmapClientPtr == NULL) {
-        LOC_LOGE("No QCMAP instance to unsubscribe from");
+        LOC_LOGE("No QCMAP instance !");
+        return;
+    }
+
+    /* Drop the synced flag so below queries go to QCMAP */
+    updateConnState(CONN_STATE_SYNCED, 0);
+
+    qcmap_msgr_wlan_mode_enum_v01 wlanMode =
+            QCMAP_MSGR_WLAN_MODE_ENUM_MIN_ENUM_VAL_V01;
+    qmi_error_type_v01 qmi_err_num = QMI_ERROR_TYPE_MIN_ENUM_VAL_V01;
+    if (!mQcmapClientPtr->GetWLANStatus(&wlanMode, &qmi_err_num)) {
+        LOC_LOGE("Failed to fetch wlan status, err %d", qmi_err_num);
         return;
     }
 
-    delete mQcmapClientPtr;
-    mQcmapClientPtr = NULL;
+    /* Both fail only on QMI errors, retried on next read */
+    bool isWlanUp = isWlanConnected();
+    setWlanHwState((!isWlanUp &&
+            wlanMode == QCMAP_MSGR_WLAN_MODE_ENUM_MIN_ENUM_VAL_V01) ?
+            LOC_NET_CONN_STATE_DISABLED : LOC_NET_CONN_STATE_ENABLED);
+    isWwanConnected();
+    if (getWlanState() == LOC_NET_CONN_STATE_INVALID ||
+            getWwanState() == LOC_NET_CONN_STATE_INVALID) {
+        LOC_LOGE("QCMAP state query failed, cache not synced");
+        return;
+    }
+
+    updateConnState(CONN_STATE_SYNCED, CONN_STATE_SYNCED);
+    LOC_LOGD("Connectivity cache synced, wlan %d hw %d wwan %d",
+            getWlanState(), getWlanHwState(), getWwanState());
 }
 
 void LocNetIface::qcmapClientCallback(
@@ -177,8 +365,15 @@ void LocNetIface::qcmapClientCallback(
         void *ind_cb_data /**< User callback handle. */ ) {
 
     ENTRY_LOG();
-    lock_guard<recursive_mutex> guard(
-            LocNetIface::sLocNetIfaceInstance->getMutex());
+
+    /* Keeps the instance from being destroyed or handed over */
+    lock_guard<recursive_mutex> clientsGuard(sNotifyClientsMutex);
+    LocNetIface* qcmapIface = LocNetIface::sLocNetIfaceInstance;
+    if (qcmapIface == NULL) {
+        LOC_LOGE("No QCMAP instance, dropping indication %u", msg_id);
+        return;
+    }
+    lock_guard<recursive_mutex> guard(qcmapIface->getMutex());
 
     qmi_client_error_type qmi_error;
 
@@ -202,7 +397,7 @@ void LocNetIface::qcmapClientCallback(
             return;
         }
 
-        LocNetIface::sLocNetIfaceInstance->handleQcmapCallback(wlanStatusIndData);
+        qcmapIface->handleQcmapCallback(wlanStatusIndData);
         break;
     }
 
@@ -221,7 +416,7 @@ void LocNetIface::qcmapClientCallback(
             return;
         }
 
-        LocNetIface::sLocNetIfaceInstance->handleQcmapCallback(stationModeIndData);
+        qcmapIface->handleQcmapCallback(stationModeIndData);
         break;
     }
 
@@ -240,7 +435,7 @@ void LocNetIface::qcmapClientCallback(
             return;
         }
 
-        LocNetIface::sLocNetIfaceInstance->handleQcmapCallback(wwanStatusIndData);
+        qcmapIface->handleQcmapCallback(wwanStatusIndData);
         break;
     }
 
@@ -259,7 +454,7 @@ void LocNetIface::qcmapClientCallback(
             return;
         }
 
-        LocNetIface::sLocNetIfaceInstance->handleQcmapCallback(bringUpWwanIndData);
+        qcmapIface->handleQcmapCallback(bringUpWwanIndData);
         break;
     }
 
@@ -278,7 +473,7 @@ void LocNetIface::qcmapClientCallback(
             return;
         }
 
-        LocNetIface::sLocNetIfaceInstance->handleQcmapCallback(teardownWwanIndData);
+        qcmapIface->handleQcmapCallback(teardownWwanIndData);
         break;
     }
 
@@ -300,12 +495,12 @@ void LocNetIface::handleQcmapCallback(
 
     /* Notify observers */
     if (wlanStatusIndData.wlan_status == QCMAP_MSGR_WLAN_ENABLED_V01) {
-        if (mLocNetWlanState == LOC_NET_CONN_STATE_DISABLED) {
-            mLocNetWlanState = LOC_NET_CONN_STATE_ENABLED;
-        }
+        setWlanHwState(LOC_NET_CONN_STATE_ENABLED);
         notifyObserverForWlanStatus(true);
     } else if (wlanStatusIndData.wlan_status == QCMAP_MSGR_WLAN_DISABLED_V01) {
-        mLocNetWlanState = LOC_NET_CONN_STATE_DISABLED;
+        /* No station without a radio */
+        setWlanHwState(LOC_NET_CONN_STATE_DISABLED);
+        setWlanState(LOC_NET_CONN_STATE_DISCONNECTED);
         notifyObserverForWlanStatus(false);
     } else {
         LOC_LOGE("Invalid wlan status %d", wlanStatusIndData.wlan_status);
@@ -321,11 +516,11 @@ void LocNetIface::handleQcmapCallback(
     /* Notify observers */
     if (stationModeIndData.station_mode_status ==
             QCMAP_MSGR_STATION_MODE_CONNECTED_V01) {
-        mLocNetWlanState = LOC_NET_CONN_STATE_CONNECTED;
+        setWlanState(LOC_NET_CONN_STATE_CONNECTED);
         notifyCurrentNetworkInfo(false, LOC_NET_CONN_TYPE_WLAN);
     } else if (stationModeIndData.station_mode_status ==
                 QCMAP_MSGR_STATION_MODE_DISCONNECTED_V01) {
-        mLocNetWlanState = LOC_NET_CONN_STATE_DISCONNECTED;
+        setWlanState(LOC_NET_CONN_STATE_DISCONNECTED);
         notifyCurrentNetworkInfo(false, LOC_NET_CONN_TYPE_WLAN);
     } else {
         LOC_LOGE("Unsupported station mode status %d",
@@ -343,11 +538,11 @@ void LocNetIface::handleQcmapCallback(
     /* Notify observers */
     if (wwanStatusIndData.wwan_status ==
             QCMAP_MSGR_WWAN_STATUS_CONNECTED_V01) {
-        mLocNetWwanState = LOC_NET_CONN_STATE_CONNECTED;
+        setWwanState(LOC_NET_CONN_STATE_CONNECTED);
         notifyCurrentNetworkInfo(false, LOC_NET_CONN_TYPE_WWAN_INTERNET);
     } else if (wwanStatusIndData.wwan_status ==
             QCMAP_MSGR_WWAN_STATUS_DISCONNECTED_V01) {
-        mLocNetWwanState = LOC_NET_CONN_STATE_DISCONNECTED;
+        setWwanState(LOC_NET_CONN_STATE_DISCONNECTED);
         notifyCurrentNetworkInfo(false, LOC_NET_CONN_TYPE_WWAN_INTERNET);
     } else {
         LOC_LOGW("Unsupported wwan status %d",
@@ -366,7 +561,7 @@ void LocNetIface::handleQcmapCallback(
     if (bringUpWwanIndData.conn_status ==
             QCMAP_MSGR_WWAN_STATUS_CONNECTED_V01) {
 
-        mLocNetWwanState = LOC_NET_CONN_STATE_CONNECTED;
+        setWwanState(LOC_NET_CONN_STATE_CONNECTED);
         notifyCurrentNetworkInfo(false, LOC_NET_CONN_TYPE_WWAN_INTERNET);
 
         if (mIsConnectBackhaulPending &&
@@ -408,7 +603,7 @@ void LocNetIface::handleQcmapCallback(
     if (teardownWwanIndData.conn_status ==
             QCMAP_MSGR_WWAN_STATUS_DISCONNECTED_V01) {
 
-        mLocNetWwanState = LOC_NET_CONN_STATE_DISCONNECTED;
+        setWwanState(LOC_NET_CONN_STATE_DISCONNECTED);
         notifyCurrentNetworkInfo(false, LOC_NET_CONN_TYPE_WWAN_INTERNET);
 
         if (mIsDisconnectBackhaulPending &&
@@ -450,9 +645,9 @@ void LocNetIface::notifyCurrentNetworkInfo(bool queryQcmap, LocNetConnType connT
 
     /* Check saved state if queryQcmap disabled */
     if (!queryQcmap) {
-        if (mLocNetWlanState == LOC_NET_CONN_STATE_CONNECTED) {
+        if (getWlanState() == LOC_NET_CONN_STATE_CONNECTED) {
             notifyObserverForNetworkInfo(true, LOC_NET_CONN_TYPE_WLAN);
-        } else if (mLocNetWwanState == LOC_NET_CONN_STATE_CONNECTED) {
+        } else if (getWwanState() == LOC_NET_CONN_STATE_CONNECTED) {
             notifyObserverForNetworkInfo(true, LOC_NET_CONN_TYPE_WWAN_INTERNET);
         } else {
             notifyObserverForNetworkInfo(false, connType);
@@ -462,14 +657,14 @@ void LocNetIface::notifyCurrentNetworkInfo(bool queryQcmap, LocNetConnType connT
 
     /* Fetch connectivity status from qcmap and notify observers */
     if (isWlanConnected()) {
-        mLocNetWlanState = LOC_NET_CONN_STATE_CONNECTED;
+        setWlanState(LOC_NET_CONN_STATE_CONNECTED);
         notifyObserverForNetworkInfo(true, LOC_NET_CONN_TYPE_WLAN);
     } else if (isWwanConnected()) {
-        mLocNetWwanState = LOC_NET_CONN_STATE_CONNECTED;
+        setWwanState(LOC_NET_CONN_STATE_CONNECTED);
         notifyObserverForNetworkInfo(true, LOC_NET_CONN_TYPE_WWAN_INTERNET);
     } else {
-        mLocNetWlanState = LOC_NET_CONN_STATE_DISCONNECTED;
-        mLocNetWwanState = LOC_NET_CONN_STATE_DISCONNECTED;
+        setWlanState(LOC_NET_CONN_STATE_DISCONNECTED);
+        setWwanState(LOC_NET_CONN_STATE_DISCONNECTED);
         // notify observer for both wifi and wwan
         notifyObserverForNetworkInfo(false, LOC_NET_CONN_TYPE_WLAN);
         notifyObserverForNetworkInfo(false, LOC_NET_CONN_TYPE_WWAN_INTERNET);
@@ -486,16 +681,15 @@ void LocNetIface::notifyCurrentWifiHardwareState(bool queryQcmap) {
         return;
     }
 
-    /* Check saved state if queryQcmap disabled */
-    if (!queryQcmap) {
-        if (mLocNetWlanState == LOC_NET_CONN_STATE_ENABLED ||
-                mLocNetWlanState == LOC_NET_CONN_STATE_CONNECTED ||
-                mLocNetWlanState == LOC_NET_CONN_STATE_DISCONNECTED) {
+    /* Check saved state if queryQcmap disabled or cache is synced */
+    if (!queryQcmap || isConnStateSynced()) {
+        LocNetConnState wlanHwState = getWlanHwState();
+        if (wlanHwState == LOC_NET_CONN_STATE_ENABLED) {
             notifyObserverForWlanStatus(true);
-        } else if (mLocNetWlanState == LOC_NET_CONN_STATE_DISABLED) {
+        } else if (wlanHwState == LOC_NET_CONN_STATE_DISABLED) {
             notifyObserverForWlanStatus(false);
         } else {
-            LOC_LOGE("Invalid WLAN state: %d", mLocNetWlanState);
+            LOC_LOGE("Invalid WLAN hardware state: %d", wlanHwState);
         }
         return;
     }
@@ -517,7 +711,7 @@ void LocNetIface::notifyCurrentWifiHardwareState(bool queryQcmap) {
     }
 
     if (wlan_mode == QCMAP_MSGR_WLAN_MODE_ENUM_MIN_ENUM_VAL_V01) {
-        mLocNetWlanState = LOC_NET_CONN_STATE_DISABLED;
+        setWlanHwState(LOC_NET_CONN_STATE_DISABLED);
         notifyObserverForWlanStatus(false);
     } else if (wlan_mode == QCMAP_MSGR_WLAN_MODE_STA_ONLY_V01 ||
             wlan_mode == QCMAP_MSGR_WLAN_MODE_AP_STA_V01 ||
@@ -525,9 +719,7 @@ void LocNetIface::notifyCurrentWifiHardwareState(bool queryQcmap) {
             wlan_mode == QCMAP_MSGR_WLAN_MODE_AP_STA_BRIDGE_V01 ||
             wlan_mode == QCMAP_MSGR_WLAN_MODE_AP_AP_STA_BRIDGE_V01 ||
             wlan_mode == QCMAP_MSGR_WLAN_MODE_STA_ONLY_BRIDGE_V01) {
-        if (mLocNetWlanState == LOC_NET_CONN_STATE_DISABLED) {
-            mLocNetWlanState = LOC_NET_CONN_STATE_ENABLED;
-        }
+        setWlanHwState(LOC_NET_CONN_STATE_ENABLED);
         notifyObserverForWlanStatus(true);
     }
 }
@@ -535,89 +727,101 @@ void LocNetIface::notifyCurrentWifiHardwareState(bool queryQcmap) {
 void LocNetIface::notifyObserverForWlanStatus(bool isWlanEnabled) {
 
     ENTRY_LOG();
+    lock_guard<recursive_mutex> clientsGuard(sNotifyClientsMutex);
+    lock_guard<recursive_mutex> guard(mMutex);
 
     /* Validate subscription object */
-    if (LocNetIfaceBase::sNotifyCb == NULL){
-        LOC_LOGE("Notify callback NULL !");
+    if (!hasNotifyClients()){
+        LOC_LOGE("No notify callback registered !");
         return;
     }
 
-    /* Create a wifi hardware status item */
-    WifiHardwareStateDataItem wifiStateDataItem;
-    IDataItemCore *dataItem = NULL;
-
-    wifiStateDataItem.mEnabled = isWlanEnabled;
-    dataItem = &wifiStateDataItem;
-
-    // Create a list and push data item, since that's what observer expects
-    std::list<IDataItemCore *> dataItemList;
-    dataItemList.push_back(dataItem);
-
-    /* Notify back to client */
-    LocNetIfaceBase::sNotifyCb(
-            LocNetIfaceBase::sNotifyCbUserDataPtr, dataItemList);
+    /* Update the wifi hardware status item, replaces any pending one */
+    mPendingWifiState.mEnabled = isWlanEnabled;
+    mIsWifiStatePending = true;
+    schedulePendingNotifications();
 }
 
 void LocNetIface::notifyObserverForNetworkInfo(
         boolean isConnected, LocNetConnType connType){
 
     ENTRY_LOG();
+    lock_guard<recursive_mutex> clientsGuard(sNotifyClientsMutex);
+    lock_guard<recursive_mutex> guard(mMutex);
 
     // Check if observer is registered
-    if (LocNetIfaceBase::sNotifyCb == NULL) {
-        LOC_LOGE("Notify callback NULL !");
+    if (!hasNotifyClients()) {
+        LOC_LOGE("No notify callback registered !");
         return;
     }
 
-    // Create a network data item
-    NetworkInfoDataItem networkInfoDataItem;
-    IDataItemCore *dataItem = NULL;
-
-    networkInfoDataItem.mType = (int32)connType;
-    networkInfoDataItem.mAvailable = isConnected;
-    networkInfoDataItem.mConnected = isConnected;
-
-    dataItem = &networkInfoDataItem;
+    // Update the network info item, replaces any pending one so only
+    // the latest connectivity state is sent
+    mPendingNetworkInfo.mType = (int32)connType;
+    mPendingNetworkInfo.mAvailable = isConnected;
+    mPendingNetworkInfo.mConnected = isConnected;
+    mIsNetworkInfoPending = true;
+    schedulePendingNotifications();
+}
 
-    // Create a list and push data item, since that's what observer expects
-    std::list<IDataItemCore *> dataItemList;
-    dataItemList.push_back(dataItem);
+void LocNetIface::schedulePendingNotifications() {
 
-    /* Notify back to client */
-    LocNetIfaceBase::sNotifyCb(
-            LocNetIfaceBase::sNotifyCbUserDataPtr, dataItemList);
+    if (mIsNotifyTimerRunning) {
+        return;
+    }
+    mIsNotifyTimerRunning =
+            mNotifyTimer.start(LOC_NET_NOTIFY_COALESCE_MS, false);
+    if (!mIsNotifyTimerRunning) {
+        LOC_LOGE("Failed to start notify timer, notifying now");
+        flushPendingNotifications();
+    }
 }
 
-bool LocNetIface::setupWwanCall() {
+void LocNetIface::flushPendingNotifications() {
 
     ENTRY_LOG();
+    lock_guard<recursive_mutex> clientsGuard(sNotifyClientsMutex);
+    lock_guard<recursive_mutex> guard(mMutex);
 
-    /* Validate call type requested */
-    if (mLocNetConnType != LOC_NET_CONN_TYPE_WWAN_SUPL) {
-        LOC_LOGE("Unsupported call type configured: %d", mLocNetConnType);
-        return false;
+    mIsNotifyTimerRunning = false;
+
+    // Create a list and push data items, since that's what observer expects
+    std::list<IDataItemCore *> dataItemList;
+    if (mIsWifiStatePending) {
+        dataItemList.push_back(&mPendingWifiState);
+        mIsWifiStatePending = false;
+    }
+    if (mIsNetworkInfoPending) {
+        dataItemList.push_back(&mPendingNetworkInfo);
+        mIsNetworkInfoPending = false;
     }
 
-    /* Check for ongoing start/stop attempts */
-    if (mIsDsiStartCallPending) {
-        LOC_LOGW("Already start pending, returning as no-op");
-        return true;
+    /* Notify back to each client subscribed to the items */
+    if (!dataItemList.empty()) {
+        LOC_LOGV("Notifying %zu data items", dataItemList.size());
+        notifyClients(dataItemList);
     }
-    if (mIsDsiStopCallPending) {
-        LOC_LOGE("Stop attempt pending, can't start now !");
-        /* When stop completes and DS callback is received, we will
-         * notify the client. So no need to notify now. */
-        return false;
+}
+
+void LocNetIface::prepareDsiCallAsync() {
+
+    ENTRY_LOG();
+
+    if (!isDsiConnType()) {
+        return;
     }
-    if (mIsDsiCallUp) {
-        LOC_LOGW("Already ongoing data call");
-        if (mWwanCallStatusCb != NULL) {
-            mWwanCallStatusCb(
-                    mWwanCbUserDataPtr, LOC_NET_WWAN_CALL_EVT_OPEN_SUCCESS,
-                    getApnNameFromConfig(), getIpTypeFromConfig());
-        }
-        return true;
+    try {
+        mDsiReady = async(launch::async,
+                &LocNetIface::prepareDsiCall, this).share();
+    } catch (const system_error& e) {
+        /* setupWwanCall() will do it inline */
+        LOC_LOGE("Failed to start DSI prep thread: %s", e.what());
     }
+}
+
+bool LocNetIface::prepareDsiCall() {
+
+    ENTRY_LOG();
 
     /* Initialize DSI library */
     int ret = -1;
@@ -646,7 +850,6 @@ bool LocNetIface::setupWwanCall() {
             return false;
         }
     }
-    LOC_LOGD("DSI Handle for call %p", mDsiHandle);
 
     /* Set call parameters */
     dsi_call_param_value_t callParams;
@@ -686,8 +889,85 @@ bool LocNetIface::setupWwanCall() {
     dsi_set_data_call_param(
             mDsiHandle, DSI_CALL_INFO_IP_VERSION, &callParams);
 
+    LOC_LOGI("DSI ready for data call, handle %p", mDsiHandle);
+    return true;
+}
+
+bool LocNetIface::setupWwanCall() {
+
+    ENTRY_LOG();
+
+    /* Wait for the DSI prep worker before taking mMutex, DSI callbacks
+     * need it and dsi_init() may be waiting for one of them. Once the
+     * prep is over the wait below returns at once, also when this is
+     * called with mMutex held on a restart from the DSI callback. */
+    shared_future<bool> dsiReady;
+    {
+        lock_guard<recursive_mutex> guard(mMutex);
+        dsiReady = mDsiReady;
+    }
+    if (dsiReady.valid()) {
+        dsiReady.wait();
+    }
+
+    lock_guard<recursive_mutex> guard(mMutex);
+
+    /* Validate call type requested */
+    if (!isDsiConnType()) {
+        LOC_LOGE("Unsupported call type configured: %d", mLocNetConnType);
+        return false;
+    }
+
+    /* Check for ongoing start/stop attempts */
+    if (mIsDsiStartCallPending) {
+        LOC_LOGW("Already start pending, returning as no-op");
+        return true;
+    }
+    if (mIsDsiStopCallPending && mIsDsiStopCallSilent) {
+        /* Linger just ran out, set up again once the stop completes */
+        LOC_LOGD("Lingering call stop pending, restart after it");
+        mIsDsiRestartPending = true;
+        return true;
+    }
+    if (mIsDsiStopCallPending) {
+        LOC_LOGE("Stop attempt pending, can't start now !");
+        /* When stop completes and DS callback is received, we will
+         * notify the client. So no need to notify now. */
+        return false;
+    }
+    if (mIsDsiCallUp) {
+        if (mIsDsiCallLingering) {
+            mLingerTimer.stop();
+            mIsDsiCallLingering = false;
+            mCallsReused++;
+            LOC_LOGD("Reusing lingering data call, %u reused, saving ~%" PRId64
+                     " ms setup each", mCallsReused,
+                     mCallSetups > 0 ? mCallSetupTotalMs / mCallSetups : 0);
+        } else {
+            LOC_LOGW("Already ongoing data call");
+        }
+        if (mWwanCallStatusCb != NULL) {
+            mWwanCallStatusCb(
+                    mWwanCbUserDataPtr, LOC_NET_WWAN_CALL_EVT_OPEN_SUCCESS,
+                    getApnNameFromConfig(), getIpTypeFromConfig());
+        }
+        return true;
+    }
+
+    /* DSI prep started at construction is done, redo it if it failed */
+    if (!mDsiReady.valid() || !mDsiReady.get()) {
+        mDsiReady = shared_future<bool>();
+        if (!prepareDsiCall()) {
+            return false;
+        }
+        promise<bool> ready;
+        ready.set_value(true);
+        mDsiReady = ready.get_future().share();
+    }
+    LOC_LOGD("DSI Handle for call %p", mDsiHandle);
+
     /* Send the call setup request */
-    ret = dsi_start_data_call(mDsiHandle);
+    int ret = dsi_start_data_call(mDsiHandle);
     if (ret != DSI_SUCCESS) {
 
         LOC_LOGE("DSI_START_DATA_CALL FAILED, err %d", ret);
@@ -695,6 +975,9 @@ bool LocNetIface::setupWwanCall() {
     }
 
     mIsDsiStartCallPending = true;
+    mCallStartTimeMs = getBootTimeMs();
+    LocNetTrace::record(mTraceCorrId, LOC_NET_TRACE_DSI_START,
+            LOC_AGPS_TYPE_INVALID, 0);
     LOC_LOGI("Data call START request sent successfully to DSI");
     return true;
 }
@@ -702,6 +985,7 @@ bool LocNetIface::setupWwanCall() {
 bool LocNetIface::stopWwanCall() {
 
     ENTRY_LOG();
+    lock_guard<recursive_mutex> guard(mMutex);
 
     /* Check for ongoing start/stop attempts */
     if (mIsDsiStopCallPending) {
@@ -714,7 +998,7 @@ bool LocNetIface::stopWwanCall() {
          * notify the client. So no need to notify now. */
         return false;
     }
-    if (!mIsDsiCallUp) {
+    if (!mIsDsiCallUp || mIsDsiCallLingering) {
         LOC_LOGE("No ongoing data call to stop");
         if (mWwanCallStatusCb != NULL) {
             mWwanCallStatusCb(
@@ -724,6 +1008,20 @@ bool LocNetIface::stopWwanCall() {
         return true;
     }
 
+    /* Keep the call up a while in case it's needed again soon,
+     * the client sees it closed right away */
+    int lingerMs = getCallLingerMsFromConfig();
+    if (lingerMs > 0 && mLingerTimer.start(lingerMs, false)) {
+        LOC_LOGD("Data call lingering for %d ms", lingerMs);
+        mIsDsiCallLingering = true;
+        if (mWwanCallStatusCb != NULL) {
+            mWwanCallStatusCb(
+                    mWwanCbUserDataPtr, LOC_NET_WWAN_CALL_EVT_CLOSE_SUCCESS,
+                    getApnNameFromConfig(), getIpTypeFromConfig());
+        }
+        return true;
+    }
+
     /* Stop the call */
     LOC_LOGD("Stopping data call with handle %p", mDsiHandle);
 
@@ -739,6 +1037,27 @@ bool LocNetIface::stopWwanCall() {
     return true;
 }
 
+void LocNetIface::handleLingerTimeout() {
+
+    ENTRY_LOG();
+    lock_guard<recursive_mutex> guard(mMutex);
+
+    if (!mIsDsiCallLingering) {
+        return;
+    }
+    mIsDsiCallLingering = false;
+
+    LOC_LOGD("Linger over, stopping data call with handle %p", mDsiHandle);
+    int ret = dsi_stop_data_call(mDsiHandle);
+    if (ret != DSI_SUCCESS) {
+        /* Still up, the next setup request will just reuse it */
+        LOC_LOGE("dsi_stop_data_call() returned err %d", ret);
+        return;
+    }
+    mIsDsiStopCallPending = true;
+    mIsDsiStopCallSilent = true;
+}
+
 /* Static callback method */
 void LocNetIface::dsiNetEventCallback(
         dsi_hndl_t dsiHandle, void* userDataPtr, dsi_net_evt_t event,
@@ -768,6 +1087,7 @@ void LocNetIface::handleDSCallback(
         dsi_hndl_t dsiHandle, bool isNetConnected){
 
     ENTRY_LOG();
+    lock_guard<recursive_mutex> guard(mMutex);
     LOC_LOGV("dsiHandle %p, isCallUp %d, stopPending %d, startPending %d",
               dsiHandle, mIsDsiCallUp, mIsDsiStopCallPending,
               mIsDsiStartCallPending);
@@ -781,6 +1101,15 @@ void LocNetIface::handleDSCallback(
     /* Process event */
     if (isNetConnected){
 
+        if (mIsDsiStartCallPending) {
+            int64_t setupMs = getBootTimeMs() - mCallStartTimeMs;
+            mCallSetups++;
+            mCallSetupTotalMs += setupMs;
+            LOC_LOGD("Data call setup took %" PRId64 " ms", setupMs);
+            LocNetTrace::record(mTraceCorrId, LOC_NET_TRACE_DSI_CALL_UP,
+                    LOC_AGPS_TYPE_INVALID, 1);
+        }
+
         /* Invoke client callback if registered*/
         if (mIsDsiStartCallPending &&
                 mWwanCallStatusCb != NULL){
@@ -797,7 +1126,9 @@ void LocNetIface::handleDSCallback(
     } else {
 
         /* Invoke client callback if registered */
-        if (mIsDsiStopCallPending &&
+        if (mIsDsiStopCallPending && mIsDsiStopCallSilent) {
+            LOC_LOGV("Lingering data call stopped");
+        } else if (mIsDsiStopCallPending &&
                 mWwanCallStatusCb != NULL) {
             LOC_LOGV("LOC_NET_WWAN_CALL_EVT_CLOSE_SUCCESS");
             mWwanCallStatusCb(
@@ -814,6 +1145,23 @@ void LocNetIface::handleDSCallback(
         /* Stop call complete */
         mIsDsiCallUp = false;
         mIsDsiStopCallPending = false;
+        mIsDsiStopCallSilent = false;
+
+        /* Network dropped a lingering call */
+        if (mIsDsiCallLingering) {
+            mLingerTimer.stop();
+            mIsDsiCallLingering = false;
+        }
+
+        /* Setup requested while the linger stop was pending */
+        if (mIsDsiRestartPending) {
+            mIsDsiRestartPending = false;
+            if (!setupWwanCall() && mWwanCallStatusCb != NULL) {
+                mWwanCallStatusCb(
+                        mWwanCbUserDataPtr, LOC_NET_WWAN_CALL_EVT_OPEN_FAILED,
+                        NULL, LOC_NET_CONN_IP_TYPE_INVALID);
+            }
+        }
     }
 }
 
@@ -827,6 +1175,11 @@ bool LocNetIface::isWlanConnected() {
         return LocNetIface::sLocNetIfaceInstance->isWlanConnected();
     }
 
+    /* Cache is authoritative once synced */
+    if (isConnStateSynced()) {
+        return getWlanState() == LOC_NET_CONN_STATE_CONNECTED;
+    }
+
     /* Validate QCMAP Client instance */
     if (mQcmapClientPtr == NULL) {
         LOC_LOGE("No QCMAP instance !");
@@ -846,11 +1199,11 @@ bool LocNetIface::isWlanConnected() {
     /* Notify observers */
     if (status == QCMAP_MSGR_STATION_MODE_CONNECTED_V01) {
         LOC_LOGV("WLAN is connected.");
-        mLocNetWlanState = LOC_NET_CONN_STATE_CONNECTED;
+        setWlanState(LOC_NET_CONN_STATE_CONNECTED);
         return true;
     } else if (status == QCMAP_MSGR_STATION_MODE_DISCONNECTED_V01) {
         LOC_LOGV("WLAN is disconnected.");
-        mLocNetWlanState = LOC_NET_CONN_STATE_DISCONNECTED;
+        setWlanState(LOC_NET_CONN_STATE_DISCONNECTED);
         return false;
     } else {
         LOC_LOGE("Unhandled station mode status %d", status);
@@ -869,6 +1222,11 @@ bool LocNetIface::isWwanConnected() {
         return LocNetIface::sLocNetIfaceInstance->isWwanConnected();
     }
 
+    /* Cache is authoritative once synced */
+    if (isConnStateSynced()) {
+        return getWwanState() == LOC_NET_CONN_STATE_CONNECTED;
+    }
+
     /* Validate QCMAP Client instance */
     if (mQcmapClientPtr == NULL) {
         LOC_LOGE("No QCMAP instance !");
@@ -885,11 +1243,11 @@ bool LocNetIface::isWwanConnected() {
     }
     if (v4_status == QCMAP_MSGR_WWAN_STATUS_CONNECTED_V01) {
         LOC_LOGV("WWAN is connected.");
-        mLocNetWwanState = LOC_NET_CONN_STATE_CONNECTED;
+        setWwanState(LOC_NET_CONN_STATE_CONNECTED);
         return true;
     } else if (v4_status == QCMAP_MSGR_WWAN_STATUS_DISCONNECTED_V01) {
         LOC_LOGV("WWAN is disconnected.");
-        mLocNetWwanState = LOC_NET_CONN_STATE_DISCONNECTED;
+        setWwanState(LOC_NET_CONN_STATE_DISCONNECTED);
         return false;
     } else {
         LOC_LOGE("Unhandled wwan status %d", v4_status);
@@ -952,7 +1310,7 @@ bool LocNetIface::connectBackhaul() {
     /* Check if we've already sent the request */
     if (mIsConnectBackhaulPending || mIsConnectReqSent) {
         LOC_LOGI("Ignoring connect, connect pending %d, wwan state %d "
-                "req sent %d", mIsConnectBackhaulPending, mLocNetWwanState,
+                "req sent %d", mIsConnectBackhaulPending, getWwanState(),
                 mIsConnectReqSent);
         mConnectReqRecvCount++;
         return true;
@@ -31,7 +31,14 @@
 #include <LocNetIfaceBase.h>
 #include <dsi_netctrl.h>
 #include <QCMAP_Client.h>
+#include <LocTimer.h>
+#include <DataItemConcreteTypes.h>
 #include <mutex>
+#include <atomic>
+#include <future>
+
+/* Window over which data item notifications are merged */
+#define LOC_NET_NOTIFY_COALESCE_MS 100
 
 using namespace std;
 
@@ -46,20 +53,33 @@ public:
         LocNetIfaceBase(connType), mQcmapClientPtr(NULL),
         mConnectReqRecvCount(0), mIsConnectReqSent(false),
         mIsConnectBackhaulPending(false), mIsDisconnectBackhaulPending(false),
-        mLocNetWlanState(LOC_NET_CONN_STATE_INVALID),
-        mLocNetWwanState(LOC_NET_CONN_STATE_INVALID),
+        mConnState(LOC_NET_CONN_STATE_INVALID),
         mIsDsiInitDone(false), mDsiHandle(NULL), mIsDsiCallUp(false),
         mIsDsiStartCallPending(false), mIsDsiStopCallPending(false),
-        mMutex() {}
+        mIsDsiCallLingering(false), mIsDsiStopCallSilent(false),
+        mIsDsiRestartPending(false), mLingerTimer(*this),
+        mCallStartTimeMs(0), mCallSetups(0), mCallSetupTotalMs(0),
+        mCallsReused(0), mDsiReady(), mNotifyTimer(*this),
+        mIsNotifyTimerRunning(false), mIsWifiStatePending(false),
+        mIsNetworkInfoPending(false), mMutex() {
+
+        prepareDsiCallAsync();
+    }
     LocNetIface() : LocNetIface(LOC_NET_CONN_TYPE_WWAN_INTERNET) {}
+    ~LocNetIface();
 
     /* Override base class pure virtual methods */
     bool setupWwanCall();
     bool stopWwanCall();
-    void subscribe(const std::list<DataItemId>& itemListToSubscribe);
-    void unsubscribe(const std::list<DataItemId>& itemListToUnsubscribe);
+    void subscribe(const DataItemId* items, size_t count);
+    void unsubscribe(const DataItemId* items, size_t count);
     void unsubscribeAll();
-    void requestData(const std::list<DataItemId>& itemListToRequestData);
+    void requestData(const DataItemId* items, size_t count);
+
+    /* Keep the list based adapters visible */
+    using LocNetIfaceBase::subscribe;
+    using LocNetIfaceBase::unsubscribe;
+    using LocNetIfaceBase::requestData;
 
     /* Setup WWAN backhaul via QCMAP
      * This sets up IP routes as well for any AP socket */
@@ -86,12 +106,61 @@ private:
 
     /* Maintain an exclusive instance for QCMAP interaction.
      * QCMAP does NOT support passing in/out a void user data pointer,
-     * Hence we need to track the instance used internally. */
+     * Hence we need to track the instance used internally.
+     * Written with sNotifyClientsMutex held, which QCMAP indications
+     * hold too, so the instance can't go away under them. When it is
+     * destroyed, the QCMAP client moves to another subscribed client.
+     * sNotifyClientsMutex is always taken before any mMutex. */
     static LocNetIface* sLocNetIfaceInstance;
+    void handOverQcmap();
 
-    /* Current connection status */
-    LocNetConnState mLocNetWlanState;
-    LocNetConnState mLocNetWwanState;
+    /* Current connection status, kept up to date by QCMAP indications.
+     * WLAN station state (CONNECTED/DISCONNECTED) in bits 0-7, WWAN
+     * state in bits 8-15, WLAN hardware state (ENABLED/DISABLED) in
+     * bits 16-23 and the synced flag above, so any thread can read a
+     * consistent set without taking mMutex. Station and hardware state
+     * are separate so that a station update never hides a disabled
+     * radio. QCMAP is only queried until the cache has synced, i.e.
+     * right after (re)creating the QCMAP client. */
+    atomic<uint32_t> mConnState;
+    static const uint32_t CONN_STATE_WLAN_SHIFT = 0;
+    static const uint32_t CONN_STATE_WWAN_SHIFT = 8;
+    static const uint32_t CONN_STATE_WLAN_HW_SHIFT = 16;
+    static const uint32_t CONN_STATE_MASK = 0xFF;
+    static const uint32_t CONN_STATE_SYNCED = 1 << 24;
+    inline LocNetConnState getWlanState() const {
+        return (LocNetConnState)((mConnState.load() >> CONN_STATE_WLAN_SHIFT)
+                & CONN_STATE_MASK);
+    }
+    inline LocNetConnState getWlanHwState() const {
+        return (LocNetConnState)((mConnState.load() >> CONN_STATE_WLAN_HW_SHIFT)
+                & CONN_STATE_MASK);
+    }
+    inline LocNetConnState getWwanState() const {
+        return (LocNetConnState)((mConnState.load() >> CONN_STATE_WWAN_SHIFT)
+                & CONN_STATE_MASK);
+    }
+    inline bool isConnStateSynced() const {
+        return (mConnState.load() & CONN_STATE_SYNCED) != 0;
+    }
+    inline void setWlanState(LocNetConnState state) {
+        updateConnState(CONN_STATE_MASK << CONN_STATE_WLAN_SHIFT,
+                (uint32_t)state << CONN_STATE_WLAN_SHIFT);
+    }
+    inline void setWwanState(LocNetConnState state) {
+        updateConnState(CONN_STATE_MASK << CONN_STATE_WWAN_SHIFT,
+                (uint32_t)state << CONN_STATE_WWAN_SHIFT);
+    }
+    inline void setWlanHwState(LocNetConnState state) {
+        updateConnState(CONN_STATE_MASK << CONN_STATE_WLAN_HW_SHIFT,
+                (uint32_t)state << CONN_STATE_WLAN_HW_SHIFT);
+    }
+    void updateConnState(uint32_t mask, uint32_t value);
+    /* Query QCMAP once for the current state and mark the cache synced */
+    void syncConnStateWithQcmap();
+
+    /* True while any client is subscribed to a QCMAP backed item */
+    static bool isQcmapNeeded();
 
     /* Private APIs to interact with QCMAP module */
     void subscribeWithQcmap();
@@ -122,6 +191,14 @@ private:
       void *ind_cb_data              /* User callback handle. */
     );
 
+    /* Call types set up through DSI on their own APN,
+     * Internet goes through the QCMAP backhaul instead */
+    inline bool isDsiConnType() const {
+        return mLocNetConnType == LOC_NET_CONN_TYPE_WWAN_SUPL ||
+                mLocNetConnType == LOC_NET_CONN_TYPE_WWAN_EMERGENCY ||
+                mLocNetConnType == LOC_NET_CONN_TYPE_WWAN_IMS;
+    }
+
     /* Data call setup specific members */
     bool mIsDsiInitDone;
     dsi_hndl_t mDsiHandle;
@@ -129,12 +206,71 @@ private:
     bool mIsDsiStartCallPending;
     bool mIsDsiStopCallPending;
 
+    /* Data call linger: a released call stays up for mCallLingerMs and
+     * is handed back as is to the next setup request */
+    class LingerTimer : public LocTimer {
+        LocNetIface& mLocNetIface;
+    public:
+        inline LingerTimer(LocNetIface& locNetIface) :
+            LocTimer(), mLocNetIface(locNetIface) {}
+        inline virtual void timeOutCallback() override {
+            mLocNetIface.handleLingerTimeout();
+        }
+    };
+    bool mIsDsiCallLingering;
+    /* Stop issued by the linger timeout, client was told already */
+    bool mIsDsiStopCallSilent;
+    /* Setup requested while a silent stop was pending */
+    bool mIsDsiRestartPending;
+    LingerTimer mLingerTimer;
+    void handleLingerTimeout();
+
+    /* Setup latency stats, to tell what linger saves */
+    int64_t mCallStartTimeMs;
+    uint32_t mCallSetups;
+    int64_t mCallSetupTotalMs;
+    uint32_t mCallsReused;
+
+    /* DSI init, handle and call parameters are set up on a worker
+     * thread at construction, so an open request only has to start
+     * the call. mDsiReady holds the outcome.
+     * The worker writes mIsDsiInitDone and mDsiHandle without mMutex.
+     * That is safe only because nothing else reads them before the
+     * future is ready: setupWwanCall() waits on mDsiReady first, and
+     * the wait orders the worker's writes before its own reads. Any new
+     * reader of these two must wait on mDsiReady as well. */
+    shared_future<bool> mDsiReady;
+    void prepareDsiCallAsync();
+    bool prepareDsiCall();
+
     /* Callback registered with DSI */
     static void dsiNetEventCallback(
             dsi_hndl_t dsiHandle, void* userDataPtr, dsi_net_evt_t event,
             dsi_evt_payload_t* eventPayloadPtr);
     void handleDSCallback(dsi_hndl_t dsiHandle, bool isNetConnected);
 
+    /* QCMAP indications tend to come in bursts. Data item updates are
+     * held for LOC_NET_NOTIFY_COALESCE_MS and then sent in a single
+     * notification carrying the last state of each item. Items are
+     * preallocated and reused. */
+    class NotifyTimer : public LocTimer {
+        LocNetIface& mLocNetIface;
+    public:
+        inline NotifyTimer(LocNetIface& locNetIface) :
+            LocTimer(), mLocNetIface(locNetIface) {}
+        inline virtual void timeOutCallback() override {
+            mLocNetIface.flushPendingNotifications();
+        }
+    };
+    NotifyTimer mNotifyTimer;
+    bool mIsNotifyTimerRunning;
+    WifiHardwareStateDataItem mPendingWifiState;
+    bool mIsWifiStatePending;
+    NetworkInfoDataItem mPendingNetworkInfo;
+    bool mIsNetworkInfoPending;
+    void schedulePendingNotifications();
+    void flushPendingNotifications();
+
     /* Mutex for synchronization */
     recursive_mutex mMutex;
 };